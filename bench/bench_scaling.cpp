@@ -0,0 +1,284 @@
+// bench/bench_scaling.cpp —— 并行阶段的线程扩展性基准
+//
+// 对同一个输入, 分别以 1, 2, 4, … N 个线程运行 并行解析 / 折叠 / 建树 / 渲染,
+// 每个阶段报告加速比、并行效率, 以及每个线程的忙碌 / 空闲时间和负载不均度（最忙线程 / 平均）,
+// 结果可写成 CSV 与 JSON, 再由 bench/scaling_chart.py 画成曲线
+//
+// 用法: bench_scaling [--threads 1,2,4,...] [--repeat N] [--csv FILE] [--json FILE] <input>
+
+#include "../include/parallel_flamegraph.hpp"
+
+#include <iomanip>
+#include <numeric>
+
+using namespace flamegraph;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+enum Stage { PARSE, COLLAPSE, BUILD, RENDER, STAGE_COUNT };
+
+constexpr const char* STAGE_NAMES[STAGE_COUNT] = {"parse", "collapse", "build", "render"};
+
+// 🔥 ===== 测量 =====
+
+struct StageRun {
+    double wall = 0;
+    std::vector<double> busy; // 下标为执行线程编号
+};
+
+struct StageResult {
+    size_t threads = 0;
+    Stage stage = PARSE;
+    StageRun run; // 取墙钟时间为中位数的那一次
+    double speedup = 0;
+    double efficiency = 0;
+
+    double busy_total() const {
+        double total = 0;
+        for (double b : run.busy) {
+            total += b;
+        }
+        return total;
+    }
+
+    // 忙碌时间占 线程数 × 墙钟 的比例
+    double utilization() const {
+        return busy_total() / std::max(run.wall * static_cast<double>(threads), 1e-12);
+    }
+
+    // 最忙线程 / 平均, 1 为完全均衡
+    double imbalance() const {
+        double mean = busy_total() / static_cast<double>(std::max<size_t>(1, run.busy.size()));
+        double max = run.busy.empty() ? 0 : *std::max_element(run.busy.begin(), run.busy.end());
+        return mean > 0 ? max / mean : 1;
+    }
+};
+
+class ScalingBench {
+  private:
+    std::string_view input_;
+    FlameGraphConfig config_;
+
+  public:
+    explicit ScalingBench(std::string_view input) : input_(input) {}
+
+    // 返回每个阶段各次运行的结果
+    std::vector<StageRun> run_once(ParallelExecutor& executor, ArenaSet& arenas) const {
+        std::vector<StageRun> runs(STAGE_COUNT);
+        WorkerTimer& timer = executor.worker_timer();
+        size_t chunk_count = executor.concurrency() * ExecutionPlanner::CHUNKS_PER_THREAD;
+        ArenaSetReleaseGuard arena_guard{arenas};
+
+        // 调用线程在阶段内的串行部分也算忙碌, 等待 worker 的时间由线程池扣除
+        auto measure = [&](Stage stage, auto&& body) {
+            timer.reset();
+            auto start = Clock::now();
+            timer.run(executor.worker_index(), body);
+            runs[stage].wall = std::chrono::duration<double>(Clock::now() - start).count();
+            runs[stage].busy = timer.busy_seconds();
+        };
+
+        SampleChunks chunks;
+        CollapsedEntries collapsed;
+        ParallelStackCollapser collapser(executor, chunk_count);
+        ParallelFlameGraphBuilder builder(executor, arenas);
+        FlameNodeRoot root{nullptr};
+        measure(PARSE, [&] { chunks = ParallelStackParser(executor, chunk_count, &arenas).parse(input_); });
+        measure(COLLAPSE, [&] { collapsed = collapser.collapse(chunks); });
+        measure(BUILD, [&] { root = builder.build_tree(collapsed); });
+        measure(RENDER, [&] { ParallelSvgFlameGraphRenderer(config_, executor).render(root, "/dev/null"); });
+        if (collapsed.empty()) {
+            throw FlameGraphException("No valid samples found in input");
+        }
+        return runs;
+    }
+
+    std::vector<StageResult> run(const std::vector<size_t>& thread_counts, size_t repeat) const {
+        std::vector<StageResult> results;
+        double baseline[STAGE_COUNT] = {};
+        for (size_t threads : thread_counts) {
+            ParallelExecutor executor(threads);
+            ArenaSet arenas(executor.concurrency());
+            executor.worker_timer().set_enabled(true);
+
+            run_once(executor, arenas); // 预热: 线程启动、页错误
+            std::vector<std::vector<StageRun>> runs;
+            for (size_t r = 0; r < repeat; ++r) {
+                runs.push_back(run_once(executor, arenas));
+            }
+
+            for (size_t s = 0; s < STAGE_COUNT; ++s) {
+                std::vector<size_t> order(repeat);
+                std::iota(order.begin(), order.end(), size_t{0});
+                std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return runs[a][s].wall < runs[b][s].wall; });
+
+                StageResult result;
+                result.threads = executor.concurrency();
+                result.stage = static_cast<Stage>(s);
+                result.run = runs[order[repeat / 2]][s];
+                if (baseline[s] == 0) {
+                    baseline[s] = result.run.wall; // 第一个线程数作为基准, 通常为 1
+                }
+                result.speedup = baseline[s] / std::max(result.run.wall, 1e-12);
+                result.efficiency = result.speedup * static_cast<double>(thread_counts.front()) /
+                                    static_cast<double>(result.threads);
+                results.push_back(std::move(result));
+            }
+        }
+        return results;
+    }
+};
+
+// 🔥 ===== 输出 =====
+
+void print_table(const std::vector<StageResult>& results) {
+    std::cout << "threads  stage        wall ms   speedup  efficiency  utilization  imbalance\n";
+    for (const auto& r : results) {
+        std::cout << std::setw(7) << r.threads << "  " << std::left << std::setw(9) << STAGE_NAMES[r.stage]
+                  << std::right << std::fixed << std::setprecision(2) << std::setw(11) << r.run.wall * 1e3
+                  << std::setw(10) << r.speedup << std::setw(11) << r.efficiency * 100 << "%" << std::setw(12)
+                  << r.utilization() * 100 << "%" << std::setw(11) << r.imbalance() << '\n';
+    }
+}
+
+void write_csv(const std::vector<StageResult>& results, const std::string& path) {
+    std::ofstream ofs(path);
+    if (! ofs.is_open()) {
+        throw OpenFileException(path);
+    }
+    ofs << std::setprecision(9);
+    ofs << "threads,stage,wall_s,speedup,efficiency,utilization,imbalance,busy_min_s,busy_max_s\n";
+    for (const auto& r : results) {
+        auto [min, max] = std::minmax_element(r.run.busy.begin(), r.run.busy.end());
+        ofs << r.threads << ',' << STAGE_NAMES[r.stage] << ',' << r.run.wall << ',' << r.speedup << ','
+            << r.efficiency << ',' << r.utilization() << ',' << r.imbalance() << ',' << *min << ',' << *max << '\n';
+    }
+}
+
+std::string json_escape(std::string_view s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+    return out;
+}
+
+void write_json(const std::vector<StageResult>& results,
+                const std::string& input,
+                size_t bytes,
+                size_t repeat,
+                const std::string& path) {
+    std::ofstream ofs(path);
+    if (! ofs.is_open()) {
+        throw OpenFileException(path);
+    }
+    ofs << std::setprecision(9);
+    ofs << "{\n  \"input\": \"" << json_escape(input) << "\",\n  \"bytes\": " << bytes << ",\n  \"repeat\": " << repeat
+        << ",\n  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const StageResult& r = results[i];
+        ofs << (i ? ",\n" : "\n") << "    {\"threads\": " << r.threads << ", \"stage\": \"" << STAGE_NAMES[r.stage]
+            << "\", \"wall_s\": " << r.run.wall << ", \"speedup\": " << r.speedup
+            << ", \"efficiency\": " << r.efficiency << ", \"utilization\": " << r.utilization()
+            << ", \"imbalance\": " << r.imbalance() << ", \"busy_s\": [";
+        for (size_t w = 0; w < r.run.busy.size(); ++w) {
+            ofs << (w ? ", " : "") << r.run.busy[w];
+        }
+        ofs << "], \"idle_s\": [";
+        for (size_t w = 0; w < r.run.busy.size(); ++w) {
+            ofs << (w ? ", " : "") << std::max(0.0, r.run.wall - r.run.busy[w]);
+        }
+        ofs << "]}";
+    }
+    ofs << "\n  ]\n}\n";
+}
+
+// 默认 1, 2, 4, … 直到硬件线程数（不是 2 的幂时最后补上硬件线程数）
+std::vector<size_t> default_thread_counts() {
+    size_t hw = std::max<size_t>(1, std::thread::hardware_concurrency());
+    std::vector<size_t> counts;
+    for (size_t t = 1; t < hw; t *= 2) {
+        counts.push_back(t);
+    }
+    counts.push_back(hw);
+    return counts;
+}
+
+std::vector<size_t> parse_thread_counts(std::string_view text) {
+    std::vector<size_t> counts;
+    while (! text.empty()) {
+        size_t comma = std::min(text.find(','), text.size());
+        std::string_view item = text.substr(0, comma);
+        size_t value = 0;
+        auto [ptr, ec] = std::from_chars(item.data(), item.data() + item.size(), value);
+        if (ec != std::errc() || ptr != item.data() + item.size() || value == 0) {
+            throw FlameGraphException("Invalid thread count: " + std::string(item));
+        }
+        counts.push_back(value);
+        text.remove_prefix(std::min(text.size(), comma + 1));
+    }
+    if (counts.empty()) {
+        throw FlameGraphException("--threads needs at least one count");
+    }
+    return counts;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::vector<size_t> thread_counts = default_thread_counts();
+    size_t repeat = 3;
+    std::string csv_path;
+    std::string json_path;
+    std::string input;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string_view arg = argv[i];
+            if ((arg == "--threads" || arg == "--repeat" || arg == "--csv" || arg == "--json") && i + 1 < argc) {
+                std::string_view value = argv[++i];
+                if (arg == "--threads") {
+                    thread_counts = parse_thread_counts(value);
+                } else if (arg == "--repeat") {
+                    repeat = std::max<size_t>(1, std::strtoul(value.data(), nullptr, 10));
+                } else if (arg == "--csv") {
+                    csv_path = value;
+                } else {
+                    json_path = value;
+                }
+            } else if (input.empty()) {
+                input = arg;
+            } else {
+                throw FlameGraphException("Unexpected argument: " + std::string(arg));
+            }
+        }
+        if (input.empty()) {
+            std::cerr << "Usage: " << argv[0] << " [--threads 1,2,4,...] [--repeat N] [--csv FILE] [--json FILE] <input>\n";
+            return 1;
+        }
+
+        MMapBuffer buffer(input);
+        std::cout << "📈 " << input << " (" << std::fixed << std::setprecision(1)
+                  << static_cast<double>(buffer.size) / (1024.0 * 1024.0) << " MB), repeat " << repeat << "\n";
+        auto results = ScalingBench(buffer.view()).run(thread_counts, repeat);
+        print_table(results);
+
+        if (! csv_path.empty()) {
+            write_csv(results, csv_path);
+            std::cout << "✅ CSV written to " << csv_path << "\n";
+        }
+        if (! json_path.empty()) {
+            write_json(results, input, buffer.size, repeat, json_path);
+            std::cout << "✅ JSON written to " << json_path << "\n";
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "❌ " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,285 @@
+// bench/bench_stages.cpp —— 分阶段微基准
+//
+// 对每个输入文件分别计时 解析 / 折叠 / 建树 / 渲染 四个阶段, 先预热再重复测量,
+// 输出各阶段耗时的分位数和吞吐量（MB/s、samples/s、nodes/s）以及各子系统的分配统计, 并可写出 JSON
+//
+// 用法: bench_stages [--warmup N] [--repeat N] [--json FILE] <input>...
+
+#include "../include/flamegraph.hpp"
+
+#include <chrono>
+#include <iomanip>
+
+using namespace flamegraph;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// 🔥 ===== 统计 =====
+
+struct Summary {
+    double min = 0;
+    double mean = 0;
+    double p50 = 0;
+    double p90 = 0;
+    double p99 = 0;
+    double max = 0;
+};
+
+// 最近秩法求分位数, samples 须已排序
+double percentile(const std::vector<double>& samples, double p) {
+    size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * static_cast<double>(samples.size())));
+    return samples[std::min(samples.size(), std::max<size_t>(1, rank)) - 1];
+}
+
+Summary summarize(std::vector<double> seconds) {
+    Summary s;
+    if (seconds.empty()) {
+        return s;
+    }
+    std::sort(seconds.begin(), seconds.end());
+    double sum = 0;
+    for (double v : seconds) {
+        sum += v;
+    }
+    s.min = seconds.front();
+    s.max = seconds.back();
+    s.mean = sum / static_cast<double>(seconds.size());
+    s.p50 = percentile(seconds, 50);
+    s.p90 = percentile(seconds, 90);
+    s.p99 = percentile(seconds, 99);
+    return s;
+}
+
+// 🔥 ===== 单个文件的测量 =====
+
+enum Stage { PARSE, COLLAPSE, BUILD, RENDER, TOTAL, STAGE_COUNT };
+
+constexpr const char* STAGE_NAMES[STAGE_COUNT] = {"parse", "collapse", "build", "render", "total"};
+
+struct FileResult {
+    std::string file;
+    size_t bytes = 0;
+    size_t samples = 0;
+    size_t unique_stacks = 0;
+    size_t nodes = 0;
+    RunStats::Memory memory;
+    std::vector<double> seconds[STAGE_COUNT];
+    Summary summary[STAGE_COUNT];
+};
+
+double elapsed(Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration<double>(to - from).count();
+}
+
+FileResult bench_file(const std::string& file, size_t warmup, size_t repeat) {
+    MMapBuffer buffer(file);
+    FileResult result;
+    result.file = file;
+    result.bytes = buffer.size;
+
+    FlameGraphConfig config;
+    auto renderer = FlameGraphRendererFactory::create("svg", config);
+    GenerationArena arena(true);
+
+    for (size_t run = 0; run < warmup + repeat; ++run) {
+        ArenaReleaseGuard arena_guard{arena};
+        CountingResource collapse_memory(arena.resource());
+        CountingResource tree_memory(arena.resource());
+        AutoDetectParser parser;
+        StackCollapser collapser(&collapse_memory);
+        FlameGraphBuilder builder(&tree_memory);
+
+        auto t0 = Clock::now();
+        StackSamplesContext ctx(arena.resource());
+        StackSamples samples = parser.parse(buffer.view(), ctx);
+        auto t1 = Clock::now();
+        CollapsedStack collapsed = collapser.collapse(samples);
+        auto t2 = Clock::now();
+        FlameNodeRoot root = builder.build_tree(collapsed);
+        auto t3 = Clock::now();
+        if (root.node->total_count == 0) {
+            throw FlameGraphException("No valid samples found in " + file);
+        }
+        // 渲染到 /dev/null, 只测格式化开销, 不测磁盘
+        renderer->render(root, "/dev/null");
+        auto t4 = Clock::now();
+
+        if (run == 0) {
+            result.samples = samples.raw_samples.size();
+            result.unique_stacks = collapsed.collapsed.size();
+            result.nodes = builder.node_count();
+            result.memory.samples = ctx.samples_allocations();
+            result.memory.frames = ctx.frames_allocations();
+            result.memory.collapse = collapse_memory.stats();
+            result.memory.tree = tree_memory.stats();
+        }
+        if (run < warmup) {
+            continue;
+        }
+        result.seconds[PARSE].push_back(elapsed(t0, t1));
+        result.seconds[COLLAPSE].push_back(elapsed(t1, t2));
+        result.seconds[BUILD].push_back(elapsed(t2, t3));
+        result.seconds[RENDER].push_back(elapsed(t3, t4));
+        result.seconds[TOTAL].push_back(elapsed(t0, t4));
+    }
+
+    for (size_t stage = 0; stage < STAGE_COUNT; ++stage) {
+        result.summary[stage] = summarize(result.seconds[stage]);
+    }
+    return result;
+}
+
+// 吞吐量按中位数耗时计算; 每个阶段用最能反映其工作量的单位
+struct Throughput {
+    const char* unit;
+    double value;
+};
+
+Throughput throughput(const FileResult& r, size_t stage) {
+    double t = std::max(r.summary[stage].p50, 1e-9);
+    switch (stage) {
+    case PARSE:
+    case TOTAL:
+        return {"MB/s", static_cast<double>(r.bytes) / (1024.0 * 1024.0) / t};
+    case COLLAPSE:
+        return {"samples/s", static_cast<double>(r.samples) / t};
+    default:
+        return {"nodes/s", static_cast<double>(r.nodes) / t};
+    }
+}
+
+// 🔥 ===== 输出 =====
+
+const std::pair<const char*, const AllocationStats RunStats::Memory::*> SUBSYSTEMS[] = {
+    {"samples", &RunStats::Memory::samples},
+    {"frames", &RunStats::Memory::frames},
+    {"collapse", &RunStats::Memory::collapse},
+    {"tree", &RunStats::Memory::tree},
+};
+
+double mib(size_t bytes) {
+    return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+
+void print_table(const FileResult& r) {
+    std::cout << "📄 " << r.file << "  (" << std::fixed << std::setprecision(1)
+              << static_cast<double>(r.bytes) / 1024.0 << " KB, " << r.samples << " samples, " << r.unique_stacks
+              << " stacks, " << r.nodes << " nodes)\n";
+    std::cout << "    stage        p50 ms      p90 ms      p99 ms     min ms    throughput\n";
+    for (size_t stage = 0; stage < STAGE_COUNT; ++stage) {
+        const Summary& s = r.summary[stage];
+        Throughput tp = throughput(r, stage);
+        std::cout << "    " << std::left << std::setw(9) << STAGE_NAMES[stage] << std::right << std::setprecision(3)
+                  << std::setw(10) << s.p50 * 1e3 << "  " << std::setw(10) << s.p90 * 1e3 << "  " << std::setw(10)
+                  << s.p99 * 1e3 << "  " << std::setw(9) << s.min * 1e3 << "    " << std::setprecision(1)
+                  << std::setw(12) << tp.value << ' ' << tp.unit << '\n';
+    }
+    std::cout << "    memory      allocs  requested MB   released MB   reserved MB   high-water MB\n";
+    for (const auto& [name, member] : SUBSYSTEMS) {
+        const AllocationStats& a = r.memory.*member;
+        std::cout << "    " << std::left << std::setw(9) << name << std::right << std::setw(9) << a.allocations
+                  << std::setprecision(2) << std::setw(15) << mib(a.bytes_requested) << std::setw(14)
+                  << mib(a.bytes_released) << std::setw(14) << mib(a.bytes_reserved) << std::setw(16)
+                  << mib(a.high_water) << '\n';
+    }
+}
+
+std::string json_escape(std::string_view s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+    return out;
+}
+
+void write_json(const std::vector<FileResult>& results, size_t warmup, size_t repeat, const std::string& path) {
+    std::ofstream ofs(path);
+    if (! ofs.is_open()) {
+        throw OpenFileException(path);
+    }
+    ofs << std::setprecision(9);
+    ofs << "{\n  \"warmup\": " << warmup << ",\n  \"repeat\": " << repeat << ",\n  \"files\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const FileResult& r = results[i];
+        ofs << (i ? ",\n" : "\n") << "    {\"file\": \"" << json_escape(r.file) << "\", \"bytes\": " << r.bytes
+            << ", \"samples\": " << r.samples << ", \"unique_stacks\": " << r.unique_stacks
+            << ", \"nodes\": " << r.nodes << ", \"stages\": {";
+        for (size_t stage = 0; stage < STAGE_COUNT; ++stage) {
+            const Summary& s = r.summary[stage];
+            Throughput tp = throughput(r, stage);
+            ofs << (stage ? ", " : "") << "\"" << STAGE_NAMES[stage] << "\": {\"min_s\": " << s.min
+                << ", \"mean_s\": " << s.mean << ", \"p50_s\": " << s.p50 << ", \"p90_s\": " << s.p90
+                << ", \"p99_s\": " << s.p99 << ", \"max_s\": " << s.max << ", \"throughput\": " << tp.value
+                << ", \"unit\": \"" << tp.unit << "\"}";
+        }
+        ofs << "}, \"memory\": {";
+        bool first = true;
+        for (const auto& [name, member] : SUBSYSTEMS) {
+            ofs << (first ? "" : ", ") << "\"" << name << "\": " << RunStats::allocation_json(r.memory.*member);
+            first = false;
+        }
+        ofs << "}}";
+    }
+    ofs << "\n  ]\n}\n";
+}
+
+size_t parse_count(const char* arg) {
+    char* end = nullptr;
+    unsigned long value = std::strtoul(arg, &end, 10);
+    if (end == arg || *end != '\0') {
+        throw FlameGraphException(std::string("Invalid count: ") + arg);
+    }
+    return value;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t warmup = 2;
+    size_t repeat = 10;
+    std::string json_path;
+    std::vector<std::string> files;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string_view arg = argv[i];
+            if ((arg == "--warmup" || arg == "--repeat" || arg == "--json") && i + 1 < argc) {
+                const char* value = argv[++i];
+                if (arg == "--warmup") {
+                    warmup = parse_count(value);
+                } else if (arg == "--repeat") {
+                    repeat = std::max<size_t>(1, parse_count(value));
+                } else {
+                    json_path = value;
+                }
+            } else {
+                files.emplace_back(arg);
+            }
+        }
+        if (files.empty()) {
+            std::cerr << "Usage: " << argv[0] << " [--warmup N] [--repeat N] [--json FILE] <input>...\n";
+            return 1;
+        }
+
+        std::cout << "⏱️  warmup " << warmup << ", repeat " << repeat << "\n";
+        std::vector<FileResult> results;
+        for (const auto& file : files) {
+            results.push_back(bench_file(file, warmup, repeat));
+            print_table(results.back());
+        }
+
+        if (! json_path.empty()) {
+            write_json(results, warmup, repeat, json_path);
+            std::cout << "✅ JSON written to " << json_path << "\n";
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "❌ " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -7,16 +7,21 @@ bench/benchmark.py  ——  综合基准：
 4. 自己的并行版  (./flamegraph_main_par)
 
 基准流程：
-• 生成 perf-script 测试数据
-• hyperfine 统一测量四个命令
-• 导出 JSON + 终端 Markdown 表格
+• 生成 perf-script 测试数据（--mode synthetic）, 或使用 bench/test_data/ 中的真实样本（--mode captures）
+• hyperfine 统一测量四个命令的墙钟时间
+• 再用 wait4 逐个运行, 取 user / sys CPU、最大 RSS（管道取各进程中的最大值）和输出文件大小
+• 导出 JSON + 终端 Markdown 表格 + 各指标柱状图
 """
 
+import argparse
 import json
+import os
 import shutil
 import subprocess
 import sys
+import time
 from pathlib import Path
+from statistics import median
 from typing import Dict, List
 from rich.console import Console
 from rich.table import Table
@@ -30,6 +35,7 @@ import numpy as np
 # ---------- 配置 ---------- #
 BASE_DIR = Path(__file__).parent.resolve()
 DATA_GEN = BASE_DIR / "../script/generate_perf_samples.py"
+CAPTURE_DIR = BASE_DIR / "test_data"
 PERF_FILE = "test_data.perf"
 
 console = Console()
@@ -38,7 +44,18 @@ TOOLS: Dict[str, str] = {
     "Perl": "stackcollapse-perf.pl {input} | flamegraph.pl > {output}",
     "inferno": "inferno-collapse-perf {input} | inferno-flamegraph > {output}",
     "FlameCrafter_Single": "./flamegraph_main {input} {output}",
+    "FlameCrafter_Parallel": "./flamegraph_main_par {input} {output}",
 }
+COLORS = ["#4E79A7", "#59A14F", "#F28E2B", "#E15759"]
+
+# 指标: (键, 表头, 图表纵轴, 图表文件)
+METRICS = [
+    ("wall", "mean wall, ms", "Mean time (ms)", "benchmark_chart.svg"),
+    ("user", "user CPU, ms", "User CPU (ms)", None),
+    ("sys", "sys CPU, ms", "Sys CPU (ms)", None),
+    ("rss", "max RSS, MB", "Max RSS (MB)", "benchmark_memory_chart.svg"),
+    ("size", "output, KB", "Output size (KB)", "benchmark_output_chart.svg"),
+]
 
 DATASETS: List[tuple] = [
     ("cute", 1_0, "10"),
@@ -50,15 +67,15 @@ DATASETS: List[tuple] = [
 ]
 
 HYPERFINE_COMMON = ["--warmup", "2", "--runs", "5", "--ignore-failure", "--show-output"]
+RUSAGE_RUNS = 3
 
 
-def save_bar_chart(rows, outfile: str = "benchmark_chart.svg"):
+def save_bar_chart(rows, metric: str = "wall", ylabel: str = "Mean time (ms)", outfile: str = "benchmark_chart.svg"):
     """
-    rows: [{'tag': '1 K', 'perl': '12.9', 'inferno': '5.3', ...}, ...]
+    rows: [{'tag': '1 K', 'wall': {'Perl': 12.9, ...}, 'rss': {...}, ...}, ...]
     """
     print(f"📊 Prepare generate chart to {outfile}")
-    tools = ["Perl", "inferno", "FlameCrafter_Single"]
-    colors = ["#4E79A7", "#59A14F", "#F28E2B"]
+    tools = list(TOOLS)
 
     n_rows = len(rows)
     fig, axs = plt.subplots(1, n_rows, figsize=(4 * n_rows, 5), sharey=False)
@@ -70,18 +87,18 @@ def save_bar_chart(rows, outfile: str = "benchmark_chart.svg"):
     for idx, row in enumerate(rows):
         ax = axs[idx]
         x_indexes = np.arange(len(tools))
-        values = [float(row.get(t, "0")) for t in tools]
+        values = [row[metric].get(t, 0.0) for t in tools]
 
-        bars = ax.bar(x_indexes, values, color=colors, width=0.6)
+        bars = ax.bar(x_indexes, values, color=COLORS[: len(tools)], width=0.6)
 
-        ax.set_title(f"Benchmark: {row['tag']} samples")
+        ax.set_title(f"{row['tag']}")
         ax.set_xticks(x_indexes)
         ax.set_xticklabels(tools, rotation=45, ha="right")
-        ax.set_ylabel("Mean time (ms)")
+        ax.set_ylabel(ylabel)
 
         # 可选：根据数值范围灵活调整 y 轴范围
-        max_val = max(values)
-        ax.set_ylim(0, max_val * 1.2)
+        max_val = max(values) if values else 0
+        ax.set_ylim(0, max_val * 1.2 if max_val > 0 else 1)
 
         # 在柱子顶部标注数值
         for bar in bars:
@@ -96,43 +113,42 @@ def save_bar_chart(rows, outfile: str = "benchmark_chart.svg"):
                 fontsize=8,
             )
 
-    plt.suptitle("Flame-graph benchmark (by tag)")
+    plt.suptitle(f"Flame-graph benchmark: {ylabel} (by tag)")
     plt.tight_layout(rect=[0, 0, 1, 0.95])  # 留出 suptitle 空间
     plt.savefig(outfile, format="svg")
+    plt.close(fig)
     print(f"📊 Chart saved to {outfile}")
 
 
+def fmt(value) -> str:
+    return "—" if value is None else f"{value:.1f}"
+
+
 def show_tables(rows):
-    # ── Rich 表格 ────────────────────────────────
-    t = Table(title="Flame-graph Benchmark (mean, ms)", show_lines=True)
-    t.add_column("Samples", justify="right")
-    t.add_column("Perl", justify="right")
-    t.add_column("inferno", justify="right")
-    t.add_column("FlameCrafter_Single", justify="right")
-
-    for row in rows:
-        t.add_row(
-            row["tag"],
-            row.get("Perl", "—"),
-            row.get("inferno", "—"),
-            row.get("FlameCrafter_Single", "—"),
-        )
-    console.print(t)
+    tools = list(TOOLS)
+
+    # ── Rich 表格: 每个指标一张 ──────────────────
+    for metric, title, _, _ in METRICS:
+        t = Table(title=f"Flame-graph Benchmark ({title})", show_lines=True)
+        t.add_column("Input", justify="right")
+        for tool in tools:
+            t.add_column(tool, justify="right")
+        for row in rows:
+            t.add_row(row["tag"], *[fmt(row[metric].get(tool)) for tool in tools])
+        console.print(t)
 
     # ── Markdown 输出 ────────────
-    md = [
-        "| Samples | Perl | inferno | FlameCrafter_Single |",
-        "|--------:|------:|--------:|----------:|",
-    ]
-    for r in rows:
-        md.append(
-            f"| {r['tag']:>7} | {r.get('Perl', '—'):>6} | {r.get('inferno', '—'):>8} | " 
-            f"{r.get('FlameCrafter_Single', '—'):>10} |"
-        )
+    md = []
+    for metric, title, _, _ in METRICS:
+        md.append(f"### {title}\n")
+        md.append("| Input | " + " | ".join(tools) + " |")
+        md.append("|------:|" + "|".join("------:" for _ in tools) + "|")
+        for r in rows:
+            md.append(f"| {r['tag']:>7} | " + " | ".join(f"{fmt(r[metric].get(t)):>8}" for t in tools) + " |")
+        md.append("")
 
     with open("benchmark_result.md", "w") as f:
         f.write("\n".join(md))
-        f.write("\n")
 
     console.print("✅ Markdown table saved to benchmark_result.md")
 
@@ -164,15 +180,15 @@ def gen_perf(samples: int):
 
 
 # ---------- run hyperfine ---------- #
-def run_hyperfine(tag: str):
+def tool_command(tmpl: str, input_file: str, output: str) -> str:
+    if "|" in tmpl or ">" in tmpl:
+        return f"sh -c '{tmpl.format(input=input_file, output=output)}'"
+    return tmpl.format(input=input_file, output=output)
+
+
+def run_hyperfine(tag: str, input_file: str):
     json_out = f"benchmark_{tag}.json"
-    cmd_list = []
-    for name, tmpl in TOOLS.items():
-        svg = f"{tag}_{name}.svg"
-        if "|" in tmpl or ">" in tmpl:
-            cmd_list.append(f"sh -c '{tmpl.format(input=PERF_FILE, output=svg)}'")
-        else:
-            cmd_list.append(tmpl.format(input=PERF_FILE, output=svg))
+    cmd_list = [tool_command(tmpl, input_file, f"{tag}_{name}.svg") for name, tmpl in TOOLS.items()]
 
     hyper_cmd = ["hyperfine", *HYPERFINE_COMMON, "--export-json", json_out, *cmd_list]
     print(f"🚀 hyperfine ({tag}) …")
@@ -180,8 +196,8 @@ def run_hyperfine(tag: str):
     return json_out
 
 
-def mean_ms(result: dict) -> str:
-    return f"{result['mean'] * 1000:.1f}"
+def mean_ms(result: dict) -> float:
+    return result["mean"] * 1000
 
 
 def parse_json(js_file: str) -> Dict[str, float]:
@@ -200,25 +216,90 @@ def parse_json(js_file: str) -> Dict[str, float]:
     return out
 
 
+# ---------- wait4: CPU 与内存 ---------- #
+def run_rusage(cmd: str) -> Dict[str, float]:
+    """运行一次, 返回墙钟、user/sys CPU（ms）与最大 RSS（MB）
+
+    wait4 的 rusage 包含子进程已回收的后代, 因此管道也能统计完整; ru_maxrss 是其中单个进程的最大值
+    """
+    start = time.perf_counter()
+    proc = subprocess.Popen(cmd, shell=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    _, status, usage = os.wait4(proc.pid, 0)
+    proc.returncode = os.waitstatus_to_exitcode(status)
+    wall = time.perf_counter() - start
+    return {
+        "wall": wall * 1000,
+        "user": usage.ru_utime * 1000,
+        "sys": usage.ru_stime * 1000,
+        "rss": usage.ru_maxrss / 1024,  # Linux 上单位为 KB
+        "ok": proc.returncode == 0,
+    }
+
+
+def measure_resources(tag: str, input_file: str) -> Dict[str, Dict[str, float]]:
+    """每个工具跑 RUSAGE_RUNS 次取中位数, 再记录输出文件大小"""
+    result: Dict[str, Dict[str, float]] = {"user": {}, "sys": {}, "rss": {}, "size": {}}
+    for name, tmpl in TOOLS.items():
+        svg = f"{tag}_{name}.svg"
+        runs = [run_rusage(tmpl.format(input=input_file, output=svg)) for _ in range(RUSAGE_RUNS)]
+        if not all(r["ok"] for r in runs):
+            print(f"⚠️  {name} failed on {tag}, skipped")
+            continue
+        for key in ("user", "sys", "rss"):
+            result[key][name] = median(r[key] for r in runs)
+        result["size"][name] = Path(svg).stat().st_size / 1024
+    return result
+
+
+# ---------- 数据集 ---------- #
+def synthetic_inputs():
+    for tag, samples, disp in DATASETS:
+        gen_perf(samples)
+        yield tag, disp, PERF_FILE
+
+
+def capture_inputs():
+    for capture in sorted(CAPTURE_DIR.glob("*.txt")):
+        yield capture.stem, capture.stem, str(capture)
+
+
 # ---------- 主入口 ---------- #
 def main():
+    ap = argparse.ArgumentParser(description="Compare flame-graph tools on time, CPU, memory and output size")
+    ap.add_argument(
+        "--mode",
+        choices=["synthetic", "captures", "all"],
+        default="synthetic",
+        help="synthetic sizes, the real captures in bench/test_data/, or both",
+    )
+    args = ap.parse_args()
+
     sanity_check()
 
-    summary_rows = []
+    sources = []
+    if args.mode in ("synthetic", "all"):
+        sources.append(synthetic_inputs())
+    if args.mode in ("captures", "all"):
+        sources.append(capture_inputs())
 
-    for tag, samples, disp in DATASETS:
-        print("\n" + "=" * 60)
-        print(f"🔬 Benchmark {disp} ({samples:,} samples)")
-        print("=" * 60)
-        gen_perf(samples)
-        js = run_hyperfine(tag)
-        res = parse_json(js)
-        row = {"tag": disp, **res}
-        summary_rows.append(row)
+    summary_rows = []
+    for source in sources:
+        for tag, disp, input_file in source:
+            print("\n" + "=" * 60)
+            print(f"🔬 Benchmark {disp} ({Path(input_file).stat().st_size / 1024:.1f} KB)")
+            print("=" * 60)
+            js = run_hyperfine(tag, input_file)
+            row = {"tag": disp, "wall": parse_json(js), **measure_resources(tag, input_file)}
+            summary_rows.append(row)
+
+    with open("benchmark_summary.json", "w") as f:
+        json.dump(summary_rows, f, indent=2)
 
     print("\n🏁 All benchmark finished!\n")
     show_tables(summary_rows)
-    save_bar_chart(summary_rows)
+    for metric, _, ylabel, outfile in METRICS:
+        if outfile:
+            save_bar_chart(summary_rows, metric, ylabel, outfile)
 
 
 if __name__ == "__main__":
@@ -0,0 +1,169 @@
+// bench/elf_symbols_check.cpp —— ELF 符号还原的 build-id 校验
+//
+// 在临时目录中生成几个只有一个函数符号的最小 ELF 文件, 检查 ElfSymbolResolver:
+//   1. 搜索目录中 build-id 不同的同名文件（另一次构建）被跳过, 不会还原出它的符号, 也不会写入缓存
+//   2. build-id 相同的调试文件照常使用, 缓存以该 build-id 为键
+// 任何不一致都以非零退出码结束
+//
+// 用法: elf_symbols_check [work_dir]
+
+#include "../include/elf_symbols.hpp"
+
+#include <iostream>
+
+using namespace flamegraph;
+
+namespace {
+
+constexpr uint64_t FUNCTION_VADDR = 0x1000;
+
+// 64 位 ET_DYN: 一个覆盖 [0, 0x2000) 的 PT_LOAD 段、GNU build-id note、只含 name 一个函数的 .symtab
+std::string make_elf(const std::string& build_id, const std::string& name) {
+    std::string note(sizeof(Elf64_Nhdr), '\0');
+    Elf64_Nhdr nhdr{};
+    nhdr.n_namesz = 4;
+    nhdr.n_descsz = static_cast<Elf64_Word>(build_id.size());
+    nhdr.n_type = NT_GNU_BUILD_ID;
+    std::memcpy(note.data(), &nhdr, sizeof(nhdr));
+    note.append("GNU\0", 4);
+    note += build_id;
+    note.resize((note.size() + 3) & ~size_t{3}, '\0');
+
+    std::string strings = std::string(1, '\0') + name + '\0';
+    Elf64_Sym symbols[2]{};
+    symbols[1].st_name = 1;
+    symbols[1].st_info = static_cast<unsigned char>((STB_GLOBAL << 4) | STT_FUNC);
+    symbols[1].st_shndx = 1;
+    symbols[1].st_value = FUNCTION_VADDR;
+    symbols[1].st_size = 0x100;
+
+    uint64_t note_at = sizeof(Elf64_Ehdr) + sizeof(Elf64_Phdr);
+    uint64_t symtab_at = note_at + note.size();
+    uint64_t strtab_at = symtab_at + sizeof(symbols);
+    uint64_t sections_at = (strtab_at + strings.size() + 7) & ~uint64_t{7};
+
+    Elf64_Ehdr header{};
+    std::memcpy(header.e_ident, ELFMAG, SELFMAG);
+    header.e_ident[EI_CLASS] = ELFCLASS64;
+    uint16_t probe = 1;
+    unsigned char little = 0;
+    std::memcpy(&little, &probe, 1);
+    header.e_ident[EI_DATA] = little == 1 ? ELFDATA2LSB : ELFDATA2MSB;
+    header.e_ident[EI_VERSION] = EV_CURRENT;
+    header.e_type = ET_DYN;
+    header.e_version = EV_CURRENT;
+    header.e_phoff = sizeof(Elf64_Ehdr);
+    header.e_shoff = sections_at;
+    header.e_ehsize = sizeof(Elf64_Ehdr);
+    header.e_phentsize = sizeof(Elf64_Phdr);
+    header.e_phnum = 1;
+    header.e_shentsize = sizeof(Elf64_Shdr);
+    header.e_shnum = 4;
+
+    Elf64_Phdr load{};
+    load.p_type = PT_LOAD;
+    load.p_filesz = 0x2000;
+    load.p_memsz = 0x2000;
+
+    Elf64_Shdr sections[4]{};
+    sections[1].sh_type = SHT_NOTE;
+    sections[1].sh_offset = note_at;
+    sections[1].sh_size = note.size();
+    sections[2].sh_type = SHT_SYMTAB;
+    sections[2].sh_offset = symtab_at;
+    sections[2].sh_size = sizeof(symbols);
+    sections[2].sh_link = 3;
+    sections[2].sh_entsize = sizeof(Elf64_Sym);
+    sections[3].sh_type = SHT_STRTAB;
+    sections[3].sh_offset = strtab_at;
+    sections[3].sh_size = strings.size();
+
+    std::string bytes;
+    bytes.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    bytes.append(reinterpret_cast<const char*>(&load), sizeof(load));
+    bytes += note;
+    bytes.append(reinterpret_cast<const char*>(symbols), sizeof(symbols));
+    bytes += strings;
+    bytes.resize(sections_at, '\0');
+    bytes.append(reinterpret_cast<const char*>(sections), sizeof(sections));
+    return bytes;
+}
+
+void write_elf(const std::filesystem::path& path, const std::string& build_id, const std::string& name) {
+    std::filesystem::create_directories(path.parent_path());
+    std::ofstream ofs(path, std::ios::binary);
+    ofs << make_elf(build_id, name);
+}
+
+// 还原 dso 中 FUNCTION_VADDR 处的文件偏移, 找不到时为空
+std::string resolve(const ElfSymbolOptions& options, const std::string& dso) {
+    ElfSymbolResolver resolver(options);
+    std::vector<ElfSymbolResolver::Request> requests(1);
+    requests[0].dso = dso;
+    requests[0].address = FUNCTION_VADDR + 0x10;
+    requests[0].is_offset = true;
+    resolver.resolve(requests);
+    return std::string(requests[0].name);
+}
+
+size_t expect(const std::string& label, const std::string& actual, const std::string& expected) {
+    if (actual == expected) {
+        std::cout << "  ✅ " << label << '\n';
+        return 0;
+    }
+    std::cout << "  ❌ " << label << ": got \"" << actual << "\", expected \"" << expected << "\"\n";
+    return 1;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    namespace fs = std::filesystem;
+    fs::path work = argc > 1 ? argv[1] : "build/elf_symbols_check.d";
+    const std::string original_id = "\x11\x22\x33\x44";
+    const std::string other_id = "\x55\x66\x77\x88";
+    const std::string original_hex = "11223344";
+    const std::string other_hex = "55667788";
+
+    size_t failures = 0;
+    try {
+        fs::remove_all(work);
+        std::string dso = (work / "host/lib/libfoo.so").string();
+        write_elf(dso, original_id, "right_function");
+        write_elf(work / "other/libfoo.so", other_id, "wrong_function");
+        write_elf(work / "debug/libfoo.so.debug", original_id, "debug_function");
+
+        std::cout << "🔍 candidate with another build-id\n";
+        ElfSymbolOptions options;
+        options.search_paths = {(work / "other").string()};
+        options.cache_dir = (work / "cache").string();
+        failures += expect("falls back to the original file", resolve(options, dso), "right_function");
+        failures += expect("cached under the original build-id",
+                           std::to_string(fs::exists(work / "cache" / (original_hex + ".symtab"))), "1");
+        failures += expect("nothing cached under the other build-id",
+                           std::to_string(fs::exists(work / "cache" / (other_hex + ".symtab"))), "0");
+
+        options.use_original_path = false;
+        options.cache_dir = (work / "cache-empty").string();
+        failures += expect("only a mismatching candidate resolves nothing", resolve(options, dso), "");
+        failures += expect("nothing cached when every candidate is skipped",
+                           std::to_string(fs::exists(options.cache_dir)), "0");
+
+        std::cout << "🔍 debug file with the same build-id\n";
+        options.search_paths = {(work / "other").string(), (work / "debug").string()};
+        options.cache_dir = (work / "cache-debug").string();
+        failures += expect("matching debug file is used", resolve(options, dso), "debug_function");
+        failures += expect("cached under the verified build-id",
+                           std::to_string(fs::exists(work / "cache-debug" / (original_hex + ".symtab"))), "1");
+    } catch (const std::exception& e) {
+        std::cerr << "❌ " << e.what() << '\n';
+        return 1;
+    }
+
+    if (failures > 0) {
+        std::cout << "❌ " << failures << " check(s) failed\n";
+        return 1;
+    }
+    std::cout << "✅ all checks passed\n";
+    return 0;
+}
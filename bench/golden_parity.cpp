@@ -0,0 +1,627 @@
+// bench/golden_parity.cpp —— 折叠输出一致性检查
+//
+// 对 test_data 中的每个 capture 运行所有解析/折叠路径（串行、分阶段并行、流水线、多文件、
+// 拆分后合并、时间切片后合并、滚动聚合）, 把折叠结果规范化（合并重复行、排序）后:
+//   1. 各路径之间两两一致, 能输出 SVG 的路径 SVG 也须逐字节一致
+//   2. 与 results/ 中的 golden 文件一致; 已知差异登记在 xfail 文件中（写明原因）, 差异的全部行记录在
+//      与 xfail 文件同名的目录下（<capture>.diff）, 实际差异须与记录完全相同: 多出的差异是回归,
+//      少掉的差异或意外通过同样报错, 以便及时更新记录或移除条目
+//   3. 打开根帧与帧注解（--pid/--tid/--kernel/--jit/--addrs/--all）时, 几条代表性路径之间一致,
+//      并与对应的 -collapsed-<模式>.txt 逐行一致（不做规范化）; 已知差异按 (capture, 模式) 登记, 同样记录全部差异行
+// 任何不一致都以非零退出码结束
+//
+// 用法: golden_parity [--record-xfail] [data_dir] [golden_dir] [work_dir] [xfail_file]
+//       --record-xfail 把 xfail 条目的当前差异写入记录文件, 修改解析或更新 golden 后用它重新记录
+
+#include "../include/parallel_flamegraph.hpp"
+#include "../include/rolling_flamegraph.hpp"
+
+#include <map>
+#include <set>
+
+using namespace flamegraph;
+
+namespace {
+
+// 🔥 ===== 规范化 =====
+
+// 堆栈 -> 次数, 有序, 重复行已合并
+using Folded = std::map<std::string, size_t>;
+
+std::string read_file(const std::string& path) {
+    std::ifstream ifs(path, std::ios::binary);
+    if (! ifs.is_open()) {
+        throw OpenFileException(path);
+    }
+    std::ostringstream oss;
+    oss << ifs.rdbuf();
+    return oss.str();
+}
+
+void write_file(const std::string& path, std::string_view content) {
+    std::ofstream ofs(path, std::ios::binary);
+    if (! ofs.is_open()) {
+        throw OpenFileException(path);
+    }
+    ofs << content;
+}
+
+// golden 文件带进程名根帧和 _[k]/_[j] 注解, 默认模式两者都不输出, 比较前去掉
+std::string normalize_golden_stack(std::string_view stack) {
+    size_t root_end = stack.find(';');
+    if (root_end == std::string_view::npos) {
+        return {};
+    }
+    std::string out;
+    for (size_t begin = root_end + 1; begin <= stack.size();) {
+        size_t end = std::min(stack.find(';', begin), stack.size());
+        std::string_view frame = stack.substr(begin, end - begin);
+        if (frame.size() > 4 && (frame.substr(frame.size() - 4) == "_[k]" || frame.substr(frame.size() - 4) == "_[j]")) {
+            frame.remove_suffix(4);
+        }
+        if (! out.empty()) {
+            out += ';';
+        }
+        out += frame;
+        begin = end + 1;
+    }
+    return out;
+}
+
+Folded parse_folded(std::string_view text, bool golden) {
+    Folded folded;
+    LineScanner scanner(text);
+    while (! scanner.eof()) {
+        std::string_view line = scanner.next_trimmed_line();
+        size_t space = line.rfind(' ');
+        if (line.empty() || space == std::string_view::npos) {
+            continue;
+        }
+        size_t count = 0;
+        auto count_text = line.substr(space + 1);
+        auto [ptr, ec] = std::from_chars(count_text.data(), count_text.data() + count_text.size(), count);
+        if (ec != std::errc() || ptr != count_text.data() + count_text.size()) {
+            throw ParseException("Bad folded line: " + std::string(line));
+        }
+        std::string stack = golden ? normalize_golden_stack(line.substr(0, space)) : std::string(line.substr(0, space));
+        if (! stack.empty()) {
+            folded[stack] += count;
+        }
+    }
+    return folded;
+}
+
+// 🔥 ===== 差异报告 =====
+
+struct Diff {
+    size_t only_left = 0;
+    size_t only_right = 0;
+    size_t count_mismatch = 0;
+    std::vector<std::string> examples;
+    std::vector<std::string> lines; // 全部差异行, 不截断, 与 xfail 的记录比较
+
+    bool empty() const {
+        return only_left == 0 && only_right == 0 && count_mismatch == 0;
+    }
+};
+
+std::string clip(const std::string& s) {
+    constexpr size_t MAX = 160;
+    return s.size() <= MAX ? s : s.substr(0, MAX) + "...";
+}
+
+Diff diff_folded(const Folded& left, const Folded& right) {
+    constexpr size_t MAX_EXAMPLES = 3;
+    Diff diff;
+    auto example = [&](char kind, const std::string& stack, std::string counts) {
+        if (diff.examples.size() < MAX_EXAMPLES) {
+            diff.examples.push_back(kind + (" " + clip(stack)) + " " + counts);
+        }
+        diff.lines.push_back(kind + (" " + stack) + " " + counts);
+    };
+
+    auto l = left.begin();
+    auto r = right.begin();
+    while (l != left.end() || r != right.end()) {
+        if (r == right.end() || (l != left.end() && l->first < r->first)) {
+            ++diff.only_left;
+            example('-', l->first, std::to_string(l->second));
+            ++l;
+        } else if (l == left.end() || r->first < l->first) {
+            ++diff.only_right;
+            example('+', r->first, std::to_string(r->second));
+            ++r;
+        } else {
+            if (l->second != r->second) {
+                ++diff.count_mismatch;
+                example('~', l->first, std::to_string(l->second) + " vs " + std::to_string(r->second));
+            }
+            ++l;
+            ++r;
+        }
+    }
+    return diff;
+}
+
+void print_diff(const Diff& diff) {
+    std::cout << "      " << diff.only_left << " stacks only on the left, " << diff.only_right
+              << " only on the right, " << diff.count_mismatch << " with different counts\n";
+    for (const auto& line : diff.examples) {
+        std::cout << "      " << line << '\n';
+    }
+}
+
+// 🔥 ===== 各条执行路径 =====
+
+struct VariantOutput {
+    Folded folded;
+    std::string svg; // 空表示该路径不输出 SVG
+    bool skipped = false;
+};
+
+FlameGraphConfig folded_config() {
+    FlameGraphConfig config;
+    config.write_folded_file = true;
+    return config;
+}
+
+// golden 按 stackcollapse-perf.pl 的默认参数生成, 去掉了函数的参数列表; 所有路径都按同样的选项解析
+ParseOptions parse_options() {
+    ParseOptions options;
+    options.strip_args = true;
+    return options;
+}
+
+VariantOutput read_outputs(const std::string& out) {
+    VariantOutput result;
+    result.folded = parse_folded(read_file(out + ".collapse"), false);
+    result.svg = read_file(out);
+    return result;
+}
+
+// 拆分/切片输出: 把各组的折叠结果加回一张, 应与整体结果相同
+VariantOutput merge_partitions(const ParallelFlameGraphGenerator& generator) {
+    VariantOutput result;
+    for (const auto& partition : generator.get_last_partitions()) {
+        for (const auto& [stack, count] : parse_folded(read_file(partition.path + ".collapse"), false)) {
+            result.folded[stack] += count;
+        }
+    }
+    return result;
+}
+
+VariantOutput run_serial(const std::string& in, const std::string& out, const ParseOptions& parse_opts) {
+    FlameGraphGenerator generator(folded_config());
+    generator.set_parse_options(parse_opts);
+    generator.generate(in, out);
+    return read_outputs(out);
+}
+
+VariantOutput run_parallel(const std::string& in, const std::string& out, size_t threads, bool auto_plan,
+                           const ParseOptions& parse_opts) {
+    ParallelFlameGraphGenerator generator(folded_config(), threads);
+    generator.set_parse_options(parse_opts);
+    generator.set_auto_plan(auto_plan);
+    generator.generate(in, out);
+    return read_outputs(out);
+}
+
+VariantOutput run_pipelined(const std::string& in, const std::string& out, size_t threads, size_t chunk_bytes,
+                            const ParseOptions& parse_opts) {
+    ParallelFlameGraphGenerator generator(folded_config(), threads);
+    generator.set_parse_options(parse_opts);
+    generator.set_auto_plan(false);
+    PipelineOptions options;
+    options.enabled = true;
+    options.chunk_bytes = chunk_bytes;
+    generator.set_pipeline_options(options);
+    generator.generate(in, out);
+    return read_outputs(out);
+}
+
+// 在中点之后的第一个样本边界处切成两个文件
+VariantOutput run_multi_file(const std::string& in, const std::string& out, size_t threads) {
+    std::string text = read_file(in);
+    size_t cut = text.find("\n\n", text.size() / 2);
+    cut = cut == std::string::npos ? text.size() : cut + 2;
+    write_file(out + ".part0", std::string_view(text).substr(0, cut));
+    write_file(out + ".part1", std::string_view(text).substr(cut));
+
+    ParallelFlameGraphGenerator generator(folded_config(), threads);
+
+    generator.set_parse_options(parse_options());
+    generator.generate(std::vector<std::string>{out + ".part0", out + ".part1"}, out);
+    return read_outputs(out);
+}
+
+VariantOutput run_split(const std::string& in, const std::string& out, SplitBy split_by) {
+    ParallelFlameGraphGenerator generator(folded_config(), 4);
+    generator.set_parse_options(parse_options());
+    generator.set_split_by(split_by);
+    generator.generate(in, out);
+    return merge_partitions(generator);
+}
+
+bool has_timestamps(const std::string& in) {
+    MMapBuffer buffer(in);
+    StackSamplesContext ctx;
+    StackSamples samples = AutoDetectParser().parse(buffer.view(), ctx);
+    return std::any_of(samples.raw_samples.begin(), samples.raw_samples.end(),
+                       [](const StackSample& sample) { return sample.timestamp != 0; });
+}
+
+VariantOutput run_time_slices(const std::string& in, const std::string& out) {
+    if (! has_timestamps(in)) {
+        VariantOutput skipped;
+        skipped.skipped = true;
+        return skipped;
+    }
+    ParallelFlameGraphGenerator generator(folded_config(), 4);
+    generator.set_parse_options(parse_options());
+    TimeSliceOptions options;
+    options.window_us = 100'000;
+    options.heatmap = false;
+    generator.set_time_slices(options);
+    generator.generate(in, out);
+    return merge_partitions(generator);
+}
+
+VariantOutput run_rolling(const std::string& in, const ParseOptions& parse_opts) {
+    RollingFlameGraphAggregator aggregator(1);
+    MMapBuffer buffer(in);
+    aggregator.add_text(buffer.view(), parse_opts);
+
+    GenerationArena arena;
+    CollapsedStack collapsed = aggregator.snapshot_stacks(arena.resource());
+    VariantOutput result;
+    for (const auto& [frames, count] : collapsed.collapsed) {
+        std::ostringstream line;
+        StackCollapser::write_folded_line(line, frames, count);
+        for (const auto& [stack, c] : parse_folded(line.str(), false)) {
+            result.folded[stack] += c;
+        }
+    }
+    return result;
+}
+
+struct Variant {
+    std::string name;
+    std::function<VariantOutput(const std::string& in, const std::string& out)> run;
+};
+
+std::vector<Variant> all_variants() {
+    std::vector<Variant> variants;
+    variants.push_back({"serial", [](const std::string& in, const std::string& out) {
+                            return run_serial(in, out, parse_options());
+                        }});
+    variants.push_back({"parallel-auto", [](const std::string& in, const std::string& out) {
+                            return run_parallel(in, out, 4, true, parse_options());
+                        }});
+    for (size_t threads : {1, 2, 4, 8}) {
+        variants.push_back({"staged-t" + std::to_string(threads), [threads](const std::string& in, const std::string& out) {
+                                return run_parallel(in, out, threads, false, parse_options());
+                            }});
+    }
+    // 小块让样本边界落在块边界附近的各种位置
+    for (size_t chunk_bytes : {size_t{4096}, size_t{1} << 20}) {
+        variants.push_back({"pipelined-" + std::to_string(chunk_bytes), [chunk_bytes](const std::string& in,
+                                                                                       const std::string& out) {
+                                return run_pipelined(in, out, 4, chunk_bytes, parse_options());
+                            }});
+    }
+    variants.push_back({"multi-file", [](const std::string& in, const std::string& out) {
+                            return run_multi_file(in, out, 2);
+                        }});
+    variants.push_back({"split-pid", [](const std::string& in, const std::string& out) {
+                            return run_split(in, out, SplitBy::Pid);
+                        }});
+    variants.push_back({"split-comm", [](const std::string& in, const std::string& out) {
+                            return run_split(in, out, SplitBy::Comm);
+                        }});
+    variants.push_back({"time-slices", [](const std::string& in, const std::string& out) {
+                            return run_time_slices(in, out);
+                        }});
+    variants.push_back({"rolling", [](const std::string& in, const std::string&) {
+                            return run_rolling(in, parse_options());
+                        }});
+    return variants;
+}
+
+// 🔥 ===== 根帧与帧注解 =====
+
+struct AnnotationMode {
+    std::string name; // 即 golden 文件名的后缀
+    ParseOptions options;
+};
+
+// 与生成 golden 时 stackcollapse-perf.pl 的参数对应, 除 --pid/--tid 外都带进程名根帧
+std::vector<AnnotationMode> annotation_modes() {
+    auto mode = [](std::string name, ProcessFrame process_frame, bool kernel, bool jit, bool addrs) {
+        AnnotationMode result{std::move(name), parse_options()};
+        result.options.process_frame = process_frame;
+        result.options.annotate_kernel = kernel;
+        result.options.annotate_jit = jit;
+        result.options.annotate_addrs = addrs;
+        return result;
+    };
+    return {
+        mode("pid", ProcessFrame::Pid, false, false, false),
+        mode("tid", ProcessFrame::Tid, false, false, false),
+        mode("kernel", ProcessFrame::Comm, true, false, false),
+        mode("jit", ProcessFrame::Comm, false, true, false),
+        mode("addrs", ProcessFrame::Comm, false, false, true),
+        mode("all", ProcessFrame::Comm, true, true, false),
+    };
+}
+
+// 根帧与注解的名字引用输入缓冲区, 选串行、分阶段、小块流水线（跨块边界）和滚动聚合（复制符号）几条路径
+std::vector<Variant> annotated_variants(const ParseOptions& parse_opts) {
+    std::vector<Variant> variants;
+    variants.push_back({"serial", [parse_opts](const std::string& in, const std::string& out) {
+                            return run_serial(in, out, parse_opts);
+                        }});
+    variants.push_back({"staged-t4", [parse_opts](const std::string& in, const std::string& out) {
+                            return run_parallel(in, out, 4, false, parse_opts);
+                        }});
+    variants.push_back({"pipelined-4096", [parse_opts](const std::string& in, const std::string& out) {
+                            return run_pipelined(in, out, 4, 4096, parse_opts);
+                        }});
+    variants.push_back({"rolling", [parse_opts](const std::string& in, const std::string&) {
+                            return run_rolling(in, parse_opts);
+                        }});
+    return variants;
+}
+
+// 🔥 ===== 已知差异 =====
+
+// xfail 文件: 每行一个 capture 名（默认模式）或 "capture:模式[,模式...]", # 之后为注释（写明差异原因）;
+// 条目按 (capture, 模式) 展开, 每个的差异行记录在 <xfail 文件去掉扩展名>/<capture>[.<模式>].diff, 每行一条, 已排序
+struct Xfail {
+    std::string path;
+    std::filesystem::path dir;
+    std::set<std::string> keys;
+    bool record = false;
+
+    Xfail(std::string xfail_path, bool record_diffs)
+        : path(std::move(xfail_path)), dir(std::filesystem::path(path).replace_extension()), record(record_diffs) {
+        if (path.empty() || ! std::filesystem::exists(path)) {
+            return;
+        }
+        std::string text = read_file(path);
+        LineScanner scanner(text);
+        while (! scanner.eof()) {
+            std::string_view line = scanner.next_trimmed_line();
+            line = trim(line.substr(0, line.find('#')));
+            size_t colon = line.find(':');
+            if (colon == std::string_view::npos) {
+                if (! line.empty()) {
+                    keys.emplace(line);
+                }
+                continue;
+            }
+            std::string_view modes = line.substr(colon + 1);
+            for (size_t begin = 0; begin <= modes.size();) {
+                size_t end = std::min(modes.find(',', begin), modes.size());
+                std::string_view mode = trim(modes.substr(begin, end - begin));
+                if (! mode.empty()) {
+                    keys.emplace(std::string(trim(line.substr(0, colon))) + ":" + std::string(mode));
+                }
+                begin = end + 1;
+            }
+        }
+    }
+
+    std::filesystem::path diff_path(std::string key) const {
+        std::replace(key.begin(), key.end(), ':', '.');
+        return dir / (key + ".diff");
+    }
+
+    std::vector<std::string> read_diff(const std::string& key) const {
+        std::vector<std::string> lines;
+        std::filesystem::path file = diff_path(key);
+        if (! std::filesystem::exists(file)) {
+            return lines;
+        }
+        std::string text = read_file(file.string());
+        for (size_t begin = 0; begin < text.size();) {
+            size_t end = std::min(text.find('\n', begin), text.size());
+            if (end > begin) {
+                lines.emplace_back(text, begin, end - begin);
+            }
+            begin = end + 1;
+        }
+        std::sort(lines.begin(), lines.end());
+        return lines;
+    }
+
+    void write_diff(const std::string& key, const std::vector<std::string>& lines) const {
+        std::filesystem::create_directories(dir);
+        std::string text;
+        for (const auto& line : lines) {
+            text += line;
+            text += '\n';
+        }
+        write_file(diff_path(key).string(), text);
+    }
+};
+
+// 两组已排序差异行的差集, count 为总数, 只返回前几行
+std::vector<std::string> missing_from(const std::vector<std::string>& lines, const std::vector<std::string>& other,
+                                      size_t& count) {
+    constexpr size_t MAX_EXAMPLES = 3;
+    std::vector<std::string> missing;
+    std::set_difference(lines.begin(), lines.end(), other.begin(), other.end(), std::back_inserter(missing));
+    count = missing.size();
+    if (missing.size() > MAX_EXAMPLES) {
+        missing.resize(MAX_EXAMPLES);
+    }
+    for (auto& line : missing) {
+        line = clip(line);
+    }
+    return missing;
+}
+
+// 运行各条路径并与第一条比较, 返回第一条的输出; label 为输出中的模式前缀
+VariantOutput run_variants(const std::vector<Variant>& variants, const std::string& capture, const std::string& out_prefix,
+                           const std::string& label, size_t& failures) {
+    VariantOutput reference;
+    for (size_t v = 0; v < variants.size(); ++v) {
+        std::string out = out_prefix + "." + variants[v].name + ".svg";
+        VariantOutput output;
+        try {
+            output = variants[v].run(capture, out);
+        } catch (const std::exception& e) {
+            std::cout << "  ❌ " << label << variants[v].name << ": " << e.what() << '\n';
+            ++failures;
+            continue;
+        }
+        if (output.skipped) {
+            std::cout << "  ⏭️  " << label << variants[v].name << ": skipped\n";
+            continue;
+        }
+        if (v == 0) {
+            reference = std::move(output);
+            continue;
+        }
+        Diff diff = diff_folded(reference.folded, output.folded);
+        bool svg_differs = ! output.svg.empty() && output.svg != reference.svg;
+        if (! diff.empty() || svg_differs) {
+            std::cout << "  ❌ " << label << variants[v].name << " differs from " << variants[0].name
+                      << (svg_differs ? " (svg differs)" : "") << '\n';
+            print_diff(diff);
+            ++failures;
+        }
+    }
+    return reference;
+}
+
+// key 为 xfail 条目: 默认模式为 capture, 注解模式为 "capture:模式"; 返回失败数（0 或 1）
+size_t check_golden(const std::string& golden_path, bool normalize, const Folded& ours, const std::string& label,
+                    const std::string& key, const Xfail& xfail) {
+    if (! std::filesystem::exists(golden_path)) {
+        std::cout << "  ⏭️  " << label << ": no " << golden_path << '\n';
+        return 0;
+    }
+    Diff diff = diff_folded(parse_folded(read_file(golden_path), normalize), ours);
+    std::sort(diff.lines.begin(), diff.lines.end());
+    bool listed = xfail.keys.count(key) > 0;
+    if (diff.empty() && listed) {
+        std::cout << "  ❌ " << label << ": matches but is listed in " << xfail.path << ", remove it\n";
+        return 1;
+    } else if (diff.empty()) {
+        std::cout << "  ✅ " << label << '\n';
+    } else if (! listed) {
+        std::cout << "  ❌ " << label << " differs (left: golden, right: ours)\n";
+        print_diff(diff);
+        return 1;
+    } else if (xfail.record) {
+        xfail.write_diff(key, diff.lines);
+        std::cout << "  📝 " << label << ": recorded " << diff.lines.size() << " diff lines in "
+                  << xfail.diff_path(key).string() << '\n';
+    } else {
+        std::vector<std::string> expected = xfail.read_diff(key);
+        size_t unexpected_count = 0;
+        size_t fixed_count = 0;
+        auto unexpected = missing_from(diff.lines, expected, unexpected_count);
+        auto fixed = missing_from(expected, diff.lines, fixed_count);
+        if (unexpected_count == 0 && fixed_count == 0) {
+            std::cout << "  ⚠️  " << label << ": known divergence (" << expected.size() << " recorded diff lines)\n";
+            return 0;
+        }
+        std::cout << "  ❌ " << label << ": diff differs from " << xfail.diff_path(key).string() << " ("
+                  << unexpected_count << " new, " << fixed_count << " gone; re-record with --record-xfail if intended)\n";
+        for (const auto& line : unexpected) {
+            std::cout << "      new:  " << line << '\n';
+        }
+        for (const auto& line : fixed) {
+            std::cout << "      gone: " << line << '\n';
+        }
+        return 1;
+    }
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    bool record = false;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string_view(argv[i]) == "--record-xfail") {
+            record = true;
+        } else {
+            args.emplace_back(argv[i]);
+        }
+    }
+    std::string data_dir = args.size() > 0 ? args[0] : "bench/test_data";
+    std::string golden_dir = args.size() > 1 ? args[1] : data_dir + "/results";
+    std::string work_dir = args.size() > 2 ? args[2] : "build/parity";
+    std::string xfail_path = args.size() > 3 ? args[3] : "bench/golden_xfail.txt";
+
+    size_t failures = 0;
+    try {
+        std::filesystem::create_directories(work_dir);
+        Xfail xfail(xfail_path, record);
+        std::set<std::string> seen;
+
+        std::vector<std::string> captures;
+        for (const auto& entry : std::filesystem::directory_iterator(data_dir)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".txt") {
+                captures.push_back(entry.path().string());
+            }
+        }
+        std::sort(captures.begin(), captures.end());
+
+        auto variants = all_variants();
+        auto modes = annotation_modes();
+        for (const auto& capture : captures) {
+            std::string name = std::filesystem::path(capture).stem().string();
+            seen.insert(name);
+            std::cout << "📄 " << name << '\n';
+
+            // 1. 各路径之间
+            VariantOutput reference = run_variants(variants, capture, work_dir + "/" + name, "", failures);
+
+            // 2. 与 golden 比较
+            failures += check_golden(golden_dir + "/" + name + "-collapsed-all.txt", true, reference.folded,
+                                     "golden", name, xfail);
+
+            // 3. 根帧与帧注解
+            for (const auto& mode : modes) {
+                VariantOutput annotated = run_variants(annotated_variants(mode.options), capture,
+                                                       work_dir + "/" + name + "." + mode.name, mode.name + " ", failures);
+                failures += check_golden(golden_dir + "/" + name + "-collapsed-" + mode.name + ".txt", false,
+                                         annotated.folded, mode.name, name + ":" + mode.name, xfail);
+            }
+        }
+
+        for (const auto& key : xfail.keys) {
+            std::string name = key.substr(0, key.find(':'));
+            if (! seen.count(name)) {
+                std::cout << "❌ " << xfail.path << " lists unknown capture " << name << '\n';
+                ++failures;
+            }
+        }
+        // 记录文件须对应 xfail 中的条目, 移除条目时一并删除
+        if (std::filesystem::is_directory(xfail.dir)) {
+            for (const auto& entry : std::filesystem::directory_iterator(xfail.dir)) {
+                bool used = std::any_of(xfail.keys.begin(), xfail.keys.end(),
+                                        [&](const std::string& key) { return xfail.diff_path(key) == entry.path(); });
+                if (! used) {
+                    std::cout << "❌ " << entry.path().string() << " is not listed in " << xfail.path << '\n';
+                    ++failures;
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "❌ " << e.what() << '\n';
+        return 1;
+    }
+
+    if (failures > 0) {
+        std::cout << "❌ " << failures << " parity failure(s)\n";
+        return 1;
+    }
+    std::cout << "✅ all outputs agree\n";
+    return 0;
+}
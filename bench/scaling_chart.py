@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+"""
+bench/scaling_chart.py  ——  把 bench_scaling 的 JSON 画成扩展性曲线：
+1. 各阶段加速比（附理想线）
+2. 各阶段并行效率
+3. 各阶段负载不均度（最忙线程 / 平均）
+
+用法: python3 bench/scaling_chart.py bench/scaling.json bench/scaling_chart.svg
+"""
+
+import json
+import sys
+from collections import defaultdict
+
+import matplotlib
+
+matplotlib.use("Agg")
+import matplotlib.pyplot as plt
+
+
+STAGES = ["parse", "collapse", "build", "render"]
+COLORS = ["#4E79A7", "#59A14F", "#F28E2B", "#E15759"]
+
+
+def load(path: str):
+    """返回 (元信息, {stage: [(threads, row), ...]})"""
+    with open(path) as f:
+        data = json.load(f)
+    series = defaultdict(list)
+    for row in data["results"]:
+        series[row["stage"]].append((row["threads"], row))
+    for rows in series.values():
+        rows.sort(key=lambda item: item[0])
+    return data, series
+
+
+def save_scaling_chart(data, series, outfile: str):
+    print(f"📊 Prepare generate chart to {outfile}")
+    fig, axs = plt.subplots(1, 3, figsize=(15, 5))
+    panels = [
+        ("speedup", "Speedup", axs[0]),
+        ("efficiency", "Parallel efficiency", axs[1]),
+        ("imbalance", "Load imbalance (max / mean busy)", axs[2]),
+    ]
+
+    threads = sorted({t for rows in series.values() for t, _ in rows})
+    for key, title, ax in panels:
+        for stage, color in zip(STAGES, COLORS):
+            rows = series.get(stage, [])
+            ax.plot([t for t, _ in rows], [row[key] for _, row in rows], marker="o", color=color, label=stage)
+
+        if key == "speedup":
+            ax.plot(threads, [t / threads[0] for t in threads], linestyle="--", color="#999999", label="ideal")
+        if key == "efficiency":
+            ax.set_ylim(0, 1.05)
+        ax.set_xscale("log", base=2)
+        ax.set_xticks(threads)
+        ax.set_xticklabels([str(t) for t in threads])
+        ax.set_xlabel("Threads")
+        ax.set_title(title)
+        ax.grid(True, alpha=0.3)
+        ax.legend(fontsize=8)
+
+    mb = data["bytes"] / (1024 * 1024)
+    hw = data.get("hardware_threads")
+    machine = f", {hw} hardware threads" if hw else ""
+    plt.suptitle(f"Thread scaling per stage ({mb:.0f} MB input{machine}, median of {data['repeat']})")
+    plt.tight_layout(rect=[0, 0, 1, 0.95])  # 留出 suptitle 空间
+    plt.savefig(outfile, format="svg")
+    print(f"📊 Chart saved to {outfile}")
+
+
+def main():
+    if len(sys.argv) != 3:
+        print(f"Usage: {sys.argv[0]} <scaling.json> <chart.svg>")
+        sys.exit(1)
+    data, series = load(sys.argv[1])
+    save_scaling_chart(data, series, sys.argv[2])
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,401 @@
+// bench/synth_profile.cpp —— 高速合成 profile 生成器
+//
+// 生成 perf script 文本或折叠格式的合成样本, 写到文件或标准输出（"-"）,
+// 用于 1 亿 ~ 10 亿样本量级的扩展性测试: perf 格式可以直接通过管道喂给 flamegraph_main(_par),
+// 不必先落盘; 折叠格式供 flamegraph.pl / inferno 等外部工具对比使用。
+// 同一组参数与种子总是生成完全相同的输出
+//
+// 调用图是一张确定性的随机图: 每个函数固定有 fanout 个被调函数, 样本从根沿图随机下行,
+// 被调函数的选择偏向编号小的那几个, 因此会出现热点路径; 每层以 recursion 的概率自我递归
+//
+// 用法: synth_profile [options]
+//   --samples N          样本数（默认 1000000）
+//   --format perf|folded 输出格式（默认 perf）
+//   --output FILE        输出文件, "-" 为标准输出（默认 -）
+//   --seed N             随机种子（默认 1）
+//   --depth MIN:MAX      栈深度范围（默认 4:32）
+//   --depth-dist D       uniform | geometric（默认 uniform, geometric 偏向浅栈）
+//   --fanout N           每个函数的被调函数个数（默认 8）
+//   --functions N        函数名基数（默认 5000）
+//   --recursion P        每层自我递归的概率（默认 0.02）
+//   --threads N          线程数（默认 16）
+//   --processes N        进程数, 线程平均分到各进程（默认 1）
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+// 🔥 ===== 参数 =====
+
+enum class Format { Perf, Folded };
+enum class DepthDist { Uniform, Geometric };
+
+struct SynthOptions {
+    uint64_t samples = 1'000'000;
+    Format format = Format::Perf;
+    std::string output = "-";
+    uint64_t seed = 1;
+    size_t min_depth = 4;
+    size_t max_depth = 32;
+    DepthDist depth_dist = DepthDist::Uniform;
+    size_t fanout = 8;
+    size_t functions = 5000;
+    double recursion = 0.02;
+    size_t threads = 16;
+    size_t processes = 1;
+};
+
+// 🔥 ===== 随机数 =====
+
+// splitmix64: 足够快, 状态只有 64 位, 种子相同则序列相同
+struct Rng {
+    uint64_t state;
+
+    explicit Rng(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // [0, n)
+    size_t below(size_t n) {
+        return static_cast<size_t>(next() % n);
+    }
+
+    // [0, 1)
+    double unit() {
+        return static_cast<double>(next() >> 11) * 0x1.0p-53;
+    }
+};
+
+uint64_t mix(uint64_t a, uint64_t b) {
+    Rng rng(a * 0x100000001B3ull ^ b);
+    return rng.next();
+}
+
+// 🔥 ===== 输出缓冲 =====
+
+class Writer {
+  private:
+    static constexpr size_t CAPACITY = 1 << 20;
+
+    int fd_;
+    std::vector<char> buffer_;
+    size_t used_ = 0;
+    uint64_t written_ = 0;
+
+  public:
+    explicit Writer(const std::string& path)
+        : fd_(path == "-" ? STDOUT_FILENO : ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)),
+          buffer_(CAPACITY) {
+        if (fd_ == -1) {
+            throw std::runtime_error("Cannot open file: " + path);
+        }
+    }
+
+    ~Writer() {
+        if (fd_ != STDOUT_FILENO) {
+            ::close(fd_);
+        }
+    }
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    // 调用方保证单次写入不超过 CAPACITY
+    char* reserve(size_t n) {
+        if (used_ + n > CAPACITY) {
+            flush();
+        }
+        return buffer_.data() + used_;
+    }
+
+    void commit(char* end) {
+        used_ = static_cast<size_t>(end - buffer_.data());
+    }
+
+    void append(std::string_view s) {
+        char* out = reserve(s.size());
+        commit(std::copy(s.begin(), s.end(), out));
+    }
+
+    void flush() {
+        const char* data = buffer_.data();
+        size_t left = used_;
+        while (left > 0) {
+            ssize_t n = ::write(fd_, data, left);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error(std::string("write failed: ") + std::strerror(errno));
+            }
+            data += n;
+            left -= static_cast<size_t>(n);
+        }
+        written_ += used_;
+        used_ = 0;
+    }
+
+    uint64_t written() const {
+        return written_ + used_;
+    }
+};
+
+char* put_uint(char* out, uint64_t value) {
+    return std::to_chars(out, out + 20, value).ptr;
+}
+
+// 固定宽度, 左侧补零
+char* put_padded(char* out, uint64_t value, size_t width) {
+    char* end = out + width;
+    for (char* p = end; p != out; value /= 10) {
+        *--p = static_cast<char>('0' + value % 10);
+    }
+    return end;
+}
+
+// 🔥 ===== 生成器 =====
+
+class SynthProfile {
+  private:
+    // 单行不会超过这个长度: 名字长度受控, 地址与偏移位数固定
+    static constexpr size_t MAX_LINE = 256;
+
+    const SynthOptions& opts_;
+    Rng rng_;
+    std::vector<std::string> names_;
+    std::vector<std::string> perf_lines_; // 每个函数预先格式化好的 perf 帧行
+    std::vector<uint32_t> stack_;
+
+  public:
+    explicit SynthProfile(const SynthOptions& opts) : opts_(opts), rng_(opts.seed) {
+        static constexpr const char* LIBS[] = {"/usr/lib/libc.so.6", "/usr/lib/libstdc++.so.6",
+                                               "/usr/lib/libssl.so.3", "/usr/bin/synth", "[kernel.kallsyms]"};
+        names_.reserve(opts_.functions);
+        perf_lines_.reserve(opts_.functions);
+        for (size_t i = 0; i < opts_.functions; ++i) {
+            // 混合 C 风格与带命名空间的 C++ 风格名字
+            std::string name = i % 3 == 0 ? "ns" + std::to_string(i % 17) + "::Class" + std::to_string(i % 97) +
+                                                "::method_" + std::to_string(i)
+                                          : "func_" + std::to_string(i);
+            char line[MAX_LINE];
+            char* p = line;
+            *p++ = '\t';
+            uint64_t addr = 0x400000 + mix(opts_.seed, i) % 0x7FFFFFFFull;
+            p = std::to_chars(p, p + 16, addr, 16).ptr;
+            *p++ = ' ';
+            p = std::copy(name.begin(), name.end(), p);
+            p = std::copy_n("+0x", 3, p);
+            p = std::to_chars(p, p + 4, 0x10 + i % 0x2F0, 16).ptr;
+            std::string_view lib = LIBS[i % std::size(LIBS)];
+            *p++ = ' ';
+            *p++ = '(';
+            p = std::copy(lib.begin(), lib.end(), p);
+            *p++ = ')';
+            *p++ = '\n';
+            perf_lines_.emplace_back(line, p);
+            names_.push_back(std::move(name));
+        }
+        stack_.reserve(opts_.max_depth);
+    }
+
+    void write(Writer& out) {
+        uint64_t timestamp_us = 100'000'000'000ull; // 从 100000 秒开始, 每个样本 100 us
+        for (uint64_t s = 0; s < opts_.samples; ++s) {
+            build_stack();
+            size_t thread = rng_.below(opts_.threads);
+            if (opts_.format == Format::Perf) {
+                write_perf(out, thread, timestamp_us);
+            } else {
+                write_folded(out);
+            }
+            timestamp_us += 100;
+        }
+        out.flush();
+    }
+
+  private:
+    size_t pick_depth() {
+        size_t span = opts_.max_depth - opts_.min_depth;
+        if (opts_.depth_dist == DepthDist::Uniform) {
+            return opts_.min_depth + rng_.below(span + 1);
+        }
+        // 几何分布, 均值约为范围的四分之一, 超出上限截断
+        double p = 4.0 / (static_cast<double>(span) + 4.0);
+        size_t extra = 0;
+        while (extra < span && rng_.unit() >= p) {
+            ++extra;
+        }
+        return opts_.min_depth + extra;
+    }
+
+    // 两次取小: 编号小的被调函数更常被选中, 形成热点路径
+    size_t pick_callee() {
+        return std::min(rng_.below(opts_.fanout), rng_.below(opts_.fanout));
+    }
+
+    void build_stack() {
+        size_t depth = pick_depth();
+        stack_.clear();
+        stack_.push_back(static_cast<uint32_t>(mix(~opts_.seed, pick_callee()) % opts_.functions));
+        while (stack_.size() < depth) {
+            uint32_t parent = stack_.back();
+            if (rng_.unit() < opts_.recursion) {
+                stack_.push_back(parent);
+                continue;
+            }
+            stack_.push_back(static_cast<uint32_t>(mix(parent, pick_callee()) % opts_.functions));
+        }
+    }
+
+    void write_perf(Writer& out, size_t thread, uint64_t timestamp_us) {
+        size_t per_process = (opts_.threads + opts_.processes - 1) / opts_.processes;
+        uint64_t process = thread / per_process;
+        uint64_t pid = 1000 + process * 1000;
+        uint64_t tid = pid + thread % per_process;
+
+        char* p = out.reserve(MAX_LINE);
+        p = std::copy_n("synth", 5, p);
+        p = put_uint(p, process);
+        *p++ = ' ';
+        p = put_uint(p, pid);
+        *p++ = '/';
+        p = put_uint(p, tid);
+        p = std::copy_n(" [", 2, p);
+        p = put_padded(p, thread % 64, 3);
+        p = std::copy_n("] ", 2, p);
+        p = put_uint(p, timestamp_us / 1'000'000);
+        *p++ = '.';
+        p = put_padded(p, timestamp_us % 1'000'000, 6);
+        p = std::copy_n(": 250000 cpu-clock:\n", 20, p);
+        out.commit(p);
+
+        // perf script 从叶子往根列出
+        for (auto it = stack_.rbegin(); it != stack_.rend(); ++it) {
+            out.append(perf_lines_[*it]);
+        }
+        out.append("\n");
+    }
+
+    void write_folded(Writer& out) {
+        for (size_t i = 0; i < stack_.size(); ++i) {
+            if (i > 0) {
+                out.append(";");
+            }
+            out.append(names_[stack_[i]]);
+        }
+        out.append(" 1\n");
+    }
+};
+
+// 🔥 ===== 命令行 =====
+
+uint64_t parse_uint(std::string_view text, std::string_view flag) {
+    uint64_t value = 0;
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (ec != std::errc() || ptr != text.data() + text.size()) {
+        throw std::invalid_argument("Invalid value for " + std::string(flag) + ": " + std::string(text));
+    }
+    return value;
+}
+
+SynthOptions parse_args(int argc, char** argv) {
+    SynthOptions opts;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view flag = argv[i];
+        if (i + 1 >= argc) {
+            throw std::invalid_argument("Missing value for " + std::string(flag));
+        }
+        std::string_view value = argv[++i];
+        if (flag == "--samples") {
+            opts.samples = parse_uint(value, flag);
+        } else if (flag == "--format") {
+            if (value != "perf" && value != "folded") {
+                throw std::invalid_argument("Unknown format: " + std::string(value));
+            }
+            opts.format = value == "perf" ? Format::Perf : Format::Folded;
+        } else if (flag == "--output") {
+            opts.output = value;
+        } else if (flag == "--seed") {
+            opts.seed = parse_uint(value, flag);
+        } else if (flag == "--depth") {
+            size_t colon = value.find(':');
+            if (colon == std::string_view::npos) {
+                throw std::invalid_argument("--depth expects MIN:MAX");
+            }
+            opts.min_depth = parse_uint(value.substr(0, colon), flag);
+            opts.max_depth = parse_uint(value.substr(colon + 1), flag);
+        } else if (flag == "--depth-dist") {
+            if (value != "uniform" && value != "geometric") {
+                throw std::invalid_argument("Unknown depth distribution: " + std::string(value));
+            }
+            opts.depth_dist = value == "uniform" ? DepthDist::Uniform : DepthDist::Geometric;
+        } else if (flag == "--fanout") {
+            opts.fanout = parse_uint(value, flag);
+        } else if (flag == "--functions") {
+            opts.functions = parse_uint(value, flag);
+        } else if (flag == "--recursion") {
+            opts.recursion = std::strtod(std::string(value).c_str(), nullptr);
+        } else if (flag == "--threads") {
+            opts.threads = parse_uint(value, flag);
+        } else if (flag == "--processes") {
+            opts.processes = parse_uint(value, flag);
+        } else {
+            throw std::invalid_argument("Unknown option: " + std::string(flag));
+        }
+    }
+
+    if (opts.min_depth == 0 || opts.min_depth > opts.max_depth || opts.max_depth > 1000) {
+        throw std::invalid_argument("--depth must satisfy 1 <= MIN <= MAX <= 1000");
+    }
+    if (opts.fanout == 0 || opts.functions == 0 || opts.threads == 0 || opts.processes == 0) {
+        throw std::invalid_argument("--fanout, --functions, --threads and --processes must be positive");
+    }
+    if (opts.functions > UINT32_MAX) {
+        throw std::invalid_argument("--functions is too large");
+    }
+    if (opts.recursion < 0 || opts.recursion >= 1) {
+        throw std::invalid_argument("--recursion must be in [0, 1)");
+    }
+    opts.processes = std::min(opts.processes, opts.threads);
+    return opts;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    try {
+        SynthOptions opts = parse_args(argc, argv);
+        auto start = std::chrono::steady_clock::now();
+        Writer out(opts.output);
+        SynthProfile(opts).write(out);
+
+        // 报告写到 stderr, 不混进标准输出的数据
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double mb = static_cast<double>(out.written()) / (1024.0 * 1024.0);
+        std::cerr << "✅ " << opts.samples << " samples, " << mb << " MB in " << seconds << " s ("
+                  << mb / std::max(seconds, 1e-9) << " MB/s)\n";
+    } catch (const std::exception& e) {
+        std::cerr << "❌ " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+// bench/tidy_check.cpp —— 函数名整理（--strip-args / --strip-generics）的一致性检查
+//
+// 同一个名字可能在解析时整理（strip_trailing_generic_args, 只缩短 view）, 也可能在折叠后由
+// SymbolRewriter 整理（strip_generic_args, 如还原出的名字）; 两条路径的结果须相同, 否则同一函数会分成两个节点.
+// 对每个用例检查 strip_generic_args 的结果, 以及解析时路径能处理时两者一致
+// 任何不一致都以非零退出码结束
+//
+// 用法: tidy_check
+
+#include "../include/flamegraph.hpp"
+
+#include <iostream>
+
+using namespace flamegraph;
+
+namespace {
+
+struct Case {
+    std::string_view name;
+    std::string_view stripped; // strip_argument_list 之后再 strip_generic_args 的结果
+};
+
+constexpr Case CASES[] = {
+    {"foo<int>", "foo"},
+    {"void foo<int>(int)", "void foo"},
+    {"std::vector<int>::push_back(int const&)", "std::vector::push_back"},
+    {"std::operator<< <char>", "std::operator<<"},
+    {"std::operator<< <std::char_traits<char> >(std::ostream&, char const*)", "std::operator<<"},
+    {"std::operator< <int>", "std::operator<"},
+    {"operator()<int>", "operator()"},
+    {"Foo<int>::operator<<", "Foo::operator<<"},
+    {"Foo <int>::bar", "Foo::bar"},
+    {"(anonymous namespace)::f<int>", "(anonymous namespace)::f"},
+    {"broken<int", "broken<int"},
+};
+
+} // namespace
+
+int main() {
+    size_t failures = 0;
+    for (const Case& c : CASES) {
+        std::string_view args_stripped = strip_argument_list(c.name);
+        std::string rewritten = strip_generic_args(args_stripped);
+        std::string_view parsed = strip_trailing_generic_args(args_stripped);
+        bool parse_handles = parsed != args_stripped || args_stripped.find('<') == std::string_view::npos;
+        if (rewritten != c.stripped) {
+            std::cout << "  ❌ \"" << c.name << "\": strip_generic_args gives \"" << rewritten << "\", expected \""
+                      << c.stripped << "\"\n";
+            ++failures;
+        } else if (parse_handles && parsed != rewritten) {
+            std::cout << "  ❌ \"" << c.name << "\": parse-time tidy gives \"" << parsed << "\", rewriter gives \""
+                      << rewritten << "\"\n";
+            ++failures;
+        } else {
+            std::cout << "  ✅ \"" << c.name << "\" -> \"" << rewritten << "\"\n";
+        }
+    }
+
+    if (failures > 0) {
+        std::cout << "❌ " << failures << " check(s) failed\n";
+        return 1;
+    }
+    std::cout << "✅ all checks passed\n";
+    return 0;
+}
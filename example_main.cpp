@@ -1,12 +1,18 @@
+#include "./include/cli_options.hpp"
 #include "./include/flamegraph.hpp"
 #include <iostream>
 #include <stdexcept>
+#include <string>
 
 using namespace flamegraph;
 
 int main(int argc, char* argv[]) {
     try {
-        if (argc == 3) { // 检查命令行参数
+        // 共用的 --stats/--trace/--progress/--demangle/--symbols 等选项见 CliOptions
+        CliOptions cli = CliOptions::parse(argc, argv);
+        const auto& args = cli.args;
+
+        if (args.size() == 2) { // 检查命令行参数
             FlameGraphConfig config;
             config.title = "Performance Test Flame Graph";
             config.interactive = true;
@@ -14,12 +20,17 @@ int main(int argc, char* argv[]) {
 
             FlameGraphGenerator generator(config);
 
-            generator.generate(argv[1], argv[2]);
+            cli.apply(generator);
+            generator.generate(args[0], args[1]);
+            cli.finish(generator);
 
             return 0;
         } else {
-            throw std::invalid_argument("not 3 argument");
+            throw std::invalid_argument(std::string("usage: flamegraph_main <input> <output> ") + CliOptions::USAGE);
         }
+    } catch (const CancelledException& e) {
+        std::cerr << "\n⚠️  " << e.what() << std::endl;
+        return 130;
     } catch (const std::exception& e) {
         std::cerr << "❌ Error: " << e.what() << std::endl;
         return 1;
@@ -1,23 +1,57 @@
+#include "./include/cli_options.hpp"
 #include "./include/parallel_flamegraph.hpp"
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace flamegraph;
 
 int main(int argc, char* argv[]) {
-    // if (argc != 3) {
-    //     std::cerr << "Usage: " << argv[0] << " <input_perf_file> <output_svg_file>\n";
-    //     return 1;
-    // }
-
-    // try {
-    //     flamegraph::FlameGraphConfig config;
-    //     config.title = "Par CPU Flame Graph";
-    //     config.interactive = true;
-
-    //     flamegraph::ParallelFlameGraphGenerator parallel_generator(config);
-    //     parallel_generator.generate(argv[1], argv[2]);
-    // } catch (const std::exception& e) {
-    //     std::cerr << "Error: " << e.what() << std::endl;
-    //     return 1;
-    // }
+    try {
+        // 共用的 --stats/--trace/--progress/--demangle/--symbols 等选项见 CliOptions
+        CliOptions cli = CliOptions::parse(argc, argv);
+        const auto& args = cli.args;
+
+        if (args.size() >= 2 && args.size() <= 4) { // 检查命令行参数, 可选: 线程数, 拆分键 (pid/tid/comm/cpu)
+            FlameGraphConfig config;
+            config.title = "Performance Test Flame Graph";
+            config.interactive = true;
+            config.write_folded_file = false;
+
+            size_t threads = args.size() >= 3 ? std::stoul(args[2]) : 0;
+            ParallelFlameGraphGenerator generator(config, threads);
+            if (args.size() == 4) {
+                generator.set_split_by(parse_split_by(args[3]));
+            }
+
+            // 输入可以是逗号分隔的多个文件, 每项都可以带通配符（需加引号避免被 shell 展开）
+            std::vector<std::string> inputs;
+            std::string_view list = args[0];
+            for (size_t begin = 0; begin <= list.size();) {
+                size_t end = std::min(list.find(',', begin), list.size());
+                if (end > begin) {
+                    inputs.emplace_back(list.substr(begin, end - begin));
+                }
+                begin = end + 1;
+            }
+
+            cli.apply(generator);
+            generator.generate(inputs, args[1]);
+            cli.finish(generator);
+
+            return 0;
+        } else {
+            throw std::invalid_argument(std::string("usage: flamegraph_main_par <input[,input...]> <output> [threads] [pid|tid|comm|cpu] ") +
+                                        CliOptions::USAGE);
+        }
+    } catch (const CancelledException& e) {
+        std::cerr << "\n⚠️  " << e.what() << std::endl;
+        return 130;
+    } catch (const std::exception& e) {
+        std::cerr << "❌ Error: " << e.what() << std::endl;
+        return 1;
+    }
 
     return 0;
 }
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "flamegraph.hpp"
+
+#include <csignal>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 命令行: flamegraph_main 与 flamegraph_main_par 共用的选项解析, 填好 ParseOptions 与统计、追踪、进度设置,
+// 再由 apply()/finish() 作用到任一生成器上; 两个程序只处理各自的位置参数
+
+namespace flamegraph {
+
+/**
+ * @brief 两个命令行程序共用的选项
+ *
+ * --stats <file|->: 生成结束后把运行统计以 JSON 写到文件或标准输出
+ * --trace <file|->: 记录工具自身各阶段、各线程的时间线, 写成 Chrome trace JSON
+ * --progress: 在标准错误上显示各阶段的进度
+ * --diagnostics: 统计中加入哈希表链长与树形状的诊断, 未给出 --stats 时写到标准输出
+ * --demangle: 把 C++/Rust 的 mangled 函数名还原为可读名字
+ * --strip-args / --strip-generics: 去掉函数名中的参数列表 / 模板参数
+ * --perf-maps <dir>: 用 <dir>/perf-<pid>.map 还原没有符号的 JIT 帧
+ * --symbols <file|dir>（可重复）: 从本地 ELF 或调试目录还原没有符号的原生帧, 隐含原路径;
+ *     符号表按 build-id 缓存在 --symbol-cache <dir>, 默认 ~/.cache/flamegraph/symbols
+ * --comm / --pid / --tid: 每个栈加进程名（-pid / -pid/tid）根帧, 同 stackcollapse-perf.pl
+ * --kernel / --jit / --addrs: 内核帧加 _[k], JIT 帧加 _[j], 没有符号的帧带上地址; --all 即 --kernel --jit --comm
+ * 其余参数按顺序留在 args 中
+ */
+struct CliOptions {
+    static constexpr const char* USAGE =
+        "[--stats <file|->] [--trace <file|->] [--progress] [--diagnostics] [--demangle] [--strip-args] "
+        "[--strip-generics] [--comm|--pid|--tid] [--kernel] [--jit] [--addrs] [--all] [--perf-maps <dir>] "
+        "[--symbols <file|dir>]... [--symbol-cache <dir>]";
+
+    std::vector<std::string> args;
+    std::string stats_path;
+    std::string trace_path;
+    bool show_progress = false;
+    bool diagnostics = false;
+    bool demangle = false;
+    ParseOptions parse_opts;
+
+    static CliOptions parse(int argc, char* argv[]) {
+        CliOptions cli;
+        ElfSymbolOptions elf_opts;
+        bool resolve_elf = false;
+        elf_opts.cache_dir = ElfSymbolResolver::default_cache_dir();
+        ParseOptions& parse_opts = cli.parse_opts;
+        for (int i = 1; i < argc; ++i) {
+            std::string_view arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if (arg == "--progress") {
+                cli.show_progress = true;
+            } else if (arg == "--diagnostics") {
+                cli.diagnostics = true;
+            } else if (arg == "--demangle") {
+                cli.demangle = true;
+            } else if (arg == "--strip-args") {
+                parse_opts.strip_args = true;
+            } else if (arg == "--strip-generics") {
+                parse_opts.strip_generics = true;
+            } else if (arg == "--comm") {
+                parse_opts.process_frame = ProcessFrame::Comm;
+            } else if (arg == "--pid") {
+                parse_opts.process_frame = ProcessFrame::Pid;
+            } else if (arg == "--tid") {
+                parse_opts.process_frame = ProcessFrame::Tid;
+            } else if (arg == "--kernel") {
+                parse_opts.annotate_kernel = true;
+            } else if (arg == "--jit") {
+                parse_opts.annotate_jit = true;
+            } else if (arg == "--addrs") {
+                parse_opts.annotate_addrs = true;
+            } else if (arg == "--all") {
+                parse_opts.annotate_kernel = true;
+                parse_opts.annotate_jit = true;
+                if (parse_opts.process_frame == ProcessFrame::None) {
+                    parse_opts.process_frame = ProcessFrame::Comm;
+                }
+            } else if (arg == "--perf-maps" && has_value) {
+                parse_opts.perf_maps = std::make_shared<PerfMapResolver>(argv[++i]);
+            } else if (arg == "--symbols" && has_value) {
+                elf_opts.search_paths.emplace_back(argv[++i]);
+                resolve_elf = true;
+            } else if (arg == "--symbol-cache" && has_value) {
+                elf_opts.cache_dir = argv[++i];
+            } else if (arg == "--stats" && has_value) {
+                cli.stats_path = argv[++i];
+            } else if (arg == "--trace" && has_value) {
+                cli.trace_path = argv[++i];
+            } else {
+                cli.args.emplace_back(arg);
+            }
+        }
+        if (resolve_elf) {
+            parse_opts.elf_symbols = std::make_shared<ElfSymbolResolver>(elf_opts);
+        }
+        if (cli.diagnostics && cli.stats_path.empty()) {
+            cli.stats_path = "-";
+        }
+        return cli;
+    }
+
+    // 设置统计、解析选项、进度与 Ctrl-C 取消, 并按需开始追踪; 在 generate() 之前调用
+    template <typename Generator>
+    void apply(Generator& generator) const {
+        generator.set_detailed_stats(! stats_path.empty());
+        generator.set_diagnostics(diagnostics);
+        generator.set_demangle(demangle);
+        generator.set_parse_options(parse_opts);
+        if (show_progress) {
+            generator.set_progress_callback(print_progress);
+        }
+        generator.set_cancellation_token(&interrupt_token_);
+        std::signal(SIGINT, on_interrupt);
+        if (! trace_path.empty()) {
+            Tracer::instance().start();
+        }
+    }
+
+    // 写出统计与追踪; 在 generate() 之后调用
+    template <typename Generator>
+    void finish(const Generator& generator) const {
+        if (! stats_path.empty()) {
+            write_stats_json(generator.get_last_stats(), stats_path);
+        }
+        if (! trace_path.empty()) {
+            Tracer::instance().stop();
+            Tracer::instance().write(trace_path);
+        }
+    }
+
+  private:
+    // Ctrl-C 取消正在进行的生成; cancel() 只是一次无锁的原子写, 可以在信号处理函数中调用
+    inline static CancellationToken interrupt_token_;
+
+    static void on_interrupt(int) {
+        interrupt_token_.cancel();
+    }
+
+    static void print_progress(std::string_view stage, double fraction) {
+        std::cerr << "\r⏳ " << stage << " " << std::setw(3) << static_cast<int>(fraction * 100) << "%" << std::flush;
+        if (fraction >= 1.0) {
+            std::cerr << '\n';
+        }
+    }
+};
+
+} // namespace flamegraph
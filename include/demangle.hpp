@@ -0,0 +1,830 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <cxxabi.h>
+
+// 符号还原: C++ 使用 libstdc++ 自带的 abi::__cxa_demangle, Rust 的 legacy 与 v0 两种编码由下面的代码解析
+// 输出与 c++filt / rustc-demangle 的 {:#} 格式一致（Rust 不显示 hash 与 crate 消歧符）
+// 所有函数在无法还原时返回空串, 由调用方保留原名
+
+namespace flamegraph {
+
+inline void append_utf8(std::string& out, uint32_t code) {
+    if (code < 0x80) {
+        out += static_cast<char>(code);
+    } else if (code < 0x800) {
+        out += static_cast<char>(0xC0 | (code >> 6));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+        out += static_cast<char>(0xE0 | (code >> 12));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (code >> 18));
+        out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+}
+
+inline bool is_lower_hex(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+}
+
+// 🔥 ===== C++ (Itanium ABI) =====
+inline std::string demangle_itanium(std::string_view symbol) {
+    std::string mangled(symbol); // __cxa_demangle 需要以 '\0' 结尾
+    int status = 0;
+    std::unique_ptr<char, decltype(&std::free)> demangled(
+        abi::__cxa_demangle(mangled.c_str(), nullptr, nullptr, &status), &std::free);
+    if (status != 0 || ! demangled) {
+        return {};
+    }
+    return demangled.get();
+}
+
+// 🔥 ===== Rust legacy =====
+
+// legacy 符号借用 Itanium 的嵌套名编码, 最后一段是 "h" + 16 位十六进制的 hash
+inline bool is_rust_legacy_hash(std::string_view ident) {
+    return ident.size() == 17 && ident[0] == 'h' && std::all_of(ident.begin() + 1, ident.end(), is_lower_hex);
+}
+
+// 段内的转义: $LT$ → <, $u7e$ → ~, .. → :: 等
+inline bool decode_rust_legacy_ident(std::string_view ident, std::string& out) {
+    static constexpr std::pair<std::string_view, char> ESCAPES[] = {
+        {"SP", '@'}, {"BP", '*'}, {"RF", '&'}, {"LT", '<'}, {"GT", '>'}, {"LP", '('}, {"RP", ')'}, {"C", ','}};
+
+    if (ident.size() >= 2 && ident[0] == '_' && ident[1] == '$') {
+        ident.remove_prefix(1);
+    }
+    while (! ident.empty()) {
+        if (ident[0] == '.') {
+            bool path_sep = ident.size() >= 2 && ident[1] == '.';
+            out += path_sep ? "::" : ".";
+            ident.remove_prefix(path_sep ? 2 : 1);
+        } else if (ident[0] == '$') {
+            size_t end = ident.find('$', 1);
+            if (end == std::string_view::npos) {
+                return false;
+            }
+            std::string_view escape = ident.substr(1, end - 1);
+            auto it = std::find_if(std::begin(ESCAPES), std::end(ESCAPES),
+                                   [&](const auto& entry) { return entry.first == escape; });
+            if (it != std::end(ESCAPES)) {
+                out += it->second;
+            } else if (escape.size() > 1 && escape[0] == 'u') {
+                uint32_t code = 0;
+                auto [ptr, ec] = std::from_chars(escape.data() + 1, escape.data() + escape.size(), code, 16);
+                if (ec != std::errc{} || ptr != escape.data() + escape.size() || code > 0x10FFFF) {
+                    return false;
+                }
+                append_utf8(out, code);
+            } else {
+                return false;
+            }
+            ident.remove_prefix(end + 1);
+        } else {
+            size_t next = std::min(ident.find_first_of("$."), ident.size());
+            out += ident.substr(0, next);
+            ident.remove_prefix(next);
+        }
+    }
+    return true;
+}
+
+// i.e. "_ZN3std2io5stdio6_print17h0123456789abcdefE" → "std::io::stdio::_print"
+// 不是 legacy Rust 符号（最后一段不是 hash）时返回空, 交给 Itanium 还原
+inline std::string demangle_rust_legacy(std::string_view symbol) {
+    std::string_view rest = symbol.substr(3); // 跳过 "_ZN"
+    std::vector<std::string_view> idents;
+    while (! rest.empty() && rest[0] != 'E') {
+        size_t len = 0;
+        auto [ptr, ec] = std::from_chars(rest.data(), rest.data() + rest.size(), len);
+        size_t digits = static_cast<size_t>(ptr - rest.data());
+        if (ec != std::errc{} || len == 0 || len > rest.size() - digits) {
+            return {};
+        }
+        idents.push_back(rest.substr(digits, len));
+        rest.remove_prefix(digits + len);
+    }
+    if (rest.empty() || idents.size() < 2 || ! is_rust_legacy_hash(idents.back())) {
+        return {};
+    }
+    idents.pop_back();
+
+    std::string out;
+    for (size_t i = 0; i < idents.size(); ++i) {
+        if (i > 0) {
+            out += "::";
+        }
+        if (! decode_rust_legacy_ident(idents[i], out)) {
+            return {};
+        }
+    }
+    return out;
+}
+
+// 🔥 ===== Rust v0 =====
+
+/**
+ * @brief Rust v0 符号（"_R" 开头）的递归下降解析器
+ *
+ * 语法见 rustc 的 symbol-mangling-version v0; 回溯引用 (B) 只允许指向当前位置之前,
+ * 加上递归深度上限, 畸形输入也一定会结束。解析失败时整体放弃, 不输出半个名字
+ */
+class RustV0Demangler {
+  private:
+    static constexpr size_t MAX_DEPTH = 256;
+
+    struct Ident {
+        std::string_view ascii;
+        std::string_view punycode;
+
+        bool empty() const {
+            return ascii.empty() && punycode.empty();
+        }
+    };
+
+    std::string_view input_; // "_R" 之后的部分, 回溯引用的位置相对于这里
+    size_t pos_ = 0;
+    size_t depth_ = 0;
+    size_t bound_lifetimes_ = 0;
+    bool ok_ = true;
+    bool printing_ = true;
+    std::string out_;
+
+  public:
+    explicit RustV0Demangler(std::string_view input) : input_(input) {}
+
+    std::string demangle() {
+        if (peek() >= '0' && peek() <= '9') {
+            return {}; // 显式的编码版本号, 目前还没有定义
+        }
+        print_path(true);
+        // 其后的实例化 crate 与 ".llvm.NNNN" 之类的后缀都不显示
+        return ok_ ? std::move(out_) : std::string{};
+    }
+
+  private:
+    char peek() const {
+        return pos_ < input_.size() ? input_[pos_] : '\0';
+    }
+
+    bool eat(char c) {
+        if (ok_ && peek() == c) {
+            ++pos_;
+            return true;
+        }
+        return false;
+    }
+
+    char next() {
+        if (! ok_ || pos_ >= input_.size()) {
+            ok_ = false;
+            return '\0';
+        }
+        return input_[pos_++];
+    }
+
+    bool enter() {
+        if (! ok_ || depth_ >= MAX_DEPTH) {
+            ok_ = false;
+            return false;
+        }
+        ++depth_;
+        return true;
+    }
+
+    void leave() {
+        --depth_;
+    }
+
+    void print(std::string_view text) {
+        if (printing_ && ok_) {
+            out_ += text;
+        }
+    }
+
+    void print(char c) {
+        if (printing_ && ok_) {
+            out_ += c;
+        }
+    }
+
+    void print(uint64_t value) {
+        print(std::string_view(std::to_string(value)));
+    }
+
+    // "_" 为 0, 否则为 62 进制数值加 1
+    uint64_t base62() {
+        if (eat('_')) {
+            return 0;
+        }
+        uint64_t value = 0;
+        while (ok_) {
+            char c = next();
+            uint64_t digit = 0;
+            if (c == '_') {
+                return value + 1;
+            } else if (c >= '0' && c <= '9') {
+                digit = static_cast<uint64_t>(c - '0');
+            } else if (c >= 'a' && c <= 'z') {
+                digit = static_cast<uint64_t>(c - 'a') + 10;
+            } else if (c >= 'A' && c <= 'Z') {
+                digit = static_cast<uint64_t>(c - 'A') + 36;
+            } else {
+                ok_ = false;
+                break;
+            }
+            if (value > (UINT64_MAX - digit) / 62 - 1) {
+                ok_ = false;
+                break;
+            }
+            value = value * 62 + digit;
+        }
+        return 0;
+    }
+
+    // 可选的 tag + base62, 缺省为 0
+    uint64_t opt_base62(char tag) {
+        return eat(tag) ? base62() + 1 : 0;
+    }
+
+    uint64_t decimal() {
+        if (eat('0')) {
+            return 0;
+        }
+        uint64_t value = 0;
+        auto [ptr, ec] = std::from_chars(input_.data() + pos_, input_.data() + input_.size(), value);
+        if (ec != std::errc{}) {
+            ok_ = false;
+            return 0;
+        }
+        pos_ = static_cast<size_t>(ptr - input_.data());
+        return value;
+    }
+
+    Ident ident() {
+        bool punycode = eat('u');
+        uint64_t len = decimal();
+        eat('_'); // 名字以数字或 '_' 开头时用于分隔长度
+        if (! ok_ || len > input_.size() - pos_) {
+            ok_ = false;
+            return {};
+        }
+        std::string_view bytes = input_.substr(pos_, static_cast<size_t>(len));
+        pos_ += static_cast<size_t>(len);
+        if (! punycode) {
+            return {bytes, {}};
+        }
+        size_t sep = bytes.rfind('_');
+        if (sep == std::string_view::npos) {
+            return {{}, bytes};
+        }
+        return {bytes.substr(0, sep), bytes.substr(sep + 1)};
+    }
+
+    void print_ident(const Ident& id) {
+        if (id.punycode.empty()) {
+            print(id.ascii);
+            return;
+        }
+        std::string decoded;
+        if (decode_punycode(id.ascii, id.punycode, decoded)) {
+            print(std::string_view(decoded));
+        } else {
+            print("punycode{");
+            if (! id.ascii.empty()) {
+                print(id.ascii);
+                print('-');
+            }
+            print(id.punycode);
+            print('}');
+        }
+    }
+
+    // RFC 3492, 非 ASCII 标识符
+    static bool decode_punycode(std::string_view ascii, std::string_view punycode, std::string& out) {
+        constexpr size_t BASE = 36, TMIN = 1, TMAX = 26, SKEW = 38, DAMP = 700;
+        std::vector<uint32_t> chars(ascii.begin(), ascii.end());
+        size_t bias = 72;
+        size_t code = 128;
+        size_t i = 0;
+        size_t p = 0;
+        bool first = true;
+        while (p < punycode.size()) {
+            size_t old_i = i;
+            size_t w = 1;
+            for (size_t k = BASE;; k += BASE) {
+                if (p >= punycode.size()) {
+                    return false;
+                }
+                char c = punycode[p++];
+                size_t digit = 0;
+                if (c >= 'a' && c <= 'z') {
+                    digit = static_cast<size_t>(c - 'a');
+                } else if (c >= '0' && c <= '9') {
+                    digit = static_cast<size_t>(c - '0') + 26;
+                } else {
+                    return false;
+                }
+                if (digit > (SIZE_MAX - i) / w) {
+                    return false;
+                }
+                i += digit * w;
+                size_t t = k <= bias ? TMIN : (k >= bias + TMAX ? TMAX : k - bias);
+                if (digit < t) {
+                    break;
+                }
+                if (w > SIZE_MAX / (BASE - t)) {
+                    return false;
+                }
+                w *= BASE - t;
+            }
+
+            size_t len = chars.size() + 1;
+            size_t delta = (i - old_i) / (first ? DAMP : 2);
+            delta += delta / len;
+            size_t k = 0;
+            while (delta > ((BASE - TMIN) * TMAX) / 2) {
+                delta /= BASE - TMIN;
+                k += BASE;
+            }
+            bias = k + (BASE - TMIN + 1) * delta / (delta + SKEW);
+            first = false;
+
+            code += i / len;
+            i %= len;
+            if (code > 0x10FFFF) {
+                return false;
+            }
+            chars.insert(chars.begin() + static_cast<std::ptrdiff_t>(i), static_cast<uint32_t>(code));
+            ++i;
+        }
+        for (uint32_t c : chars) {
+            append_utf8(out, c);
+        }
+        return true;
+    }
+
+    template <typename F>
+    void backref(F&& f) {
+        size_t start = pos_ - 1; // 'B' 的位置
+        uint64_t target = base62();
+        if (! ok_ || target >= start) {
+            ok_ = false;
+            return;
+        }
+        size_t saved = pos_;
+        pos_ = static_cast<size_t>(target);
+        f();
+        pos_ = saved;
+    }
+
+    template <typename F>
+    void skip_printing(F&& f) {
+        bool saved = printing_;
+        printing_ = false;
+        f();
+        printing_ = saved;
+    }
+
+    void print_path(bool in_value) {
+        if (! enter()) return;
+        char tag = next();
+        switch (tag) {
+            case 'C': // crate 根, 不显示消歧符
+                opt_base62('s');
+                print_ident(ident());
+                break;
+            case 'N': {
+                char ns = next();
+                if (! ((ns >= 'a' && ns <= 'z') || (ns >= 'A' && ns <= 'Z'))) {
+                    ok_ = false;
+                    break;
+                }
+                print_path(in_value);
+                uint64_t disambiguator = opt_base62('s');
+                Ident id = ident();
+                if (ns >= 'A' && ns <= 'Z') { // 闭包、shim 等编译器生成的项: ::{closure#0}
+                    print("::{");
+                    if (ns == 'C') {
+                        print("closure");
+                    } else if (ns == 'S') {
+                        print("shim");
+                    } else {
+                        print(ns);
+                    }
+                    if (! id.empty()) {
+                        print(':');
+                        print_ident(id);
+                    }
+                    print('#');
+                    print(disambiguator);
+                    print('}');
+                } else if (! id.empty()) {
+                    print("::");
+                    print_ident(id);
+                }
+                break;
+            }
+            case 'M':
+            case 'X':
+            case 'Y': // <T>, <T as Trait>
+                if (tag != 'Y') {
+                    opt_base62('s');
+                    skip_printing([&] { print_path(false); });
+                }
+                print('<');
+                print_type();
+                if (tag != 'M') {
+                    print(" as ");
+                    print_path(false);
+                }
+                print('>');
+                break;
+            case 'I':
+                print_path(in_value);
+                if (in_value) {
+                    print("::");
+                }
+                print('<');
+                print_generic_args();
+                print('>');
+                break;
+            case 'B':
+                backref([&] { print_path(in_value); });
+                break;
+            default:
+                ok_ = false;
+                break;
+        }
+        leave();
+    }
+
+    void print_generic_args() {
+        for (size_t i = 0; ok_ && ! eat('E'); ++i) {
+            if (i > 0) {
+                print(", ");
+            }
+            print_generic_arg();
+        }
+    }
+
+    void print_generic_arg() {
+        if (eat('L')) {
+            print_lifetime(base62());
+        } else if (eat('K')) {
+            print_const();
+        } else {
+            print_type();
+        }
+    }
+
+    void print_lifetime(uint64_t lifetime) {
+        print('\'');
+        if (lifetime == 0) {
+            print('_');
+            return;
+        }
+        if (lifetime > bound_lifetimes_) {
+            ok_ = false;
+            return;
+        }
+        uint64_t depth = bound_lifetimes_ - lifetime;
+        if (depth < 26) {
+            print(static_cast<char>('a' + depth));
+        } else {
+            print('_');
+            print(depth);
+        }
+    }
+
+    // for<'a, 'b> 引入的生命周期只在 f 内有效
+    template <typename F>
+    void print_binder(F&& f) {
+        uint64_t count = opt_base62('G');
+        if (count > input_.size()) {
+            ok_ = false;
+            return;
+        }
+        if (count > 0) {
+            print("for<");
+            for (uint64_t i = 0; i < count; ++i) {
+                if (i > 0) {
+                    print(", ");
+                }
+                ++bound_lifetimes_;
+                print_lifetime(1);
+            }
+            print("> ");
+        }
+        f();
+        bound_lifetimes_ -= static_cast<size_t>(count);
+    }
+
+    static std::string_view basic_type(char tag) {
+        switch (tag) {
+            case 'a': return "i8";
+            case 'b': return "bool";
+            case 'c': return "char";
+            case 'd': return "f64";
+            case 'e': return "str";
+            case 'f': return "f32";
+            case 'h': return "u8";
+            case 'i': return "isize";
+            case 'j': return "usize";
+            case 'l': return "i32";
+            case 'm': return "u32";
+            case 'n': return "i128";
+            case 'o': return "u128";
+            case 'p': return "_";
+            case 's': return "i16";
+            case 't': return "u16";
+            case 'u': return "()";
+            case 'v': return "...";
+            case 'x': return "i64";
+            case 'y': return "u64";
+            case 'z': return "!";
+            default: return {};
+        }
+    }
+
+    void print_type() {
+        if (! enter()) return;
+        char tag = next();
+        std::string_view basic = basic_type(tag);
+        if (! basic.empty()) {
+            print(basic);
+            leave();
+            return;
+        }
+        switch (tag) {
+            case 'R':
+            case 'Q':
+                print('&');
+                if (eat('L')) {
+                    uint64_t lifetime = base62();
+                    if (lifetime != 0) {
+                        print_lifetime(lifetime);
+                        print(' ');
+                    }
+                }
+                if (tag == 'Q') {
+                    print("mut ");
+                }
+                print_type();
+                break;
+            case 'P':
+                print("*const ");
+                print_type();
+                break;
+            case 'O':
+                print("*mut ");
+                print_type();
+                break;
+            case 'A':
+            case 'S':
+                print('[');
+                print_type();
+                if (tag == 'A') {
+                    print("; ");
+                    print_const();
+                }
+                print(']');
+                break;
+            case 'T': {
+                print('(');
+                size_t count = 0;
+                for (; ok_ && ! eat('E'); ++count) {
+                    if (count > 0) {
+                        print(", ");
+                    }
+                    print_type();
+                }
+                if (count == 1) {
+                    print(',');
+                }
+                print(')');
+                break;
+            }
+            case 'F':
+                print_binder([&] { print_fn_sig(); });
+                break;
+            case 'D':
+                print("dyn ");
+                print_binder([&] {
+                    for (size_t i = 0; ok_ && ! eat('E'); ++i) {
+                        if (i > 0) {
+                            print(" + ");
+                        }
+                        print_dyn_trait();
+                    }
+                });
+                if (! eat('L')) {
+                    ok_ = false;
+                    break;
+                }
+                if (uint64_t lifetime = base62(); lifetime != 0) {
+                    print(" + ");
+                    print_lifetime(lifetime);
+                }
+                break;
+            case 'B':
+                backref([&] { print_type(); });
+                break;
+            default: // 具名类型就是路径
+                --pos_;
+                print_path(false);
+                break;
+        }
+        leave();
+    }
+
+    void print_fn_sig() {
+        if (eat('U')) {
+            print("unsafe ");
+        }
+        if (eat('K')) {
+            if (eat('C')) {
+                print("extern \"C\" ");
+            } else {
+                Ident abi = ident();
+                if (! abi.punycode.empty()) {
+                    ok_ = false;
+                    return;
+                }
+                std::string name(abi.ascii);
+                std::replace(name.begin(), name.end(), '_', '-');
+                print("extern \"");
+                print(std::string_view(name));
+                print("\" ");
+            }
+        }
+        print("fn(");
+        for (size_t i = 0; ok_ && ! eat('E'); ++i) {
+            if (i > 0) {
+                print(", ");
+            }
+            print_type();
+        }
+        print(')');
+        if (eat('u')) {
+            return; // 返回 () 时不显示
+        }
+        print(" -> ");
+        print_type();
+    }
+
+    // dyn Trait<Args, Assoc = T>: 关联类型绑定接在 trait 自己的泛型参数之后
+    void print_dyn_trait() {
+        bool open = print_path_maybe_open_generics();
+        while (eat('p')) {
+            print(open ? ", " : "<");
+            open = true;
+            print_ident(ident());
+            print(" = ");
+            print_type();
+        }
+        if (open) {
+            print('>');
+        }
+    }
+
+    // 路径带泛型参数时不输出结尾的 '>', 返回 true
+    bool print_path_maybe_open_generics() {
+        if (! enter()) return false;
+        bool open = false;
+        if (eat('B')) {
+            backref([&] { open = print_path_maybe_open_generics(); });
+        } else if (eat('I')) {
+            print_path(false);
+            print('<');
+            print_generic_args();
+            open = true;
+        } else {
+            print_path(false);
+        }
+        leave();
+        return open;
+    }
+
+    void print_const() {
+        if (! enter()) return;
+        if (eat('B')) {
+            backref([&] { print_const(); });
+        } else if (eat('p')) {
+            print('_');
+        } else {
+            char type = next();
+            switch (type) {
+                case 'a': case 'h': case 'i': case 'j': case 'l': case 'm':
+                case 'n': case 'o': case 's': case 't': case 'x': case 'y': {
+                    bool negative = eat('n');
+                    std::string_view hex = const_hex();
+                    if (hex.size() > 16) {
+                        print(negative ? "-0x" : "0x");
+                        print(hex);
+                    } else {
+                        if (negative) {
+                            print('-');
+                        }
+                        print(hex_value(hex));
+                    }
+                    break;
+                }
+                case 'b': {
+                    uint64_t value = hex_value(const_hex());
+                    if (value > 1) {
+                        ok_ = false;
+                    }
+                    print(value == 1 ? "true" : "false");
+                    break;
+                }
+                case 'c': {
+                    std::string_view hex = const_hex();
+                    uint64_t value = hex.size() <= 8 ? hex_value(hex) : UINT64_MAX;
+                    if (value > 0x10FFFF) {
+                        ok_ = false;
+                        break;
+                    }
+                    print('\'');
+                    if (value >= 0x20 && value < 0x7F && value != '\'' && value != '\\') {
+                        print(static_cast<char>(value));
+                    } else {
+                        std::string escaped = "\\u{";
+                        escaped += hex.empty() ? "0" : std::string(hex);
+                        escaped += '}';
+                        print(std::string_view(escaped));
+                    }
+                    print('\'');
+                    break;
+                }
+                default: // 字符串、结构体等较新的常量编码不支持
+                    ok_ = false;
+                    break;
+            }
+        }
+        leave();
+    }
+
+    std::string_view const_hex() {
+        size_t start = pos_;
+        while (is_lower_hex(peek())) {
+            ++pos_;
+        }
+        std::string_view hex = input_.substr(start, pos_ - start);
+        if (! eat('_')) {
+            ok_ = false;
+        }
+        return hex;
+    }
+
+    static uint64_t hex_value(std::string_view hex) {
+        uint64_t value = 0;
+        for (char c : hex) {
+            value = value * 16 + static_cast<uint64_t>(c <= '9' ? c - '0' : c - 'a' + 10);
+        }
+        return value;
+    }
+};
+
+// 🔥 ===== 入口 =====
+
+// 按前缀分派; perf 对 PLT 条目与带版本的符号附加的 "@plt"、"@@GLIBC_2.2.5" 原样保留在结果之后
+inline std::string demangle_symbol(std::string_view symbol) {
+    size_t at = std::min(symbol.find('@'), symbol.size());
+    std::string_view name = symbol.substr(0, at);
+    std::string_view suffix = symbol.substr(at);
+    if (name.size() < 3 || name[0] != '_') {
+        return {};
+    }
+
+    std::string result;
+    if (name[1] == 'R') {
+        result = RustV0Demangler(name.substr(2)).demangle();
+    } else if (name[1] == 'Z') {
+        if (name[2] == 'N') {
+            result = demangle_rust_legacy(name);
+        }
+        if (result.empty()) {
+            result = demangle_itanium(name);
+        }
+    }
+    if (result.empty()) {
+        return {};
+    }
+    result += suffix;
+    return result;
+}
+
+} // namespace flamegraph
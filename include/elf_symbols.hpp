@@ -0,0 +1,718 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ELF 符号: perf 录制时没有读到符号的帧只剩 "[unknown] (/usr/lib/libfoo.so)", 这里从本地的同一个二进制
+// 或它的调试文件（foo.debug、<debug 目录>/.build-id/xx/yyyy.debug）读取 .symtab/.dynsym 离线补上
+// 每个文件的符号整理成按地址排序的扁平表, 以 build-id 为键缓存在磁盘上, 之后的运行直接 mmap 缓存文件
+// 找不到文件、文件损坏都不是错误, 对应的帧保持原样, 因此这里不抛异常
+
+namespace flamegraph {
+
+/**
+ * @brief 只读映射整个文件, 文件不存在或无法映射时为空
+ */
+class MappedFile {
+  private:
+    void* addr_ = nullptr;
+    size_t size_ = 0;
+
+  public:
+    MappedFile() = default;
+
+    explicit MappedFile(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1) {
+            return;
+        }
+        struct stat st {};
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void* addr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                addr_ = addr;
+                size_ = static_cast<size_t>(st.st_size);
+            }
+        }
+        close(fd);
+    }
+
+    MappedFile(MappedFile&& other) noexcept
+        : addr_(std::exchange(other.addr_, nullptr)), size_(std::exchange(other.size_, 0)) {}
+
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            reset();
+            addr_ = std::exchange(other.addr_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+        }
+        return *this;
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        reset();
+    }
+
+    std::string_view view() const {
+        return addr_ == nullptr ? std::string_view{} : std::string_view(static_cast<const char*>(addr_), size_);
+    }
+
+  private:
+    void reset() {
+        if (addr_ != nullptr) {
+            munmap(addr_, size_);
+        }
+        addr_ = nullptr;
+        size_ = 0;
+    }
+};
+
+// 🔥 ===== ELF 读取 =====
+
+/**
+ * @brief 从映射的 ELF 文件中读出可加载段、build-id 与函数符号
+ *
+ * 构造时只读文件头、段表、节表和 note; 符号表可能很大, 由 symbols() 在需要建表时才读
+ * 支持与本机字节序相同的 32/64 位 ELF; 所有偏移都做越界检查, 损坏的文件视为无效
+ */
+class ElfImage {
+  public:
+    // 一个 PT_LOAD 段, 用于把 dso 内的文件偏移换算为虚拟地址
+    struct Segment {
+        uint64_t offset;
+        uint64_t file_size;
+        uint64_t vaddr;
+        uint64_t mem_size;
+    };
+
+    struct Symbol {
+        uint64_t start;
+        uint64_t size;
+        std::string_view name;
+        int rank; // 同一地址有多个符号时取 rank 小的: 有大小的优先, 全局优先, .symtab 优先
+    };
+
+  private:
+    // .symtab/.dynsym 及其字符串表的位置, 已做越界检查
+    struct SymbolSection {
+        uint64_t offset;
+        uint64_t size;
+        uint64_t strings_offset;
+        uint64_t strings_size;
+        bool symtab;
+    };
+
+    std::string_view data_;
+    bool valid_ = false;
+    bool is_64_ = false;
+    uint16_t type_ = 0;
+    bool has_symtab_ = false;
+    std::string build_id_;
+    std::vector<Segment> segments_;
+    std::vector<SymbolSection> symbol_sections_;
+
+  public:
+    explicit ElfImage(std::string_view data) : data_(data) {
+        if (data_.size() < EI_NIDENT || std::memcmp(data_.data(), ELFMAG, SELFMAG) != 0 ||
+            static_cast<unsigned char>(data_[EI_DATA]) != host_data()) {
+            return;
+        }
+        if (data_[EI_CLASS] == ELFCLASS64) {
+            is_64_ = true;
+            valid_ = load<Elf64_Ehdr, Elf64_Shdr, Elf64_Phdr, Elf64_Sym>();
+        } else if (data_[EI_CLASS] == ELFCLASS32) {
+            valid_ = load<Elf32_Ehdr, Elf32_Shdr, Elf32_Phdr, Elf32_Sym>();
+        }
+    }
+
+    bool valid() const {
+        return valid_;
+    }
+
+    // ET_EXEC 或 ET_DYN
+    uint16_t type() const {
+        return type_;
+    }
+
+    // 十六进制, 没有 NT_GNU_BUILD_ID 时为空
+    const std::string& build_id() const {
+        return build_id_;
+    }
+
+    // 有 .symtab（未 strip 或调试文件）时符号比只有 .dynsym 完整得多, 缓存按两者区分
+    bool has_symtab() const {
+        return has_symtab_;
+    }
+
+    const std::vector<Segment>& segments() const {
+        return segments_;
+    }
+
+    // 函数符号, 未排序; 每次调用都重新读取符号表
+    std::vector<Symbol> symbols() const {
+        std::vector<Symbol> symbols;
+        for (const SymbolSection& section : symbol_sections_) {
+            if (is_64_) {
+                read_symbols<Elf64_Sym>(section, symbols);
+            } else {
+                read_symbols<Elf32_Sym>(section, symbols);
+            }
+        }
+        return symbols;
+    }
+
+  private:
+    static unsigned char host_data() {
+        uint16_t probe = 1;
+        unsigned char first = 0;
+        std::memcpy(&first, &probe, 1);
+        return first == 1 ? ELFDATA2LSB : ELFDATA2MSB;
+    }
+
+    template <typename T>
+    bool read(uint64_t offset, T& out) const {
+        if (offset > data_.size() || sizeof(T) > data_.size() - offset) {
+            return false;
+        }
+        std::memcpy(&out, data_.data() + offset, sizeof(T));
+        return true;
+    }
+
+    bool in_bounds(uint64_t offset, uint64_t size) const {
+        return offset <= data_.size() && size <= data_.size() - offset;
+    }
+
+    template <typename Ehdr, typename Shdr, typename Phdr, typename Sym>
+    bool load() {
+        Ehdr header{};
+        if (! read(0, header)) {
+            return false;
+        }
+        type_ = header.e_type;
+
+        if (header.e_phentsize == sizeof(Phdr)) {
+            for (uint64_t i = 0; i < header.e_phnum; ++i) {
+                Phdr phdr{};
+                if (! read(header.e_phoff + i * sizeof(Phdr), phdr)) {
+                    return false;
+                }
+                if (phdr.p_type == PT_LOAD) {
+                    segments_.push_back({phdr.p_offset, phdr.p_filesz, phdr.p_vaddr, phdr.p_memsz});
+                }
+            }
+        }
+
+        if (header.e_shentsize != sizeof(Shdr)) {
+            return true; // 没有节头表: 没有符号, 但段信息仍然有效
+        }
+        std::vector<Shdr> sections(header.e_shnum);
+        for (size_t i = 0; i < sections.size(); ++i) {
+            if (! read(header.e_shoff + i * sizeof(Shdr), sections[i])) {
+                return false;
+            }
+        }
+        for (const Shdr& section : sections) {
+            if (section.sh_type == SHT_NOTE && build_id_.empty()) {
+                read_build_id(section.sh_offset, section.sh_size);
+            } else if (section.sh_type == SHT_SYMTAB || section.sh_type == SHT_DYNSYM) {
+                bool symtab = section.sh_type == SHT_SYMTAB;
+                has_symtab_ = has_symtab_ || symtab;
+                if (section.sh_link >= sections.size()) {
+                    continue;
+                }
+                const Shdr& strings = sections[section.sh_link];
+                if (section.sh_entsize == sizeof(Sym) && in_bounds(section.sh_offset, section.sh_size) &&
+                    in_bounds(strings.sh_offset, strings.sh_size)) {
+                    symbol_sections_.push_back(
+                        {section.sh_offset, section.sh_size, strings.sh_offset, strings.sh_size, symtab});
+                }
+            }
+        }
+        return true;
+    }
+
+    void read_build_id(uint64_t offset, uint64_t size) {
+        if (! in_bounds(offset, size)) {
+            return;
+        }
+        auto align4 = [](uint64_t n) { return (n + 3) & ~uint64_t{3}; };
+        uint64_t end = offset + size;
+        while (offset + sizeof(Elf64_Nhdr) <= end) {
+            Elf64_Nhdr note{}; // 32 位与 64 位的 note 头相同
+            read(offset, note);
+            uint64_t name_at = offset + sizeof(Elf64_Nhdr);
+            uint64_t desc_at = name_at + align4(note.n_namesz);
+            uint64_t next = desc_at + align4(note.n_descsz);
+            if (next > end) {
+                return;
+            }
+            if (note.n_type == NT_GNU_BUILD_ID && note.n_namesz == 4 &&
+                std::memcmp(data_.data() + name_at, "GNU", 4) == 0) {
+                static constexpr char HEX[] = "0123456789abcdef";
+                for (uint64_t i = 0; i < note.n_descsz; ++i) {
+                    auto byte = static_cast<unsigned char>(data_[desc_at + i]);
+                    build_id_ += HEX[byte >> 4];
+                    build_id_ += HEX[byte & 0xF];
+                }
+                return;
+            }
+            offset = next;
+        }
+    }
+
+    template <typename Sym>
+    void read_symbols(const SymbolSection& table, std::vector<Symbol>& symbols) const {
+        std::string_view names = data_.substr(table.strings_offset, table.strings_size);
+        uint64_t count = table.size / sizeof(Sym);
+        bool symtab = table.symtab;
+        for (uint64_t i = 0; i < count; ++i) {
+            Sym sym{};
+            read(table.offset + i * sizeof(Sym), sym);
+            unsigned type = sym.st_info & 0xF;
+            unsigned bind = sym.st_info >> 4;
+            if ((type != STT_FUNC && type != STT_GNU_IFUNC) || sym.st_shndx == SHN_UNDEF || sym.st_value == 0 ||
+                sym.st_name >= names.size()) {
+                continue;
+            }
+            std::string_view name = names.substr(sym.st_name);
+            name = name.substr(0, name.find('\0'));
+            if (name.empty()) {
+                continue;
+            }
+            int rank = (sym.st_size == 0 ? 4 : 0) + (bind == STB_LOCAL ? 2 : 0) + (symtab ? 0 : 1);
+            symbols.push_back({sym.st_value, sym.st_size, name, rank});
+        }
+    }
+};
+
+// 🔥 ===== 符号表 =====
+
+/**
+ * @brief 一个 dso 的扁平符号表, 内存与磁盘缓存使用同一种布局, 缓存文件 mmap 后直接使用
+ *
+ * 布局: Header | Segment[segment_count] | uint64 starts[n] | uint64 ends[n] | uint32 name_offsets[n] | names
+ * starts 单独一列, 二分查找只访问这一列; 名字以 '\0' 结尾
+ */
+class ElfSymbolTable {
+  private:
+    static constexpr char MAGIC[8] = {'F', 'G', 'E', 'L', 'F', 'S', 'Y', '1'};
+
+    struct Header {
+        char magic[8];
+        uint32_t elf_type;
+        uint32_t segment_count;
+        uint64_t symbol_count;
+        uint64_t names_bytes;
+    };
+
+    MappedFile mapped_;
+    std::string owned_;
+    Header header_{};
+    const ElfImage::Segment* segments_ = nullptr;
+    const uint64_t* starts_ = nullptr;
+    const uint64_t* ends_ = nullptr;
+    const uint32_t* name_offsets_ = nullptr;
+    const char* names_ = nullptr;
+
+  public:
+    ElfSymbolTable(const ElfSymbolTable&) = delete;
+    ElfSymbolTable& operator=(const ElfSymbolTable&) = delete;
+
+    // 把 ELF 的符号整理成上面的布局
+    static std::string build(const ElfImage& image) {
+        std::vector<ElfImage::Symbol> symbols = image.symbols();
+        std::sort(symbols.begin(), symbols.end(), [](const ElfImage::Symbol& a, const ElfImage::Symbol& b) {
+            return a.start != b.start ? a.start < b.start : a.rank < b.rank;
+        });
+        symbols.erase(std::unique(symbols.begin(), symbols.end(),
+                                  [](const ElfImage::Symbol& a, const ElfImage::Symbol& b) { return a.start == b.start; }),
+                      symbols.end());
+
+        const auto& segments = image.segments();
+        std::vector<uint64_t> ends(symbols.size());
+        for (size_t i = 0; i < symbols.size(); ++i) {
+            if (symbols[i].size != 0) {
+                ends[i] = symbols[i].start + symbols[i].size;
+            } else if (i + 1 < symbols.size()) {
+                ends[i] = symbols[i + 1].start; // 没有大小的符号（多为汇编）延伸到下一个符号
+            } else {
+                ends[i] = symbols[i].start + 1;
+                for (const auto& segment : segments) {
+                    if (segment.vaddr <= symbols[i].start && symbols[i].start < segment.vaddr + segment.mem_size) {
+                        ends[i] = segment.vaddr + segment.mem_size;
+                    }
+                }
+            }
+        }
+
+        Header header{};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.elf_type = image.type();
+        header.segment_count = static_cast<uint32_t>(segments.size());
+        header.symbol_count = symbols.size();
+        std::string names;
+        std::vector<uint32_t> name_offsets(symbols.size());
+        for (size_t i = 0; i < symbols.size(); ++i) {
+            name_offsets[i] = static_cast<uint32_t>(names.size());
+            names += symbols[i].name;
+            names += '\0';
+        }
+        header.names_bytes = names.size();
+
+        std::string bytes;
+        bytes.reserve(sizeof(Header) + segments.size() * sizeof(ElfImage::Segment) +
+                      symbols.size() * (2 * sizeof(uint64_t) + sizeof(uint32_t)) + names.size());
+        append(bytes, &header, sizeof(header));
+        append(bytes, segments.data(), segments.size() * sizeof(ElfImage::Segment));
+        for (const auto& symbol : symbols) {
+            append(bytes, &symbol.start, sizeof(uint64_t));
+        }
+        append(bytes, ends.data(), ends.size() * sizeof(uint64_t));
+        append(bytes, name_offsets.data(), name_offsets.size() * sizeof(uint32_t));
+        bytes += names;
+        return bytes;
+    }
+
+    // 格式不对时返回空
+    static std::unique_ptr<ElfSymbolTable> from_bytes(std::string bytes) {
+        std::unique_ptr<ElfSymbolTable> table(new ElfSymbolTable());
+        table->owned_ = std::move(bytes);
+        if (! table->attach(table->owned_)) {
+            return nullptr;
+        }
+        return table;
+    }
+
+    static std::unique_ptr<ElfSymbolTable> from_file(MappedFile file) {
+        std::unique_ptr<ElfSymbolTable> table(new ElfSymbolTable());
+        table->mapped_ = std::move(file);
+        if (! table->attach(table->mapped_.view())) {
+            return nullptr;
+        }
+        return table;
+    }
+
+    size_t size() const {
+        return static_cast<size_t>(header_.symbol_count);
+    }
+
+    // dso 内的地址换算为符号表的虚拟地址: is_offset 时为文件偏移, 按 PT_LOAD 段换算;
+    // 否则为进程中的绝对地址, 只有不可重定位的 ET_EXEC 才与虚拟地址相同
+    bool to_vaddr(uint64_t address, bool is_offset, uint64_t& vaddr) const {
+        if (! is_offset) {
+            vaddr = address;
+            return header_.elf_type == ET_EXEC;
+        }
+        for (uint32_t i = 0; i < header_.segment_count; ++i) {
+            const ElfImage::Segment& segment = segments_[i];
+            if (segment.offset <= address && address - segment.offset < segment.file_size) {
+                vaddr = address - segment.offset + segment.vaddr;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 包含 vaddr 的符号下标, 没有时返回 size(); hint 为上一次结果, 地址递增查找时缩小二分范围
+    size_t find(uint64_t vaddr, size_t hint = 0) const {
+        size_t count = size();
+        size_t lo = hint < count && starts_[hint] <= vaddr ? hint : 0;
+        const uint64_t* it = std::upper_bound(starts_ + lo, starts_ + count, vaddr);
+        if (it == starts_) {
+            return count;
+        }
+        size_t index = static_cast<size_t>(it - starts_) - 1;
+        return vaddr < ends_[index] ? index : count;
+    }
+
+    std::string_view name(size_t index) const {
+        return names_ + name_offsets_[index];
+    }
+
+  private:
+    ElfSymbolTable() = default;
+
+    static void append(std::string& bytes, const void* data, size_t size) {
+        bytes.append(static_cast<const char*>(data), size);
+    }
+
+    bool attach(std::string_view bytes) {
+        if (bytes.size() < sizeof(Header)) {
+            return false;
+        }
+        std::memcpy(&header_, bytes.data(), sizeof(Header));
+        uint64_t n = header_.symbol_count;
+        uint64_t segments_bytes = uint64_t{header_.segment_count} * sizeof(ElfImage::Segment);
+        uint64_t names_at = sizeof(Header) + segments_bytes + n * (2 * sizeof(uint64_t) + sizeof(uint32_t));
+        if (std::memcmp(header_.magic, MAGIC, sizeof(MAGIC)) != 0 || n > bytes.size() ||
+            names_at + header_.names_bytes != bytes.size() || (header_.names_bytes > 0 && bytes.back() != '\0')) {
+            return false;
+        }
+        const char* base = bytes.data();
+        segments_ = reinterpret_cast<const ElfImage::Segment*>(base + sizeof(Header));
+        starts_ = reinterpret_cast<const uint64_t*>(base + sizeof(Header) + segments_bytes);
+        ends_ = starts_ + n;
+        name_offsets_ = reinterpret_cast<const uint32_t*>(ends_ + n);
+        names_ = base + names_at;
+        for (uint64_t i = 0; i < n; ++i) {
+            if (name_offsets_[i] >= header_.names_bytes) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// 🔥 ===== 解析 =====
+
+struct ElfSymbolOptions {
+    std::vector<std::string> search_paths; // 二进制文件或目录（调试目录、sysroot）, 按顺序查找
+    std::string cache_dir;                 // 为空时不缓存
+    bool use_original_path = true;         // 最后尝试帧中记录的原路径（在录制的机器上离线解析时）
+};
+
+/**
+ * @brief 按 (dso, 地址) 批量还原符号, 可被多个解析线程同时调用
+ *
+ * 每个 dso 的符号表在第一次用到时载入, 载入在全局锁之外进行, 只有等同一个 dso 的线程会等待:
+ * 先按原文件的 build-id 查缓存, 命中时 mmap 缓存文件, 不打开任何候选文件; 否则逐个候选文件只读文件头,
+ * build-id 与原文件不同的候选（搜索目录中同名的另一次构建）直接跳过, 其余按 build-id 查缓存, 仍未命中才读符号建表并写入缓存.
+ * 一批请求按 (dso, 地址) 排序后逐个 dso 查找, 同一 dso 内地址递增,
+ * 二分查找从上一次的位置开始. 返回的名字引用 resolver 持有的表, 因此 resolver 须活到渲染结束
+ */
+class ElfSymbolResolver {
+  public:
+    struct Request {
+        std::string_view dso;  // 帧中记录的完整路径
+        uint64_t address = 0;  // is_offset 时为 dso 内的文件偏移, 否则为进程中的地址
+        bool is_offset = false;
+        std::string_view name; // 结果, 找不到时为空
+    };
+
+  private:
+    // 一个 dso 的符号表, 由第一个用到它的线程载入; 找不到符号时为 nullptr
+    struct TableSlot {
+        std::once_flag loaded;
+        std::unique_ptr<ElfSymbolTable> table;
+    };
+
+    ElfSymbolOptions options_;
+    std::mutex tables_mutex_; // 只保护 tables_ 本身, 载入时不持有
+    std::unordered_map<std::string, std::unique_ptr<TableSlot>> tables_;
+    std::atomic<size_t> resolved_frames_{0};
+    std::atomic<size_t> cache_hits_{0};
+
+  public:
+    explicit ElfSymbolResolver(ElfSymbolOptions options) : options_(std::move(options)) {}
+
+    // $XDG_CACHE_HOME/flamegraph/symbols 或 ~/.cache/flamegraph/symbols, 都没有时为空
+    static std::string default_cache_dir() {
+        if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg != nullptr && *xdg != '\0') {
+            return std::string(xdg) + "/flamegraph/symbols";
+        }
+        if (const char* home = std::getenv("HOME"); home != nullptr && *home != '\0') {
+            return std::string(home) + "/.cache/flamegraph/symbols";
+        }
+        return {};
+    }
+
+    void resolve(std::vector<Request>& requests) {
+        std::vector<size_t> order(requests.size());
+        std::iota(order.begin(), order.end(), size_t{0});
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            const Request& x = requests[a];
+            const Request& y = requests[b];
+            if (x.dso != y.dso) {
+                return x.dso < y.dso;
+            }
+            return x.is_offset != y.is_offset ? x.is_offset < y.is_offset : x.address < y.address;
+        });
+
+        size_t resolved = 0;
+        for (size_t begin = 0; begin < order.size();) {
+            std::string_view dso = requests[order[begin]].dso;
+            size_t end = begin + 1;
+            while (end < order.size() && requests[order[end]].dso == dso) {
+                ++end;
+            }
+            if (const ElfSymbolTable* symbols = table(dso)) {
+                size_t hint = 0;
+                for (size_t i = begin; i < end; ++i) {
+                    Request& request = requests[order[i]];
+                    uint64_t vaddr = 0;
+                    if (! symbols->to_vaddr(request.address, request.is_offset, vaddr)) {
+                        continue;
+                    }
+                    size_t index = symbols->find(vaddr, hint);
+                    if (index < symbols->size()) {
+                        request.name = symbols->name(index);
+                        hint = index;
+                        ++resolved;
+                    }
+                }
+            }
+            begin = end;
+        }
+        resolved_frames_.fetch_add(resolved, std::memory_order_relaxed);
+    }
+
+    // 没有可用符号时返回 nullptr
+    const ElfSymbolTable* table(std::string_view dso) {
+        TableSlot* slot = nullptr;
+        const std::string* path = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(tables_mutex_);
+            auto [it, inserted] = tables_.try_emplace(std::string(dso));
+            if (inserted) {
+                it->second = std::make_unique<TableSlot>();
+            }
+            slot = it->second.get();
+            path = &it->first; // unordered_map 的键在 rehash 后地址不变
+        }
+        std::call_once(slot->loaded, [&] { slot->table = load(*path); });
+        return slot->table.get();
+    }
+
+    // 累计还原成功的帧数（按样本中的帧计）
+    size_t resolved_frames() const {
+        return resolved_frames_.load(std::memory_order_relaxed);
+    }
+
+    // 直接使用磁盘缓存的 dso 个数
+    size_t cache_hits() const {
+        return cache_hits_.load(std::memory_order_relaxed);
+    }
+
+  private:
+    std::unique_ptr<ElfSymbolTable> load(const std::string& dso) {
+        // 原文件在本机时先读出它的 build-id（只读文件头与 note）, 用来查缓存和在调试目录的 .build-id/ 下找调试文件
+        std::string build_id;
+        {
+            MappedFile original(dso);
+            build_id = ElfImage(original.view()).build_id();
+        }
+        // 带 .symtab 的缓存是最完整的结果, 命中时不必打开候选文件;
+        // 只有 .dynsym 的缓存要等确认候选中没有更完整的文件（例如新加入的调试文件）后才用
+        if (auto cached = open_cache(build_id, true); cached && cached->size() > 0) {
+            return cached;
+        }
+        for (const auto& candidate : candidates(dso, build_id)) {
+            auto symbols = open_table(candidate, build_id);
+            if (symbols && symbols->size() > 0) {
+                return symbols;
+            }
+        }
+        return nullptr;
+    }
+
+    std::vector<std::string> candidates(const std::string& dso, const std::string& build_id) const {
+        namespace fs = std::filesystem;
+        std::vector<std::string> paths;
+        fs::path original(dso);
+        std::string base = original.filename().string();
+        for (const auto& search : options_.search_paths) {
+            std::error_code ec;
+            if (fs::is_directory(search, ec)) {
+                fs::path dir(search);
+                if (build_id.size() > 2) {
+                    paths.push_back((dir / ".build-id" / build_id.substr(0, 2) / (build_id.substr(2) + ".debug")).string());
+                }
+                paths.push_back((dir / original.relative_path()).string() + ".debug");
+                paths.push_back((dir / original.relative_path()).string());
+                paths.push_back((dir / (base + ".debug")).string());
+                paths.push_back((dir / base).string());
+            } else {
+                std::string name = fs::path(search).filename().string();
+                if (name == base || name == base + ".debug") {
+                    paths.push_back(search);
+                }
+            }
+        }
+        if (options_.use_original_path) {
+            paths.push_back(dso);
+        }
+        return paths;
+    }
+
+    // 缓存关闭或没有 build-id 时为空
+    std::string cache_path(const std::string& build_id, bool symtab) const {
+        if (options_.cache_dir.empty() || build_id.empty()) {
+            return {};
+        }
+        return options_.cache_dir + "/" + build_id + (symtab ? ".symtab" : ".dynsym");
+    }
+
+    std::unique_ptr<ElfSymbolTable> open_cache(const std::string& build_id, bool symtab) {
+        std::string path = cache_path(build_id, symtab);
+        if (path.empty()) {
+            return nullptr;
+        }
+        auto cached = ElfSymbolTable::from_file(MappedFile(path));
+        if (cached) {
+            cache_hits_.fetch_add(1, std::memory_order_relaxed);
+        }
+        return cached;
+    }
+
+    // 原文件的 build-id 已知时, build-id 不同（或没有）的候选文件是另一次构建, 跳过; 未知时无从校验, 用候选自己的.
+    // 缓存命中时只读了文件头, 未命中才读符号
+    std::unique_ptr<ElfSymbolTable> open_table(const std::string& path, const std::string& expected_build_id) {
+        MappedFile file(path);
+        ElfImage image(file.view());
+        if (! image.valid() || (! expected_build_id.empty() && image.build_id() != expected_build_id)) {
+            return nullptr;
+        }
+        if (auto cached = open_cache(image.build_id(), image.has_symtab())) {
+            return cached;
+        }
+
+        std::string bytes = ElfSymbolTable::build(image);
+        std::string cache_file = cache_path(image.build_id(), image.has_symtab());
+        if (! cache_file.empty()) {
+            write_cache(cache_file, bytes);
+        }
+        return ElfSymbolTable::from_bytes(std::move(bytes));
+    }
+
+    // 先写临时文件再改名, 并发的运行不会读到写了一半的缓存; 写不了时只是不缓存
+    void write_cache(const std::string& path, const std::string& bytes) const {
+        std::error_code ec;
+        std::filesystem::create_directories(options_.cache_dir, ec);
+        std::string tmp = path + ".tmp." + std::to_string(getpid());
+        {
+            std::ofstream ofs(tmp, std::ios::binary);
+            if (! ofs.is_open() || ! ofs.write(bytes.data(), static_cast<std::streamsize>(bytes.size()))) {
+                std::filesystem::remove(tmp, ec);
+                return;
+            }
+        }
+        std::filesystem::rename(tmp, path, ec);
+        if (ec) {
+            std::filesystem::remove(tmp, ec);
+        }
+    }
+};
+
+} // namespace flamegraph
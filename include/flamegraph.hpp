@@ -1,8 +1,13 @@
 #pragma once
 
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <chrono>
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
+#include <ctime>
 #include <fstream>
 #include <functional>
 #include <iostream>
@@ -15,13 +20,24 @@
 #include <filesystem>
 #include <stdexcept>
 #include <memory_resource>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include <fcntl.h>
 
+#include "demangle.hpp"
+#include "elf_symbols.hpp"
+#include "perf_map.hpp"
+
 namespace flamegraph {
-thread_local static inline std::pmr::unsynchronized_pool_resource pool;
 
 class FlameGraphException : public std::runtime_error {
   public:
@@ -59,6 +75,12 @@ class RenderException : public FlameGraphException {
         : FlameGraphException(std::string("Render Error: ") + message.data()) {}
 };
 
+// 生成被 CancellationToken 取消; 生成器原样抛出, 不转换为 FlameGraphException
+class CancelledException : public FlameGraphException {
+  public:
+    CancelledException() : FlameGraphException("Generation cancelled") {}
+};
+
 namespace {
 inline std::string_view trim(std::string_view str) {
     const auto first = str.find_first_not_of(" \t\r\n");
@@ -70,14 +92,25 @@ inline std::string_view trim(std::string_view str) {
     return str.substr(first, last - first + 1);
 }
 
+// 普通文件直接 mmap; 管道、FIFO 和 "-"（标准输入）无法 mmap, 整体读入内存,
+// 这样合成数据可以直接从生成器流进来, 不必先落盘. 报告大小为 0 的普通文件（空文件、procfs 一类）同样读入
 struct MMapBuffer {
     void* addr;
     size_t size;
+    bool mapped = true;
+    std::string piped; // 非普通文件时的内容, 此时 addr 指向这里
 
     MMapBuffer(std::string_view filename) {
-        int fd = open(filename.data(), O_RDONLY);
+        int fd = filename == "-" ? STDIN_FILENO : open(filename.data(), O_RDONLY);
         if (fd == -1) throw OpenFileException(filename);
-        size = lseek(fd, 0, SEEK_END);
+        struct stat st {};
+        if (fstat(fd, &st) == 0 && (! S_ISREG(st.st_mode) || st.st_size == 0)) {
+            bool ok = read_all(fd);
+            if (fd != STDIN_FILENO) close(fd);
+            if (! ok) throw OpenFileException(filename);
+            return;
+        }
+        size = static_cast<size_t>(lseek(fd, 0, SEEK_END));
         addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
         if (addr == MAP_FAILED) throw MemoryException("mmap failed");
         madvise(addr, size, MADV_WILLNEED);
@@ -85,12 +118,32 @@ struct MMapBuffer {
     }
 
     ~MMapBuffer() {
-        munmap(addr, size);
+        if (mapped) {
+            munmap(addr, size);
+        }
     }
 
     std::string_view view() const {
         return {static_cast<char*>(addr), size};
     }
+
+  private:
+    bool read_all(int fd) {
+        constexpr size_t BLOCK = 1 << 20;
+        size_t used = 0;
+        for (;;) {
+            piped.resize(used + BLOCK);
+            ssize_t n = ::read(fd, piped.data() + used, BLOCK);
+            if (n < 0) return false;
+            if (n == 0) break;
+            used += static_cast<size_t>(n);
+        }
+        piped.resize(used);
+        mapped = false;
+        addr = piped.data();
+        size = used;
+        return true;
+    }
 };
 
 struct LineScanner {
@@ -201,7 +254,7 @@ inline std::string escape_xml(std::string_view str) {
     return escaped;
 }
 
-void escape_xml_to_stream(std::string_view str, std::ofstream& os) {
+inline void escape_xml_to_stream(std::string_view str, std::ostream& os) {
     for (char c : str) {
         switch (c) {
             case '&':
@@ -330,19 +383,989 @@ class ColorSchemeFactory {
     }
 };
 
+// 🔥 ===== 内存管理 =====
+
+enum class HugePages {
+    Off,         // 普通页
+    Transparent, // madvise(MADV_HUGEPAGE), 由内核决定是否合并为大页
+    Explicit,    // MAP_HUGETLB, 需要预留大页; 失败时退回 Transparent
+};
+
+// arena 的底层内存策略, 默认与 new/delete 相同
+struct ArenaPolicy {
+    HugePages huge_pages = HugePages::Off;
+    bool numa_local = false; // 优先从分配线程所在的 NUMA 节点取页
+};
+
+// 系统中的 NUMA 节点数, 无法判断时为 1
+inline size_t numa_node_count() {
+    static const size_t count = [] {
+        size_t nodes = 0;
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator("/sys/devices/system/node", ec)) {
+            auto name = entry.path().filename().string();
+            if (name.rfind("node", 0) == 0 && name.size() > 4 && std::isdigit(static_cast<unsigned char>(name[4]))) {
+                ++nodes;
+            }
+        }
+        return std::max<size_t>(1, nodes);
+    }();
+    return count;
+}
+
+/**
+ * @brief 直接用 mmap 取整块内存的上游资源, 供 arena 按策略使用大页和 NUMA 本地内存
+ *
+ * 只适合作为 monotonic_buffer_resource 的上游: 每次申请都是一次 mmap, 粒度很粗
+ * 大页或 mbind 不可用（权限、内核配置、单节点机器）时静默退回普通页, 不影响正确性
+ */
+class PageResource : public std::pmr::memory_resource {
+  private:
+    static constexpr size_t HUGE_PAGE_SIZE = 2 << 20;
+    static constexpr int MPOL_PREFERRED_MODE = 1; // 即 <numaif.h> 中的 MPOL_PREFERRED, 避免依赖 libnuma
+
+    ArenaPolicy policy_;
+
+  public:
+    explicit PageResource(const ArenaPolicy& policy) : policy_(policy) {}
+
+    const ArenaPolicy& policy() const {
+        return policy_;
+    }
+
+  private:
+    size_t mapping_size(size_t size) const {
+        size_t granularity = policy_.huge_pages == HugePages::Off ? static_cast<size_t>(sysconf(_SC_PAGESIZE))
+                                                                  : HUGE_PAGE_SIZE;
+        return (size + granularity - 1) / granularity * granularity;
+    }
+
+    void* do_allocate(size_t size, size_t alignment) override {
+        (void)alignment; // mmap 按页对齐, 足以满足任何基本类型
+        size_t length = mapping_size(size);
+        void* addr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+        if (policy_.huge_pages == HugePages::Explicit) {
+            addr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        }
+#endif
+        if (addr == MAP_FAILED) {
+            addr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (addr == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+#ifdef MADV_HUGEPAGE
+            if (policy_.huge_pages != HugePages::Off) {
+                madvise(addr, length, MADV_HUGEPAGE);
+            }
+#endif
+        }
+        if (policy_.numa_local) {
+            bind_to_local_node(addr, length);
+        }
+        return addr;
+    }
+
+    void do_deallocate(void* p, size_t size, size_t alignment) override {
+        (void)alignment;
+        munmap(p, mapping_size(size));
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    // 页还未被触碰, 此时设置策略即可决定它们落在哪个节点
+    static void bind_to_local_node(void* addr, size_t length) {
+#if defined(SYS_getcpu) && defined(SYS_mbind)
+        if (numa_node_count() <= 1) {
+            return;
+        }
+        unsigned cpu = 0;
+        unsigned node = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0 || node >= 64) {
+            return;
+        }
+        unsigned long mask = 1UL << node;
+        syscall(SYS_mbind, addr, length, MPOL_PREFERRED_MODE, &mask, 64UL, 0U);
+#else
+        (void)addr;
+        (void)length;
+#endif
+    }
+};
+
+/**
+ * @brief 一次生成所用的 arena
+ *
+ * 节点、children 哈希表、折叠结果都从这里分配, 生成结束后整体释放, 不逐个析构
+ * reuse 模式下本轮向上游申请的块在释放时都保留下来, 下次生成的申请按大小取回这些已经触碰过的热页;
+ * 用量增长的那一轮新申请的块同样保留, 之后只有超出历史峰值的部分才是新触碰的页.
+ * NUMA 本地模式例外: 块须由工作线程首次触碰, 因此每轮释放, 只把上次的用量作为首块大小
+ * 非线程安全: 并行阶段每个线程使用自己的 arena
+ */
+class GenerationArena {
+  private:
+    // 记录 monotonic 向上游申请的字节数; retain 时归还的块留作备用, 之后的申请优先从备用块中取
+    class UpstreamTracker : public std::pmr::memory_resource {
+      public:
+        struct Block {
+            void* p;
+            size_t size;
+        };
+
+        size_t bytes = 0;
+        bool retain = false;
+        std::pmr::memory_resource* base = std::pmr::new_delete_resource();
+        std::vector<Block> spare; // 可以借出的保留块
+        std::vector<Block> lent;  // 借出的块的实际大小, 可能大于申请的大小
+
+        // 把备用块还给 base
+        void free_spare() {
+            for (const Block& block : spare) {
+                base->deallocate(block.p, block.size, alignof(std::max_align_t));
+            }
+            spare.clear();
+        }
+
+      private:
+        void* do_allocate(size_t size, size_t alignment) override {
+            bytes += size;
+            if (alignment <= alignof(std::max_align_t)) {
+                // 取能容纳的最小块; 热缓冲区不变时各轮的申请序列相同, 通常正好合适
+                auto best = spare.end();
+                for (auto it = spare.begin(); it != spare.end(); ++it) {
+                    if (it->size >= size && (best == spare.end() || it->size < best->size)) {
+                        best = it;
+                    }
+                }
+                if (best != spare.end()) {
+                    Block block = *best;
+                    spare.erase(best);
+                    lent.push_back(block);
+                    return block.p;
+                }
+            }
+            return base->allocate(size, std::max(alignment, alignof(std::max_align_t)));
+        }
+
+        void do_deallocate(void* p, size_t size, size_t alignment) override {
+            Block block{p, size};
+            auto it = std::find_if(lent.begin(), lent.end(), [p](const Block& b) { return b.p == p; });
+            if (it != lent.end()) {
+                block = *it;
+                lent.erase(it);
+            }
+            if (retain && alignment <= alignof(std::max_align_t)) {
+                spare.push_back(block);
+            } else {
+                base->deallocate(block.p, block.size, std::max(alignment, alignof(std::max_align_t)));
+            }
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+    };
+
+    static constexpr size_t PAGE_BACKED_INITIAL_SIZE = 2 << 20; // 页策略下每次至少向上游要一个大页
+
+    bool reuse_;
+    std::unique_ptr<PageResource> pages_; // 默认策略下为空, 直接使用 new/delete
+    UpstreamTracker upstream_;
+    size_t next_initial_size_ = 0; // NUMA 本地模式下代替保留块: 首次分配时一次要够上次的用量
+    std::unique_ptr<std::pmr::monotonic_buffer_resource> mono_;
+
+  public:
+    explicit GenerationArena(bool reuse = false, const ArenaPolicy& policy = {}) : reuse_(reuse) {
+        apply_policy(policy);
+        reset_resource();
+    }
+
+    ~GenerationArena() {
+        mono_.reset();
+        free_retained();
+    }
+
+    GenerationArena(const GenerationArena&) = delete;
+    GenerationArena& operator=(const GenerationArena&) = delete;
+
+    std::pmr::memory_resource* resource() {
+        return mono_.get();
+    }
+
+    // 本轮向上游申请的字节数, 包括取自保留块的部分
+    size_t bytes_reserved() const {
+        return upstream_.bytes;
+    }
+
+    bool reuse() const {
+        return reuse_;
+    }
+
+    void set_reuse(bool reuse) {
+        reuse_ = reuse;
+        mono_.reset();
+        if (! reuse_) {
+            free_retained();
+        }
+        reset_resource();
+    }
+
+    // 更换底层内存策略, 会丢弃本轮分配的全部内存
+    void set_policy(const ArenaPolicy& policy) {
+        mono_.reset();
+        free_retained();
+        apply_policy(policy);
+        reset_resource();
+    }
+
+    ArenaPolicy policy() const {
+        return pages_ ? pages_->policy() : ArenaPolicy{};
+    }
+
+    // 释放本轮分配的全部内存; 之后从 arena 得到的指针全部失效
+    void release() {
+        size_t wanted = bytes_reserved();
+        bool grow = reuse_ && upstream_.bytes > 0;
+        if (grow && pages_ && pages_->policy().numa_local) {
+            // release 在主线程调用, 此时分配会落在主线程的节点上; 推迟到工作线程首次分配
+            mono_.reset();
+            next_initial_size_ = wanted;
+        } else {
+            // 本轮向上游申请的块全部保留, 不释放也不重新申请
+            upstream_.retain = reuse_;
+            mono_.reset();
+            upstream_.retain = false;
+        }
+        reset_resource();
+    }
+
+  private:
+    void apply_policy(const ArenaPolicy& policy) {
+        bool page_backed = policy.huge_pages != HugePages::Off || policy.numa_local;
+        pages_ = page_backed ? std::make_unique<PageResource>(policy) : nullptr;
+        upstream_.base = page_backed ? static_cast<std::pmr::memory_resource*>(pages_.get())
+                                     : std::pmr::new_delete_resource();
+    }
+
+    void free_retained() {
+        next_initial_size_ = 0;
+        upstream_.free_spare();
+    }
+
+    void reset_resource() {
+        mono_.reset();
+        upstream_.bytes = 0;
+        if (pages_) {
+            size_t initial = std::max(PAGE_BACKED_INITIAL_SIZE, next_initial_size_);
+            mono_ = std::make_unique<std::pmr::monotonic_buffer_resource>(initial, &upstream_);
+        } else {
+            mono_ = std::make_unique<std::pmr::monotonic_buffer_resource>(&upstream_);
+        }
+    }
+};
+
+// 作用域结束时释放 arena, 保证先于 arena 释放的对象（树、折叠结果）都已不再使用
+struct ArenaReleaseGuard {
+    GenerationArena& arena;
+
+    ~ArenaReleaseGuard() {
+        arena.release();
+    }
+};
+
+// 🔥 ===== 分配计数 =====
+
+// 一个子系统的分配统计
+struct AllocationStats {
+    size_t allocations = 0;
+    size_t bytes_requested = 0; // 使用方请求的总字节
+    size_t bytes_released = 0;  // 使用方归还的字节; 在 monotonic 之上无法复用, 即扩容等造成的浪费
+    size_t bytes_reserved = 0;  // 向下一层实际要走的字节（monotonic 按块申请, 会大于 requested）
+    size_t high_water = 0;      // 同时在用字节（requested - released）的峰值
+
+    // 合并多个资源的统计; 峰值相加, 是合并后峰值的上界
+    AllocationStats& operator+=(const AllocationStats& other) {
+        allocations += other.allocations;
+        bytes_requested += other.bytes_requested;
+        bytes_released += other.bytes_released;
+        bytes_reserved += other.bytes_reserved;
+        high_water += other.high_water;
+        return *this;
+    }
+};
+
+/**
+ * @brief 透传的计数资源: 所有请求原样转给上游, 只记录次数和字节数
+ *
+ * 非线程安全, 与 arena 一样每个线程各用一个; 每次分配只多一次虚调用和几次加法, 可以一直开启
+ */
+class CountingResource : public std::pmr::memory_resource {
+  private:
+    std::pmr::memory_resource* upstream_;
+    AllocationStats stats_;
+
+  public:
+    explicit CountingResource(std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+        : upstream_(upstream) {}
+
+    CountingResource(const CountingResource&) = delete;
+    CountingResource& operator=(const CountingResource&) = delete;
+
+    // 透传资源向上游要的就是使用方请求的字节数
+    AllocationStats stats() const {
+        AllocationStats stats = stats_;
+        stats.bytes_reserved = stats.bytes_requested;
+        return stats;
+    }
+
+    std::pmr::memory_resource* upstream() const {
+        return upstream_;
+    }
+
+  private:
+    void* do_allocate(size_t size, size_t alignment) override {
+        void* p = upstream_->allocate(size, alignment);
+        ++stats_.allocations;
+        stats_.bytes_requested += size;
+        stats_.high_water = std::max(stats_.high_water, stats_.bytes_requested - stats_.bytes_released);
+        return p;
+    }
+
+    void do_deallocate(void* p, size_t size, size_t alignment) override {
+        stats_.bytes_released += size;
+        upstream_->deallocate(p, size, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
 // 统计信息结构
 struct TreeStats {
     size_t total_nodes = 0;
     size_t leaf_nodes = 0;
     int max_depth = 0;
     size_t total_samples = 0;
+    size_t distinct_frames = 0; // 名字 + 标记都相同的 Frame 只计一次
     std::vector<size_t> depth_distribution;
+    size_t single_child_nodes = 0;     // 恰好一个子节点
+    size_t max_single_child_chain = 0; // 连续单子节点的最长链
+    size_t max_fanout = 0;
+    std::vector<size_t> fanout_histogram; // 下标 0 为叶子, k > 0 为子节点数在 [2^(k-1), 2^k) 之间
+
+    static size_t fanout_bucket(size_t fanout) {
+        size_t bucket = 0;
+        for (; fanout != 0; fanout >>= 1) {
+            ++bucket;
+        }
+        return bucket;
+    }
+
+    // 拆分输出时合并另一棵树; distinct_frames 在树之间可能重复, 只是简单相加
+    void merge(const TreeStats& other) {
+        total_nodes += other.total_nodes;
+        leaf_nodes += other.leaf_nodes;
+        max_depth = std::max(max_depth, other.max_depth);
+        total_samples += other.total_samples;
+        distinct_frames += other.distinct_frames;
+        single_child_nodes += other.single_child_nodes;
+        max_single_child_chain = std::max(max_single_child_chain, other.max_single_child_chain);
+        max_fanout = std::max(max_fanout, other.max_fanout);
+        add_histogram(depth_distribution, other.depth_distribution);
+        add_histogram(fanout_histogram, other.fanout_histogram);
+    }
+
+    static void add_histogram(std::vector<size_t>& into, const std::vector<size_t>& from) {
+        into.resize(std::max(into.size(), from.size()), 0);
+        for (size_t i = 0; i < from.size(); ++i) {
+            into[i] += from[i];
+        }
+    }
+};
+
+/**
+ * @brief 链式哈希表（std::unordered_map）的健康度, 可以汇总多张表
+ *
+ * chain_histogram[n] 为链长恰好为 n 的桶数, 查找的代价与所在桶的链长成正比
+ * rehashes 为填表过程中桶数组被替换的次数（含 reserve 与首次插入时的分配）, 由填表的一方统计
+ */
+struct HashTableHealth {
+    size_t tables = 0;
+    size_t elements = 0;
+    size_t buckets = 0;
+    size_t max_chain = 0;
+    size_t rehashes = 0;
+    std::vector<size_t> chain_histogram;
+
+    double load_factor() const {
+        return buckets == 0 ? 0 : static_cast<double>(elements) / static_cast<double>(buckets);
+    }
+
+    template <typename Map>
+    void add_table(const Map& map) {
+        ++tables;
+        elements += map.size();
+        buckets += map.bucket_count();
+        for (size_t b = 0; b < map.bucket_count(); ++b) {
+            size_t chain = map.bucket_size(b);
+            if (chain >= chain_histogram.size()) {
+                chain_histogram.resize(chain + 1, 0);
+            }
+            ++chain_histogram[chain];
+            max_chain = std::max(max_chain, chain);
+        }
+    }
+
+    void merge(const HashTableHealth& other) {
+        tables += other.tables;
+        elements += other.elements;
+        buckets += other.buckets;
+        max_chain = std::max(max_chain, other.max_chain);
+        rehashes += other.rehashes;
+        TreeStats::add_histogram(chain_histogram, other.chain_histogram);
+    }
+};
+
+// 🔥 ===== 自追踪 =====
+
+/**
+ * @brief 工具自身的时间线: 各阶段以及每个分块、分片、子树、渲染段的耗时, 按线程记录
+ *
+ * 输出 Chrome trace event JSON, chrome://tracing 与 Perfetto 都能直接打开
+ * 每个线程只往自己的缓冲区追加, 不加锁; 未开启时 TraceSpan 只做一次 relaxed 读
+ * start()/write() 须在没有并行任务运行时调用
+ */
+class Tracer {
+  public:
+    static constexpr size_t NO_INDEX = static_cast<size_t>(-1);
+
+  private:
+    struct Event {
+        const char* category;
+        const char* name;
+        std::chrono::steady_clock::time_point begin;
+        std::chrono::steady_clock::time_point end;
+        size_t index;
+    };
+
+    struct ThreadBuffer {
+        long tid;
+        std::vector<Event> events;
+    };
+
+    std::atomic<bool> enabled_{false};
+    std::chrono::steady_clock::time_point origin_;
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers_; // 线程退出后缓冲区仍保留, 直到进程结束
+
+    inline static thread_local ThreadBuffer* tl_buffer_ = nullptr;
+
+  public:
+    static Tracer& instance() {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    bool enabled() const {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    // 清空已有事件并开始记录
+    void start() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& buffer : buffers_) {
+            buffer->events.clear();
+        }
+        origin_ = std::chrono::steady_clock::now();
+        enabled_.store(true, std::memory_order_relaxed);
+    }
+
+    void stop() {
+        enabled_.store(false, std::memory_order_relaxed);
+    }
+
+    void record(const char* category,
+                const char* name,
+                std::chrono::steady_clock::time_point begin,
+                std::chrono::steady_clock::time_point end,
+                size_t index = NO_INDEX) {
+        if (tl_buffer_ == nullptr) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            buffers_.push_back(std::make_unique<ThreadBuffer>());
+            buffers_.back()->tid = syscall(SYS_gettid);
+            tl_buffer_ = buffers_.back().get();
+        }
+        tl_buffer_->events.push_back(Event{category, name, begin, end, index});
+    }
+
+    // path 为 "-" 时写到标准输出
+    void write(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::ofstream file;
+        if (path != "-") {
+            file.open(path);
+            if (! file.is_open()) {
+                throw OpenFileException(path);
+            }
+        }
+        std::ostream& out = path == "-" ? std::cout : file;
+
+        auto micros = [this](std::chrono::steady_clock::time_point t) {
+            return std::chrono::duration<double, std::micro>(t - origin_).count();
+        };
+        long pid = getpid();
+        out << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first = true;
+        for (const auto& buffer : buffers_) {
+            out << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+                << ",\"tid\":" << buffer->tid << ",\"args\":{\"name\":\"" << (buffer->tid == pid ? "main" : "worker")
+                << "\"}}";
+            first = false;
+            for (const auto& e : buffer->events) {
+                out << ",\n{\"name\":\"" << e.name << "\",\"cat\":\"" << e.category << "\",\"ph\":\"X\",\"ts\":"
+                    << micros(e.begin) << ",\"dur\":" << micros(e.end) - micros(e.begin) << ",\"pid\":" << pid
+                    << ",\"tid\":" << buffer->tid;
+                if (e.index != NO_INDEX) {
+                    out << ",\"args\":{\"index\":" << e.index << "}";
+                }
+                out << "}";
+            }
+        }
+        out << "\n]}\n";
+    }
+};
+
+// 作用域内的一段追踪; name/category 须是字符串字面量
+class TraceSpan {
+  private:
+    const char* category_;
+    const char* name_;
+    size_t index_;
+    bool active_;
+    std::chrono::steady_clock::time_point begin_;
+
+  public:
+    TraceSpan(const char* category, const char* name, size_t index = Tracer::NO_INDEX)
+        : category_(category), name_(name), index_(index), active_(Tracer::instance().enabled()) {
+        if (active_) {
+            begin_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~TraceSpan() {
+        if (active_) {
+            Tracer::instance().record(category_, name_, begin_, std::chrono::steady_clock::now(), index_);
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+};
+
+// 🔥 ===== 运行统计 =====
+
+// 一个阶段的耗时; cpu 为整个进程的 CPU 时间, 并行阶段包含所有线程
+struct StageTime {
+    double wall_ms = 0;
+    double cpu_ms = 0;
+
+    StageTime& operator+=(const StageTime& other) {
+        wall_ms += other.wall_ms;
+        cpu_ms += other.cpu_ms;
+        return *this;
+    }
+};
+
+// 分段计时: 每次 lap() 返回距上一次 lap（或构造）的耗时
+class StageTimer {
+  private:
+    std::chrono::steady_clock::time_point wall_;
+    double cpu_ms_;
+
+    static double process_cpu_ms() {
+        timespec ts{};
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return static_cast<double>(ts.tv_sec) * 1e3 + static_cast<double>(ts.tv_nsec) / 1e6;
+    }
+
+  public:
+    StageTimer() : wall_(std::chrono::steady_clock::now()), cpu_ms_(process_cpu_ms()) {}
+
+    // 给出 trace_name 且追踪已开启时, 这一段同时记为一个阶段事件
+    StageTime lap(const char* trace_name = nullptr) {
+        auto wall = std::chrono::steady_clock::now();
+        if (trace_name != nullptr && Tracer::instance().enabled()) {
+            Tracer::instance().record("stage", trace_name, wall_, wall);
+        }
+        double cpu_ms = process_cpu_ms();
+        StageTime time{std::chrono::duration<double, std::milli>(wall - wall_).count(), cpu_ms - cpu_ms_};
+        wall_ = wall;
+        cpu_ms_ = cpu_ms;
+        return time;
+    }
+};
+
+/**
+ * @brief 一次生成的统计, 每次 generate 都会填写, 通过 get_last_stats() 读取
+ *
+ * 计数都在各阶段中顺带得到, 不额外遍历数据, 可以一直开启
+ * distinct_frames 需要对每个节点的名字做一次哈希, 只在 set_detailed_stats(true) 时统计, 否则为 0
+ * demangled_symbols 为成功还原的不同符号数, 只在 set_demangle(true) 时统计
+ * jit_frames 为从 perf-<pid>.map 还原的帧数（按样本计）, 只在设置了 ParseOptions::perf_maps 时统计
+ * elf_frames 为从本地 ELF 文件还原的帧数, 只在设置了 ParseOptions::elf_symbols 时统计
+ * 拆分/切片输出时树的计数为各张图之和, 建树与渲染在各组之间并行交错, 合计记在 render 中
+ */
+struct RunStats {
+    size_t bytes_read = 0;
+    size_t lines = 0;
+    size_t samples = 0;
+    size_t unique_stacks = 0;
+    size_t distinct_frames = 0;
+    size_t demangled_symbols = 0;
+    size_t jit_frames = 0;
+    size_t elf_frames = 0;
+    size_t tree_nodes = 0;
+    int max_depth = 0;
+    size_t pruned_nodes = 0;
+    size_t bytes_written = 0;
+    size_t peak_arena_bytes = 0;
+    StageTime parse;    // 流水线与多文件模式下解析和折叠重叠执行, 合计记在这里
+    StageTime collapse; // 含符号还原与写 folded 文件
+    StageTime build;
+    StageTime render;
+    StageTime total;
+
+    // 各子系统的分配; 并行版的折叠表直接使用堆, 不计入 collapse
+    struct Memory {
+        AllocationStats samples;  // 样本数组
+        AllocationStats frames;   // 每个样本的 Frame 数组
+        AllocationStats collapse; // 折叠哈希表
+        AllocationStats tree;     // 树节点及其 children 表
+    } memory;
+
+    // 数据结构诊断, 只在 set_diagnostics(true) 时统计（需要遍历所有哈希桶和整棵树）
+    // 折叠表: 串行版为 CollapsedStack, 并行分阶段版为各分块的局部表; 流水线、多文件与拆分模式不统计
+    struct Diagnostics {
+        bool enabled = false;
+        HashTableHealth collapse_table;
+        HashTableHealth children_tables;
+        TreeStats tree;
+    } diagnostics;
+
+    // 并行生成器的执行计划（见 ExecutionPlanner）及其依据, 串行生成器不填
+    struct Plan {
+        bool enabled = false;
+        std::string strategy;
+        size_t threads = 0;
+        size_t chunk_count = 0;             // 分阶段模式的分块数
+        size_t chunk_bytes = 0;             // 流水线模式的块大小
+        size_t estimated_samples = 0;       // 由探测前缀估算
+        size_t estimated_unique_stacks = 0;
+        size_t presize = 0;                 // 折叠哈希表的预分配大小
+        std::string reason;
+    } plan;
+
+    // 拆分输出时合并另一张图的统计
+    void add_graph(const RunStats& graph) {
+        distinct_frames += graph.distinct_frames;
+        demangled_symbols += graph.demangled_symbols;
+        tree_nodes += graph.tree_nodes;
+        max_depth = std::max(max_depth, graph.max_depth);
+        pruned_nodes += graph.pruned_nodes;
+        bytes_written += graph.bytes_written;
+        memory.tree += graph.memory.tree;
+        if (graph.diagnostics.enabled) {
+            diagnostics.enabled = true;
+            diagnostics.children_tables.merge(graph.diagnostics.children_tables);
+            diagnostics.tree.merge(graph.diagnostics.tree);
+        }
+    }
+
+    std::string to_json() const {
+        std::ostringstream oss;
+        oss << std::fixed << std::setprecision(3);
+        oss << "{\"bytes_read\":" << bytes_read << ",\"lines\":" << lines << ",\"samples\":" << samples
+            << ",\"unique_stacks\":" << unique_stacks << ",\"distinct_frames\":" << distinct_frames
+            << ",\"demangled_symbols\":" << demangled_symbols << ",\"jit_frames\":" << jit_frames
+            << ",\"elf_frames\":" << elf_frames
+            << ",\"tree_nodes\":" << tree_nodes << ",\"max_depth\":" << max_depth
+            << ",\"pruned_nodes\":" << pruned_nodes << ",\"bytes_written\":" << bytes_written
+            << ",\"peak_arena_bytes\":" << peak_arena_bytes << ",\"stages\":{";
+        const std::pair<const char*, const StageTime*> stages[] = {
+            {"parse", &parse}, {"collapse", &collapse}, {"build", &build}, {"render", &render}, {"total", &total}};
+        bool first = true;
+        for (const auto& [name, time] : stages) {
+            oss << (first ? "" : ",") << "\"" << name << "\":{\"wall_ms\":" << time->wall_ms
+                << ",\"cpu_ms\":" << time->cpu_ms << "}";
+            first = false;
+        }
+        oss << "},\"memory\":{";
+        const std::pair<const char*, const AllocationStats*> subsystems[] = {
+            {"samples", &memory.samples}, {"frames", &memory.frames}, {"collapse", &memory.collapse}, {"tree", &memory.tree}};
+        first = true;
+        for (const auto& [name, alloc] : subsystems) {
+            oss << (first ? "" : ",") << "\"" << name << "\":" << allocation_json(*alloc);
+            first = false;
+        }
+        oss << "}";
+        if (diagnostics.enabled) {
+            oss << ",\"diagnostics\":{\"collapse_table\":" << hash_table_json(diagnostics.collapse_table)
+                << ",\"children_tables\":" << hash_table_json(diagnostics.children_tables)
+                << ",\"tree\":" << tree_json(diagnostics.tree) << "}";
+        }
+        if (plan.enabled) {
+            oss << ",\"plan\":{\"strategy\":" << json_string(plan.strategy) << ",\"threads\":" << plan.threads
+                << ",\"chunk_count\":" << plan.chunk_count << ",\"chunk_bytes\":" << plan.chunk_bytes
+                << ",\"estimated_samples\":" << plan.estimated_samples
+                << ",\"estimated_unique_stacks\":" << plan.estimated_unique_stacks << ",\"presize\":" << plan.presize
+                << ",\"reason\":" << json_string(plan.reason) << "}";
+        }
+        oss << "}";
+        return oss.str();
+    }
+
+    static std::string json_string(std::string_view text) {
+        std::ostringstream oss;
+        oss << '"';
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                oss << '\\' << c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                oss << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+            } else {
+                oss << c;
+            }
+        }
+        oss << '"';
+        return oss.str();
+    }
+
+    static std::string histogram_json(const std::vector<size_t>& histogram) {
+        std::ostringstream oss;
+        oss << "[";
+        for (size_t i = 0; i < histogram.size(); ++i) {
+            oss << (i ? "," : "") << histogram[i];
+        }
+        oss << "]";
+        return oss.str();
+    }
+
+    static std::string hash_table_json(const HashTableHealth& health) {
+        std::ostringstream oss;
+        oss << std::fixed << std::setprecision(3);
+        oss << "{\"tables\":" << health.tables << ",\"elements\":" << health.elements
+            << ",\"buckets\":" << health.buckets << ",\"load_factor\":" << health.load_factor()
+            << ",\"max_chain\":" << health.max_chain << ",\"rehashes\":" << health.rehashes
+            << ",\"chain_histogram\":" << histogram_json(health.chain_histogram) << "}";
+        return oss.str();
+    }
+
+    static std::string tree_json(const TreeStats& tree) {
+        std::ostringstream oss;
+        oss << std::fixed << std::setprecision(3);
+        double single_child_fraction =
+            tree.total_nodes == 0 ? 0 : static_cast<double>(tree.single_child_nodes) / static_cast<double>(tree.total_nodes);
+        oss << "{\"nodes\":" << tree.total_nodes << ",\"leaves\":" << tree.leaf_nodes
+            << ",\"max_depth\":" << tree.max_depth << ",\"single_child_nodes\":" << tree.single_child_nodes
+            << ",\"single_child_fraction\":" << single_child_fraction
+            << ",\"max_single_child_chain\":" << tree.max_single_child_chain << ",\"max_fanout\":" << tree.max_fanout
+            << ",\"fanout_histogram\":" << histogram_json(tree.fanout_histogram)
+            << ",\"depth_distribution\":" << histogram_json(tree.depth_distribution) << "}";
+        return oss.str();
+    }
+
+    static std::string allocation_json(const AllocationStats& alloc) {
+        std::ostringstream oss;
+        oss << "{\"allocations\":" << alloc.allocations << ",\"bytes_requested\":" << alloc.bytes_requested
+            << ",\"bytes_released\":" << alloc.bytes_released << ",\"bytes_reserved\":" << alloc.bytes_reserved
+            << ",\"high_water\":" << alloc.high_water << "}";
+        return oss.str();
+    }
+};
+
+// path 为 "-" 时写到标准输出
+inline void write_stats_json(const RunStats& stats, const std::string& path) {
+    if (path == "-") {
+        std::cout << stats.to_json() << std::endl;
+        return;
+    }
+    std::ofstream ofs(path);
+    if (! ofs.is_open()) {
+        throw OpenFileException(path);
+    }
+    ofs << stats.to_json() << '\n';
+}
+
+// 文件不存在或无法访问时为 0
+inline size_t file_size_or_zero(const std::string& path) {
+    std::error_code ec;
+    auto size = std::filesystem::file_size(path, ec);
+    return ec ? 0 : static_cast<size_t>(size);
+}
+
+// 🔥 ===== 进度与取消 =====
+
+// 可以从任意线程调用 cancel(), 正在运行的生成在下一个检查点抛出 CancelledException
+class CancellationToken {
+  private:
+    std::atomic<bool> cancelled_{false};
+
+  public:
+    void cancel() {
+        cancelled_.store(true, std::memory_order_relaxed);
+    }
+
+    // 复用同一个 token 开始新的生成前调用
+    void reset() {
+        cancelled_.store(false, std::memory_order_relaxed);
+    }
+
+    bool cancelled() const {
+        return cancelled_.load(std::memory_order_relaxed);
+    }
+};
+
+// stage 为阶段名（parse, collapse, build, render 等）, fraction 为该阶段的完成比例 [0, 1]
+using ProgressCallback = std::function<void(std::string_view stage, double fraction)>;
+
+/**
+ * @brief 一次生成的进度汇报与取消检查
+ *
+ * 生成器在每个阶段开始时 begin(stage, total), 各循环按工作量 tick()/advance(), 阶段结束时 finish()
+ * 工作量的单位由阶段决定: 解析为字节, 折叠为样本, 建树为堆栈, 渲染为已覆盖的样本数
+ * tick() 先在线程本地累计, 每 TICKS_PER_FLUSH 次才汇总到共享计数并检查取消, 热循环里也可以每次调用
+ * 回调可能在工作线程上执行, 但同一时刻只有一个; 同一阶段内汇报的比例单调不减, 大约每 1% 一次
+ */
+class ProgressReporter {
+  public:
+    static constexpr size_t TICKS_PER_FLUSH = 1024;
+    static constexpr size_t REPORT_STEPS = 100;
+
+  private:
+    ProgressCallback callback_;
+    const CancellationToken* token_;
+    std::mutex mutex_;
+    const char* stage_ = "";
+    size_t total_ = 1;
+    std::atomic<uint64_t> stage_id_{0};
+    std::atomic<size_t> done_{0};
+    std::atomic<size_t> next_report_{0};
+
+    // 线程本地的未汇总工作量, 阶段变化后作废
+    struct Pending {
+        uint64_t stage_id = 0;
+        size_t amount = 0;
+        size_t ticks = 0;
+    };
+
+    static uint64_t next_stage_id() {
+        static std::atomic<uint64_t> counter{0};
+        return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+  public:
+    // callback 与 token 都可以为空
+    ProgressReporter(ProgressCallback callback, const CancellationToken* token)
+        : callback_(std::move(callback)), token_(token) {}
+
+    // 须在没有其它线程汇报时调用
+    void begin(const char* stage, size_t total) {
+        check_cancelled();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stage_ = stage;
+            total_ = std::max<size_t>(1, total);
+            done_.store(0, std::memory_order_relaxed);
+            next_report_.store(0, std::memory_order_relaxed);
+            stage_id_.store(next_stage_id(), std::memory_order_relaxed);
+        }
+        report(0);
+    }
+
+    void finish() {
+        report(total_);
+    }
+
+    // 直接把 amount 计入共享计数, 适合按分块汇报的调用方
+    void advance(size_t amount) {
+        check_cancelled();
+        size_t done = done_.fetch_add(amount, std::memory_order_relaxed) + amount;
+        if (done >= next_report_.load(std::memory_order_relaxed)) {
+            report(done);
+        }
+    }
+
+    void tick(size_t amount = 1) {
+        thread_local Pending pending;
+        uint64_t stage_id = stage_id_.load(std::memory_order_relaxed);
+        if (pending.stage_id != stage_id) {
+            pending = Pending{stage_id, 0, 0};
+        }
+        pending.amount += amount;
+        if (++pending.ticks == TICKS_PER_FLUSH) {
+            size_t flushed = pending.amount;
+            pending.amount = 0;
+            pending.ticks = 0;
+            advance(flushed);
+        }
+    }
+
+    void check_cancelled() const {
+        if (token_ != nullptr && token_->cancelled()) {
+            throw CancelledException();
+        }
+    }
+
+  private:
+    void report(size_t done) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // 其它线程已经汇报过更新的进度
+        if (done < next_report_.load(std::memory_order_relaxed)) {
+            return;
+        }
+        next_report_.store(done + std::max<size_t>(1, total_ / REPORT_STEPS), std::memory_order_relaxed);
+        if (callback_) {
+            callback_(stage_, std::min(1.0, static_cast<double>(done) / static_cast<double>(total_)));
+        }
+    }
+};
+
+inline void progress_tick(ProgressReporter* progress, size_t amount = 1) {
+    if (progress != nullptr) {
+        progress->tick(amount);
+    }
+}
+
+inline void check_cancelled(const ProgressReporter* progress) {
+    if (progress != nullptr) {
+        progress->check_cancelled();
+    }
+}
+
+/**
+ * @brief 帧注解, 对应 stackcollapse-perf.pl 的 --kernel/--jit/--addrs/--pid/--tid
+ *
+ * 只是 Frame 上的标志位, name 仍是输入中的原文, 输出时由 operator<< 拼出注解, 解析时不为帧构造新字符串;
+ * 标志位参与比较与哈希, 因此注解不同的同名帧不会合并
+ */
+enum FrameAnnotation : uint8_t {
+    ANNOTATE_KERNEL = 1 << 0,  // 后缀 _[k]
+    ANNOTATE_JIT = 1 << 1,     // 后缀 _[j]
+    ANNOTATE_ADDRESS = 1 << 2, // name 为 "地址 [unknown] (库" 的整段原文, 输出 [库 <地址>]
+    ANNOTATE_PROCESS = 1 << 3, // 根帧, name 为进程名, 空格输出为 _
+    ANNOTATE_PID = 1 << 4,     // 根帧, name 为 "进程名 pid", 输出 进程名-pid
+    ANNOTATE_TID = 1 << 5,     // 根帧, name 为 "进程名 pid/tid", 输出 进程名-pid/tid
+    ANNOTATE_NO_PID = 1 << 6,  // 根帧, 头部只有 tid: name 不含 pid（ANNOTATE_PID）或只含 tid（ANNOTATE_TID）, pid 输出为 ?
 };
 
 struct Frame {
     std::string_view name; // 底层零拷贝视图
     bool is_func;
     bool lib_include_brackets;           // 是否已经加了 [xxx]
+    uint8_t annotations = 0;             // FrameAnnotation 的组合, 放在对齐空隙中, 不增加 Frame 的大小
     mutable size_t precomputed_hash = 0; // 预先算好 hash
 
     // 可扩展字段: pid, 线程id, 采样率等
@@ -362,18 +1385,22 @@ struct Frame {
         if (is_func != other.is_func) {
             return is_func < other.is_func;
         }
-        // 最后比较 lib_include_brackets
-        return lib_include_brackets < other.lib_include_brackets;
+        // 再比较 lib_include_brackets
+        if (lib_include_brackets != other.lib_include_brackets) {
+            return lib_include_brackets < other.lib_include_brackets;
+        }
+        return annotations < other.annotations;
     }
 
     bool operator==(const Frame& other) const noexcept {
-        return is_func == other.is_func && lib_include_brackets == other.lib_include_brackets && name == other.name;
+        return is_func == other.is_func && lib_include_brackets == other.lib_include_brackets &&
+               annotations == other.annotations && name == other.name;
     }
 
     Frame() : Frame("") {}
 
-    explicit Frame(std::string_view name, bool is_func = true, bool lib_include_brackets = false)
-        : name(name), is_func(is_func), lib_include_brackets(lib_include_brackets) {}
+    explicit Frame(std::string_view name, bool is_func = true, bool lib_include_brackets = false, uint8_t annotations = 0)
+        : name(name), is_func(is_func), lib_include_brackets(lib_include_brackets), annotations(annotations) {}
 
     size_t computed_hash() const noexcept {
         if (precomputed_hash == 0) {
@@ -382,6 +1409,9 @@ struct Frame {
             size_t h3 = std::hash<bool>{}(lib_include_brackets);
             size_t combined = h1 ^ (h2 + 0x9e3779b9 + (h1 << 6) + (h1 >> 2));
             combined ^= h3 + 0x9e3779b9 + (combined << 6) + (combined >> 2);
+            if (annotations != 0) {
+                combined ^= annotations + 0x9e3779b9 + (combined << 6) + (combined >> 2);
+            }
             precomputed_hash = combined;
         }
 
@@ -393,15 +1423,61 @@ struct Frame {
     }
 
     friend inline std::ostream& operator<<(std::ostream& os, const Frame& f) {
-        if (! f.is_func && ! f.lib_include_brackets) {
-            os << "[";
+        if (f.annotations & ANNOTATE_PROCESS) {
+            write_process(os, f);
+        } else if (f.annotations & ANNOTATE_ADDRESS) {
+            write_address(os, f.name);
+        } else {
+            if (! f.is_func && ! f.lib_include_brackets) {
+                os << "[";
+            }
+            os << (f.name.empty() ? "root" : f.name);
+            if (! f.is_func && ! f.lib_include_brackets) {
+                os << "]";
+            }
         }
-        os << (f.name.empty() ? "root" : f.name);
-        if (! f.is_func && ! f.lib_include_brackets) {
-            os << "]";
+        if (f.annotations & ANNOTATE_KERNEL) {
+            os << "_[k]";
+        } else if (f.annotations & ANNOTATE_JIT) {
+            os << "_[j]";
         }
         return os;
     }
+
+  private:
+    // "comm 123/456" → comm-123/456; 只有 tid 时 pid 为 ?
+    static void write_process(std::ostream& os, const Frame& f) {
+        std::string_view comm = f.name;
+        std::string_view ids;
+        bool has_ids = (f.annotations & ANNOTATE_TID) || ((f.annotations & ANNOTATE_PID) && ! (f.annotations & ANNOTATE_NO_PID));
+        if (has_ids) {
+            size_t space = comm.find_last_of(" \t");
+            if (space != std::string_view::npos) {
+                ids = comm.substr(space + 1);
+                comm = comm.substr(0, comm.find_last_not_of(" \t", space) + 1);
+            }
+        }
+        for (char c : comm) {
+            os << (c == ' ' ? '_' : c);
+        }
+        if (f.annotations & (ANNOTATE_PID | ANNOTATE_TID)) {
+            os << '-';
+            if (f.annotations & ANNOTATE_NO_PID) {
+                os << ((f.annotations & ANNOTATE_TID) ? "?/" : "?");
+            }
+            os << ids;
+        }
+    }
+
+    // "7f26cab4c0b0 [unknown] (/usr/lib/libfoo.so" → [libfoo.so <7f26cab4c0b0>]
+    static void write_address(std::ostream& os, std::string_view raw) {
+        std::string_view address = raw.substr(0, raw.find(' '));
+        std::string_view lib = raw.substr(raw.find_last_of("/(") + 1);
+        if (lib == "[unknown]") { // 与 stackcollapse-perf.pl 一致, 其余 [xxx] 原样保留
+            lib = "unknown";
+        }
+        os << '[' << lib << " <" << address << ">]";
+    }
 };
 
 struct FlameNode {
@@ -430,9 +1506,15 @@ struct FlameNode {
     FlameNode* parent = nullptr; // 父节点指针
     int height = 1;              // 默认自己在 1 层
 
-    explicit FlameNode() : frame(nullptr), children(&pool) {}
+    explicit FlameNode(std::pmr::memory_resource* resource) : frame(nullptr), children(resource) {}
 
-    explicit FlameNode(const Frame* frame) : frame(frame), children(&pool) {}
+    FlameNode(const Frame* frame, std::pmr::memory_resource* resource) : frame(frame), children(resource) {}
+
+    // 节点本身和它的 children 都从 resource 分配, 随 arena 整体释放, 不单独析构
+    static FlameNode* create(std::pmr::memory_resource* resource, const Frame* frame = nullptr) {
+        void* mem = resource->allocate(sizeof(FlameNode), alignof(FlameNode));
+        return new (mem) FlameNode(frame, resource);
+    }
 
     // 禁用拷贝/移动构造函数
     FlameNode(FlameNode&& other) noexcept = delete;
@@ -440,7 +1522,7 @@ struct FlameNode {
     FlameNode(const FlameNode&) = delete;
     FlameNode& operator=(const FlameNode&) = delete;
 
-    // 不再有递归析构器, 仅仅析构 children 本身, 析构 FlameNode* 时需要手动调用 destroy_tree
+    // 不再有递归析构器, 整棵树的内存随 arena 释放
     ~FlameNode() = default;
 
     FlameNode* get_or_create_child(const Frame* child_frame) {
@@ -449,8 +1531,8 @@ struct FlameNode {
             return it->second;
         }
 
-        // 尚不存在
-        FlameNode* new_node = new FlameNode(child_frame);
+        // 尚不存在, 子节点沿用父节点的内存资源
+        FlameNode* new_node = create(children.get_allocator().resource(), child_frame);
         new_node->parent = this;          // 设置父指针
         children[child_frame] = new_node; // 现在当前节点多了一个子节点了
 
@@ -493,30 +1575,68 @@ struct FlameNode {
         return std::min(1.0, static_cast<double>(total_count) / static_cast<double>(parent->total_count));
     }
 
-    // 修剪树节点 - 移除小于阈值的节点
-    void prune_tree(double threshold) {
-        if (total_count == 0) return;
+    // 修剪树节点 - 移除小于阈值的节点, 返回被移除的节点数（含子孙）
+    size_t prune_tree(double threshold) {
+        if (total_count == 0) return 0;
 
+        size_t removed = 0;
         auto it = children.begin();
         while (it != children.end()) {
             double ratio = static_cast<double>(it->second->total_count) / static_cast<double>(total_count);
             if (ratio < threshold) {
+                removed += it->second->subtree_size();
                 auto next_it = std::next(it);
                 children.erase(it);
                 it = next_it;
             } else {
-                it->second->prune_tree(threshold);
+                removed += it->second->prune_tree(threshold);
                 ++it;
             }
         }
+        return removed;
+    }
+
+    size_t subtree_size() const {
+        size_t size = 1;
+        for (const auto& [frame, child] : children) {
+            size += child->subtree_size();
+        }
+        return size;
+    }
+
+    // 按 Frame 排序的子节点, 使输出顺序与哈希表的插入历史无关
+    std::vector<std::pair<const Frame*, const FlameNode*>> sorted_children() const {
+        std::vector<std::pair<const Frame*, const FlameNode*>> sorted(children.begin(), children.end());
+        std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+            return FramePtrLess{}(a.first, b.first);
+        });
+        return sorted;
     }
 
     TreeStats analyze_tree() {
         TreeStats stats;
-        analyze_node_recursive(stats, 0);
+        std::unordered_set<const Frame*, FramePtrHasher, FramePtrEqual> frames;
+        analyze_node_recursive(stats, frames, 0, 0);
+        stats.distinct_frames = frames.size();
         return stats;
     }
 
+    // 整棵树中非空 children 表的健康度; 叶子的空表不计入
+    HashTableHealth children_health() const {
+        HashTableHealth health;
+        std::vector<const FlameNode*> stack{this};
+        while (! stack.empty()) {
+            const FlameNode* node = stack.back();
+            stack.pop_back();
+            if (node->children.empty()) continue;
+            health.add_table(node->children);
+            for (const auto& [frame, child] : node->children) {
+                stack.push_back(child);
+            }
+        }
+        return health;
+    }
+
     std::string to_json_string() const {
         std::ostringstream oss;
         oss << "{";
@@ -532,7 +1652,7 @@ struct FlameNode {
         if (! children.empty()) {
             oss << ",\"children\":[";
             bool first = true;
-            for (const auto& [name, child] : children) {
+            for (const auto& [name, child] : sorted_children()) {
                 if (! first) oss << ",";
                 oss << child->to_json_string();
                 first = false;
@@ -545,8 +1665,15 @@ struct FlameNode {
     }
 
   private:
-    void analyze_node_recursive(TreeStats& stats, int depth) {
+    // chain 为到本节点为止连续单子节点的个数
+    void analyze_node_recursive(TreeStats& stats,
+                                std::unordered_set<const Frame*, FramePtrHasher, FramePtrEqual>& frames,
+                                int depth,
+                                size_t chain) {
         stats.total_nodes++;
+        if (frame != nullptr) {
+            frames.insert(frame);
+        }
         stats.total_samples += self_count;
         stats.max_depth = std::max(stats.max_depth, depth);
 
@@ -556,41 +1683,35 @@ struct FlameNode {
         }
         stats.depth_distribution[depth]++;
 
+        size_t fanout = children.size();
+        size_t bucket = TreeStats::fanout_bucket(fanout);
+        if (bucket >= stats.fanout_histogram.size()) {
+            stats.fanout_histogram.resize(bucket + 1, 0);
+        }
+        stats.fanout_histogram[bucket]++;
+        stats.max_fanout = std::max(stats.max_fanout, fanout);
+        if (fanout == 1) {
+            stats.single_child_nodes++;
+            stats.max_single_child_chain = std::max(stats.max_single_child_chain, ++chain);
+        } else {
+            chain = 0;
+        }
+
         if (children.empty()) {
             stats.leaf_nodes++;
         } else {
             for (const auto& [name, child] : children) {
-                child->analyze_node_recursive(stats, depth + 1);
+                child->analyze_node_recursive(stats, frames, depth + 1, chain);
             }
         }
     }
 };
 
+// 树的根; 节点内存归 arena 所有, 这里不负责释放
 struct FlameNodeRoot {
     FlameNode* node;
 
     FlameNodeRoot(FlameNode* node) : node(node) {}
-
-    ~FlameNodeRoot() {
-        // 选择 stack 而不是 queue, DFS 而非 BFS
-        // DFS（stack）峰值为 “树的最大深度”
-        // BFS（queue）峰值为 “树的最大宽度”
-        // 火焰图一般不是很深, 但是非常宽, BFS 会占用大量内存
-        // 而且相邻访问的节点在内存中更可能相近（父子节点通常在相近时间创建）, 缓存更好
-        std::vector<FlameNode*> stk;
-        stk.reserve(128); // 根据实际最大深度估一估
-        stk.push_back(node);
-
-        while (! stk.empty()) {
-            FlameNode* curr = stk.back();
-            stk.pop_back();
-
-            for (auto& [_, child] : curr->children) {
-                if (child) stk.push_back(child);
-            }
-            delete curr;
-        }
-    }
 };
 
 struct FlameGraphConfig {
@@ -663,17 +1784,46 @@ struct FlameGraphConfig {
 
 class StackSamplesContext {
   private:
+    // 使用方 -> *_counter（计数）-> *_mono -> *_upstream（计数, 即 monotonic 预留的字节）-> upstream
+    CountingResource samples_upstream;
+    CountingResource frames_upstream;
     std::pmr::monotonic_buffer_resource samples_mono;
     std::pmr::monotonic_buffer_resource frames_mono;
+    CountingResource samples_counter;
+    CountingResource frames_counter;
 
   public:
+    explicit StackSamplesContext(std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+        : samples_upstream(upstream),
+          frames_upstream(upstream),
+          samples_mono(&samples_upstream),
+          frames_mono(&frames_upstream),
+          samples_counter(&samples_mono),
+          frames_counter(&frames_mono) {}
+
+    AllocationStats samples_allocations() const {
+        AllocationStats stats = samples_counter.stats();
+        stats.bytes_reserved = samples_upstream.stats().bytes_requested;
+        return stats;
+    }
+
+    AllocationStats frames_allocations() const {
+        AllocationStats stats = frames_counter.stats();
+        stats.bytes_reserved = frames_upstream.stats().bytes_requested;
+        return stats;
+    }
+
     struct StackSample {
         std::pmr::vector<Frame> frames;
         size_t count = 1;
         std::string_view process_name;
+        std::string_view id_token; // 头部 "pid/tid" 或 "tid" 的原文, 根帧注解使用
         uint64_t timestamp = 0;
+        uint32_t pid = 0;
+        uint32_t tid = 0;
+        int32_t cpu = -1; // -1 表示输入中没有 [cpu] 字段
 
-        StackSample(std::pmr::monotonic_buffer_resource& mono) : frames(&mono) {
+        StackSample(std::pmr::memory_resource& resource) : frames(&resource) {
             frames.reserve(16);
         }
 
@@ -684,8 +1834,9 @@ class StackSamplesContext {
 
     struct StackSamples {
         std::pmr::vector<StackSample> raw_samples;
+        size_t line_count = 0; // 解析过的输入行数
 
-        StackSamples(std::pmr::monotonic_buffer_resource& mono) : raw_samples(&mono) {}
+        StackSamples(std::pmr::memory_resource& resource) : raw_samples(&resource) {}
 
         bool empty() const {
             return raw_samples.empty();
@@ -704,17 +1855,189 @@ class StackSamplesContext {
 
     // 创建 StackSamples
     StackSamples create_samples() {
-        return StackSamples(this->samples_mono);
+        return StackSamples(this->samples_counter);
     }
 
     StackSample create_sample() {
-        return StackSample(this->frames_mono);
+        return StackSample(this->frames_counter);
     }
 }; // 析构时自动释放所有内存
 
 using StackSamples = StackSamplesContext::StackSamples;
 using StackSample = StackSamplesContext::StackSample;
 
+// 🔥 ===== 函数名整理 =====
+
+// 根帧, 对应 stackcollapse-perf.pl 的默认输出与 --pid/--tid
+enum class ProcessFrame {
+    None, // 不加根帧（默认）
+    Comm, // 进程名
+    Pid,  // 进程名-pid
+    Tid,  // 进程名-pid/tid
+};
+
+// 解析选项, 由生成器传给各个解析器
+struct ParseOptions {
+    bool strip_args = false;     // 去掉 C++ 参数列表及其后的部分: foo(int) const → foo, 闭包归入外层函数
+    bool strip_generics = false; // 去掉模板参数: std::vector<int>::push_back → std::vector::push_back
+    // 非空时用 perf-<pid>.map 还原 [unknown] 的 JIT 帧; 名字引用 resolver 中的内容, 由各解析器共同持有
+    std::shared_ptr<PerfMapResolver> perf_maps;
+    // 非空时从本地的 ELF 文件还原 [unknown] 的原生帧, 每次 parse_into 结束时批量查找
+    std::shared_ptr<ElfSymbolResolver> elf_symbols;
+    // 帧注解, 见 FrameAnnotation
+    ProcessFrame process_frame = ProcessFrame::None;
+    bool annotate_kernel = false; // 内核帧加 _[k]
+    bool annotate_jit = false;    // JIT 帧（perf-<pid>.map）加 _[j]
+    bool annotate_addrs = false;  // 没有符号的帧带上地址: [库 <地址>]
+
+    // 累计从 perf map 还原的帧数, 生成器取前后之差记入 RunStats::jit_frames
+    size_t jit_frames() const {
+        return perf_maps ? perf_maps->resolved_frames() : 0;
+    }
+
+    // 同上, 记入 RunStats::elf_frames
+    size_t elf_frames() const {
+        return elf_symbols ? elf_symbols->resolved_frames() : 0;
+    }
+};
+
+// name[i] 处是 "operator" 时跳过它之后的运算符记号（<<、()、[]、-> 等）, 这些不是括号; 否则返回 i
+inline size_t skip_operator_token(std::string_view name, size_t i) {
+    constexpr std::string_view OPERATOR = "operator";
+    if (name.compare(i, OPERATOR.size(), OPERATOR) != 0 ||
+        (i > 0 && (std::isalnum(static_cast<unsigned char>(name[i - 1])) || name[i - 1] == '_'))) {
+        return i;
+    }
+    size_t j = i + OPERATOR.size();
+    if (name.compare(j, 2, "()") == 0 || name.compare(j, 2, "[]") == 0) {
+        return j + 2;
+    }
+    while (j < name.size() && std::string_view("<>=!+-*/%&|^~,").find(name[j]) != std::string_view::npos) {
+        ++j;
+    }
+    return j;
+}
+
+// 第一个不在 <> 或 {} 之内的参数列表的起点, 没有时返回 npos
+// "(anonymous namespace)" 与 Go 的方法接收者 "pkg.(*T)" 不是参数列表
+inline size_t find_argument_list(std::string_view name) {
+    constexpr std::string_view ANONYMOUS = "(anonymous namespace)";
+    size_t depth = 0;
+    for (size_t i = 0; i < name.size();) {
+        char c = name[i];
+        if (c == 'o') {
+            size_t next = skip_operator_token(name, i);
+            if (next != i) {
+                i = next;
+                continue;
+            }
+        }
+        if (c == '<' || c == '{') {
+            ++depth;
+        } else if ((c == '>' || c == '}') && depth > 0) {
+            --depth;
+        } else if (c == '(') {
+            if (name.compare(i, ANONYMOUS.size(), ANONYMOUS) == 0) {
+                i += ANONYMOUS.size();
+                continue;
+            }
+            if (depth == 0 && i > 0 && name[i - 1] != '.') {
+                return i;
+            }
+        }
+        ++i;
+    }
+    return std::string_view::npos;
+}
+
+// 只缩短 view, 不分配
+inline std::string_view strip_argument_list(std::string_view name) {
+    size_t pos = find_argument_list(name);
+    if (pos == std::string_view::npos) {
+        return name;
+    }
+    std::string_view stripped = name.substr(0, pos);
+    while (! stripped.empty() && stripped.back() == ' ') {
+        stripped.remove_suffix(1);
+    }
+    return stripped.empty() ? name : stripped;
+}
+
+// 模板参数只在末尾时（如去掉参数列表后的 "void foo<int>"）只缩短 view; 中间还有模板参数时原样返回
+inline std::string_view strip_trailing_generic_args(std::string_view name) {
+    if (name.empty() || name.back() != '>') {
+        return name;
+    }
+    size_t depth = 0;
+    size_t open = std::string_view::npos;
+    for (size_t i = 0; i < name.size();) {
+        char c = name[i];
+        if (c == 'o') {
+            size_t next = skip_operator_token(name, i);
+            if (next != i) {
+                i = next;
+                continue;
+            }
+        }
+        if (c == '<') {
+            if (depth++ == 0) {
+                if (open != std::string_view::npos) {
+                    return name; // 前面已经有一组顶层模板参数
+                }
+                open = i;
+            }
+        } else if (c == '>' && depth > 0 && --depth == 0 && i + 1 != name.size()) {
+            return name;
+        }
+        ++i;
+    }
+    if (depth != 0 || open == std::string_view::npos || open == 0) {
+        return name;
+    }
+    std::string_view stripped = name.substr(0, open);
+    while (! stripped.empty() && stripped.back() == ' ') {
+        stripped.remove_suffix(1);
+    }
+    return stripped.empty() ? name : stripped;
+}
+
+// 去掉所有顶层模板参数, 需要拼接, 因此返回新字符串; <> 不配对时原样返回
+inline std::string strip_generic_args(std::string_view name) {
+    std::string out;
+    out.reserve(name.size());
+    size_t depth = 0;
+    for (size_t i = 0; i < name.size();) {
+        char c = name[i];
+        if (c == 'o') {
+            size_t next = skip_operator_token(name, i);
+            if (next != i) {
+                if (depth == 0) {
+                    out += name.substr(i, next - i);
+                }
+                i = next;
+                continue;
+            }
+        }
+        if (c == '<') {
+            // 与 strip_trailing_generic_args 一致, 去掉的一组之前的空格也去掉（"operator<< <char>" -> "operator<<"）
+            if (depth++ == 0) {
+                while (! out.empty() && out.back() == ' ') {
+                    out.pop_back();
+                }
+            }
+        } else if (c == '>' && depth > 0) {
+            --depth;
+        } else if (depth == 0) {
+            out += c;
+        }
+        ++i;
+    }
+    if (depth != 0 || out.empty()) {
+        return std::string(name);
+    }
+    return out;
+}
+
 // 🔥 ===== 解析器基类和实现 =====
 class AbstractStackParser {
   public:
@@ -722,18 +2045,58 @@ class AbstractStackParser {
 
     virtual StackSamples parse(std::string_view buffer, StackSamplesContext& sample_ctx) = 0;
     virtual std::string_view get_parser_name() const = 0;
+
+    // 把 buffer 中的样本追加到 samples, 空结果不抛异常; 分块/并行解析复用此接口
+    virtual void parse_into(std::string_view buffer, StackSamplesContext& sample_ctx, StackSamples& samples) = 0;
+
+    // 返回 pos 之后（含）第一个可以安全切分的位置, 从该位置开始单独解析与整体解析结果一致
+    // 默认以空行作为样本边界
+    virtual size_t next_chunk_boundary(std::string_view buffer, size_t pos) const {
+        if (pos == 0) return 0;
+        // 先对齐到行首, 半行不能用来判断是否为空行
+        if (buffer[pos - 1] != '\n') {
+            size_t end = buffer.find('\n', pos);
+            if (end == std::string_view::npos) return buffer.size();
+            pos = end + 1;
+        }
+        while (pos < buffer.size()) {
+            size_t end = buffer.find('\n', pos);
+            if (end == std::string_view::npos) return buffer.size();
+            bool blank = trim(buffer.substr(pos, end - pos)).empty();
+            pos = end + 1;
+            if (blank) break;
+        }
+        return std::min(pos, buffer.size());
+    }
 };
 
 /**
  * @brief 适配 perf script 收集的堆栈
  */
 class PerfScriptParser : public AbstractStackParser {
+  private:
+    ParseOptions options_;
+
   public:
+    explicit PerfScriptParser(const ParseOptions& options = {}) : options_(options) {}
+
     StackSamples parse(std::string_view buffer, StackSamplesContext& sample_ctx) override {
         StackSamples samples = sample_ctx.create_samples();
+        parse_into(buffer, sample_ctx, samples);
+
+        if (samples.empty()) {
+            throw ParseException("No valid samples found in file");
+        }
+
+        return samples;
+    }
+
+    void parse_into(std::string_view buffer, StackSamplesContext& sample_ctx, StackSamples& samples) override {
         StackSample current_sample = sample_ctx.create_sample();
         bool reading_stack = false;
         LineScanner scanner(buffer);
+        PendingSymbols pending;
+        PendingSymbols* pending_ptr = options_.elf_symbols ? &pending : nullptr;
 
         while (true) {
             std::string_view trimmed_line = scanner.next_trimmed_line();
@@ -741,24 +2104,22 @@ class PerfScriptParser : public AbstractStackParser {
 
             if (trimmed_line.empty()) { // 空行：当前 stack 结束
                 if (reading_stack) {
+                    add_process_frame(current_sample);
                     samples.move_valid_sample(current_sample);
                 }
                 reading_stack = false;
             } else { // 非空行：做解析
-                parse_line(trimmed_line, current_sample, reading_stack);
+                parse_line(trimmed_line, current_sample, reading_stack, pending_ptr, samples.raw_samples.size());
             }
         }
 
         // 文件结束后，最后一个样本（如果有）
         if (reading_stack) {
+            add_process_frame(current_sample);
             samples.move_valid_sample(current_sample);
         }
-
-        if (samples.empty()) {
-            throw ParseException("No valid samples found in file");
-        }
-
-        return samples;
+        samples.line_count += scanner.line_number;
+        resolve_pending(pending, samples);
     }
 
     std::string_view get_parser_name() const override {
@@ -766,15 +2127,29 @@ class PerfScriptParser : public AbstractStackParser {
     }
 
   private:
-    friend class ParallelPerfScriptParser;
+    // 等待 ELF 符号的帧, 一次 parse_into 结束时交给 ElfSymbolResolver 批量查找
+    struct PendingSymbols {
+        std::vector<ElfSymbolResolver::Request> requests;
+        std::vector<std::pair<size_t, size_t>> positions; // (样本下标, 反转前的帧下标)
+    };
 
-    static void parse_line(std::string_view line_view, StackSample& current_sample, bool& reading_stack) {
+    // sample_index 为当前样本入列后的下标
+    void parse_line(std::string_view line_view, StackSample& current_sample, bool& reading_stack,
+                    PendingSymbols* pending, size_t sample_index) const {
+        if (line_view[0] == '#') { // perf script 的文件头注释, 如 "# captured on: ..."
+            return;
+        }
         if (! reading_stack && line_view.find(':') != std::string::npos) {
             parse_sample_header(line_view, current_sample);
             reading_stack = true;
         } else if (reading_stack) {
-            Frame frame = parse_perf_stack_frame(line_view);
+            ElfSymbolResolver::Request request;
+            Frame frame = parse_perf_stack_frame(line_view, current_sample.pid, pending != nullptr ? &request : nullptr);
             if (! frame.empty()) {
+                if (! request.dso.empty()) {
+                    pending->requests.push_back(request);
+                    pending->positions.emplace_back(sample_index, current_sample.frames.size());
+                }
                 current_sample.frames.emplace_back(frame);
             }
         }
@@ -784,8 +2159,52 @@ class PerfScriptParser : public AbstractStackParser {
   private:
     static void parse_sample_header(std::string_view line_view, StackSample& sample) {
         // 尝试提取时间戳和其他元数据
-        sample.process_name = extract_process_name(line_view);
         sample.timestamp = extract_timestamp(line_view);
+        sample.id_token = {};
+        sample.pid = 0;
+        sample.tid = 0;
+        sample.cpu = -1;
+
+        // i.e. "iperf 27409/28744 [000] 441995.133575: cpu-clock:"
+        // comm 中可能有空格, 以 comm 之后第一个形如 pid 或 pid/tid 的字段为准
+        size_t pos = line_view.find_first_of(" \t");
+        while (pos != std::string_view::npos) {
+            size_t begin = line_view.find_first_not_of(" \t", pos);
+            if (begin == std::string_view::npos) break;
+            size_t end = std::min(line_view.find_first_of(" \t", begin), line_view.size());
+
+            if (parse_pid_tid(line_view.substr(begin, end - begin), sample.pid, sample.tid)) {
+                sample.process_name = trim(line_view.substr(0, pos));
+                sample.id_token = line_view.substr(begin, end - begin);
+                size_t cpu_begin = line_view.find_first_not_of(" \t", end);
+                if (cpu_begin != std::string_view::npos && line_view[cpu_begin] == '[') {
+                    uint32_t cpu = 0;
+                    auto [ptr, ec] = std::from_chars(line_view.data() + cpu_begin + 1, line_view.data() + line_view.size(), cpu);
+                    if (ec == std::errc{} && ptr < line_view.data() + line_view.size() && *ptr == ']') {
+                        sample.cpu = static_cast<int32_t>(cpu);
+                    }
+                }
+                return;
+            }
+            pos = end;
+        }
+
+        sample.process_name = extract_process_name(line_view);
+    }
+
+    // "pid" 或 "pid/tid", 没有 tid 时 tid 与 pid 相同
+    static bool parse_pid_tid(std::string_view token, uint32_t& pid, uint32_t& tid) {
+        const char* first = token.data();
+        const char* last = token.data() + token.size();
+        auto [pid_end, pid_ec] = std::from_chars(first, last, pid);
+        if (pid_ec != std::errc{}) return false;
+        if (pid_end == last) {
+            tid = pid;
+            return true;
+        }
+        if (*pid_end != '/') return false;
+        auto [tid_end, tid_ec] = std::from_chars(pid_end + 1, last, tid);
+        return tid_ec == std::errc{} && tid_end == last;
     }
 
     static std::string_view extract_process_name(std::string_view line_view) {
@@ -812,7 +2231,8 @@ class PerfScriptParser : public AbstractStackParser {
         return static_cast<uint64_t>(timestamp * 1000000);
     }
 
-    static Frame parse_perf_stack_frame(std::string_view line) {
+    // request 非空时, 没有符号的原生帧把 dso 与地址填进去, 留给批量查找
+    Frame parse_perf_stack_frame(std::string_view line, uint32_t pid, ElfSymbolResolver::Request* request) const {
         // i.e. "7f0b8bf5766d malloc+0x5d (/usr/lib/libc.so.6)"
         size_t first_space = line.find(' '); // 跳过 address
         if (first_space == std::string::npos) return Frame{};
@@ -832,31 +2252,175 @@ class PerfScriptParser : public AbstractStackParser {
             func_name = content;
         }
 
-        if (func_name != "[unknown]") {
-            size_t plus_pos = func_name.find('+');
-            if (plus_pos != std::string::npos) {
-                func_name = func_name.substr(0, plus_pos);
-            }
+        if (func_name != "[unknown]") {
+            size_t plus_pos = func_name.find('+');
+            if (plus_pos != std::string::npos) {
+                func_name = func_name.substr(0, plus_pos);
+            }
+        }
+
+        // perf script -F +dsoff 在 dso 后面附上文件偏移: "(/usr/lib/libc.so.6+0x8ccb0)"
+        uint64_t dso_offset = 0;
+        bool has_dso_offset = false;
+        if (size_t plus = lib_name.rfind("+0x"); plus != std::string_view::npos) {
+            std::string_view hex = lib_name.substr(plus + 3);
+            auto [ptr, ec] = std::from_chars(hex.data(), hex.data() + hex.size(), dso_offset, 16);
+            if (ec == std::errc() && ptr == hex.data() + hex.size()) {
+                has_dso_offset = true;
+                lib_name = lib_name.substr(0, plus);
+            }
+        }
+        std::string_view lib_path = lib_name;
+        uint8_t annotations = annotate(lib_path);
+
+        if (! lib_name.empty()) {
+            size_t last_slash = lib_name.find_last_of('/');
+            if (last_slash != std::string::npos) {
+                lib_name = lib_name.substr(last_slash + 1);
+            }
+
+            // 如果已经是 [xxx]，就不再加括号
+            if (lib_name.front() == '[' && lib_name.back() == ']') {
+                lib_include_brackets = true;
+            }
+        }
+
+        if (! func_name.empty() && func_name != "[unknown]") {
+            return Frame(tidy(func_name), true, false, annotations);
+        } else if (std::string_view jit_name = resolve_jit(line.substr(0, first_space), lib_name, pid);
+                   ! jit_name.empty()) {
+            return Frame(tidy(jit_name), true, false, annotations);
+        } else {
+            if (request != nullptr && lib_path.size() > 1 && lib_path.front() == '/') {
+                uint64_t addr = dso_offset;
+                std::string_view address = line.substr(0, first_space);
+                auto [ptr, ec] = std::from_chars(address.data(), address.data() + address.size(), addr, 16);
+                if (has_dso_offset || (ec == std::errc() && ptr == address.data() + address.size())) {
+                    request->dso = lib_path;
+                    request->address = has_dso_offset ? dso_offset : addr;
+                    request->is_offset = has_dso_offset;
+                }
+            }
+            // 如果没有 func_name 则使用 lib 替代; 带地址时 name 取从地址到库名的整段原文, 由 operator<< 拼出
+            if (options_.annotate_addrs && ! lib_name.empty()) {
+                std::string_view raw(line.data(), static_cast<size_t>(lib_path.data() + lib_path.size() - line.data()));
+                return Frame{raw, false, false, static_cast<uint8_t>(annotations | ANNOTATE_ADDRESS)};
+            }
+            return Frame{lib_name, false, lib_include_brackets, annotations};
+        }
+    }
+
+    // 找到符号的帧原地换成函数帧; 样本已在入列时反转, 帧下标随之换算
+    void resolve_pending(PendingSymbols& pending, StackSamples& samples) const {
+        if (pending.requests.empty()) {
+            return;
+        }
+        options_.elf_symbols->resolve(pending.requests);
+        for (size_t i = 0; i < pending.requests.size(); ++i) {
+            std::string_view name = pending.requests[i].name;
+            auto [sample, frame] = pending.positions[i];
+            if (name.empty() || sample >= samples.raw_samples.size()) {
+                continue;
+            }
+            auto& frames = samples.raw_samples[sample].frames;
+            if (frame < frames.size()) {
+                Frame& resolved = frames[frames.size() - 1 - frame];
+                resolved = Frame(tidy(name), true, false, static_cast<uint8_t>(resolved.annotations & (ANNOTATE_KERNEL | ANNOTATE_JIT)));
+            }
+        }
+    }
+
+    static bool is_perf_map(std::string_view lib_path) {
+        constexpr std::string_view PREFIX = "perf-";
+        constexpr std::string_view SUFFIX = ".map";
+        std::string_view lib_name = lib_path.substr(lib_path.find_last_of('/') + 1);
+        if (lib_name.size() <= PREFIX.size() + SUFFIX.size() || lib_name.substr(0, PREFIX.size()) != PREFIX ||
+            lib_name.substr(lib_name.size() - SUFFIX.size()) != SUFFIX) {
+            return false;
+        }
+        std::string_view digits = lib_name.substr(PREFIX.size(), lib_name.size() - PREFIX.size() - SUFFIX.size());
+        return std::all_of(digits.begin(), digits.end(), [](char c) { return c >= '0' && c <= '9'; });
+    }
+
+    // 与 stackcollapse-perf.pl 相同: 模块形如 [xxx] 或 vmlinux 的是内核帧（[unknown] 除外）, perf-<pid>.map 中的是 JIT 帧
+    uint8_t annotate(std::string_view lib_path) const {
+        constexpr std::string_view VMLINUX = "vmlinux";
+        if (options_.annotate_kernel && ! lib_path.empty() &&
+            (lib_path.front() == '[' ||
+             (lib_path.size() >= VMLINUX.size() && lib_path.substr(lib_path.size() - VMLINUX.size()) == VMLINUX)) &&
+            lib_path.find("unknown") == std::string_view::npos) {
+            return ANNOTATE_KERNEL;
+        }
+        if (options_.annotate_jit && is_perf_map(lib_path)) {
+            return ANNOTATE_JIT;
+        }
+        return 0;
+    }
+
+    // 样本结束时在末尾（反转后即根部）加进程根帧; name 取头部原文, 由 operator<< 拼出 comm-pid/tid
+    void add_process_frame(StackSample& sample) const {
+        if (options_.process_frame == ProcessFrame::None || sample.frames.empty()) {
+            return;
         }
-
-        if (! lib_name.empty()) {
-            size_t last_slash = lib_name.find_last_of('/');
-            if (last_slash != std::string::npos) {
-                lib_name = lib_name.substr(last_slash + 1);
+        std::string_view comm = sample.process_name;
+        std::string_view ids = sample.id_token;
+        uint8_t annotations = ANNOTATE_PROCESS;
+        if (options_.process_frame == ProcessFrame::Comm || ids.empty() || comm.empty()) {
+            sample.frames.emplace_back(comm, true, false, annotations);
+            return;
+        }
+        size_t slash = ids.find('/');
+        if (options_.process_frame == ProcessFrame::Pid) {
+            annotations |= ANNOTATE_PID;
+            if (slash == std::string_view::npos) {
+                sample.frames.emplace_back(comm, true, false, static_cast<uint8_t>(annotations | ANNOTATE_NO_PID));
+                return;
             }
+            ids = ids.substr(0, slash);
+        } else {
+            annotations |= ANNOTATE_TID;
+            if (slash == std::string_view::npos) {
+                annotations |= ANNOTATE_NO_PID;
+            }
+        }
+        std::string_view root(comm.data(), static_cast<size_t>(ids.data() + ids.size() - comm.data()));
+        sample.frames.emplace_back(root, true, false, annotations);
+    }
 
-            // 如果已经是 [xxx]，就不再加括号
-            if (lib_name.front() == '[' && lib_name.back() == ']') {
-                lib_include_brackets = true;
+    // 没有符号的帧在 perf-<pid>.map 中查找; pid 优先取自 map 文件名, 匿名映射（[unknown]）用样本的 pid
+    std::string_view resolve_jit(std::string_view address, std::string_view lib_name, uint32_t pid) const {
+        constexpr std::string_view PREFIX = "perf-";
+        constexpr std::string_view SUFFIX = ".map";
+        if (! options_.perf_maps) {
+            return {};
+        }
+        if (lib_name.size() > PREFIX.size() + SUFFIX.size() && lib_name.substr(0, PREFIX.size()) == PREFIX &&
+            lib_name.substr(lib_name.size() - SUFFIX.size()) == SUFFIX) {
+            std::string_view digits = lib_name.substr(PREFIX.size(), lib_name.size() - PREFIX.size() - SUFFIX.size());
+            auto [ptr, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), pid);
+            if (ec != std::errc() || ptr != digits.data() + digits.size()) {
+                return {};
             }
+        } else if (lib_name != "[unknown]" || pid == 0) {
+            return {};
+        }
+        uint64_t addr = 0;
+        auto [ptr, ec] = std::from_chars(address.data(), address.data() + address.size(), addr, 16);
+        if (ec != std::errc() || ptr != address.data() + address.size()) {
+            return {};
         }
+        return options_.perf_maps->resolve(pid, addr);
+    }
 
-        if (! func_name.empty() && func_name != "[unknown]") {
-            return Frame(func_name);
-        } else {
-            // 如果没有 func_name 则使用 lib 替代
-            return Frame{lib_name, false, lib_include_brackets};
+    // 在哈希与折叠之前整理函数名, 只缩短 view; 中间的模板参数无法原地去掉, 留给折叠后的 SymbolRewriter
+    std::string_view tidy(std::string_view func_name) const {
+        if (options_.strip_args) {
+            func_name = strip_argument_list(func_name);
+        }
+        if (options_.strip_generics) {
+            func_name = strip_trailing_generic_args(func_name);
         }
+        return func_name;
     }
 };
 
@@ -867,6 +2431,11 @@ class GenericTextParser : public AbstractStackParser {
   public:
     StackSamples parse(std::string_view buffer, StackSamplesContext& sample_ctx) override {
         StackSamples samples = sample_ctx.create_samples();
+        parse_into(buffer, sample_ctx, samples);
+        return samples;
+    }
+
+    void parse_into(std::string_view buffer, StackSamplesContext& sample_ctx, StackSamples& samples) override {
         StackSample current_sample = sample_ctx.create_sample();
         LineScanner scanner(buffer);
 
@@ -890,21 +2459,30 @@ class GenericTextParser : public AbstractStackParser {
         if (! current_sample.frames.empty()) {
             samples.move_valid_sample(current_sample);
         }
-
-        return samples;
+        samples.line_count += scanner.line_number;
     }
 
     std::string_view get_parser_name() const override {
         return "GenericTextParser";
     }
+
+    // 每一行都是独立的 sample, 任意行首都可以切分
+    size_t next_chunk_boundary(std::string_view buffer, size_t pos) const override {
+        if (pos == 0) return 0;
+        size_t end = buffer.find('\n', pos - 1);
+        return end == std::string_view::npos ? buffer.size() : end + 1;
+    }
 };
 
 class AutoDetectParser : public AbstractStackParser {
   private:
     std::unique_ptr<AbstractStackParser> actual_parser_;
+    ParseOptions options_;
     static constexpr int MAX_PREVIEW_LINE = 128;
 
   public:
+    explicit AutoDetectParser(const ParseOptions& options = {}) : options_(options) {}
+
     StackSamples parse(std::string_view buffer, StackSamplesContext& sample_ctx) override {
         detect_format(buffer);
         if (! actual_parser_) {
@@ -914,25 +2492,24 @@ class AutoDetectParser : public AbstractStackParser {
         return actual_parser_->parse(buffer, sample_ctx);
     }
 
-    std::string_view get_parser_name() const override {
-        return "AutoDetectParser";
+    void parse_into(std::string_view buffer, StackSamplesContext& sample_ctx, StackSamples& samples) override {
+        detect_format(buffer);
+        actual_parser_->parse_into(buffer, sample_ctx, samples);
     }
 
-    std::string get_using_parser() const {
-        std::ostringstream oss;
-        if (actual_parser_) {
-            oss << "AutoDetect(" << actual_parser_->get_parser_name().data() << ")";
-        } else {
-            oss << "AutoDetect(Unknown)";
-        }
-        return oss.str();
+    size_t next_chunk_boundary(std::string_view buffer, size_t pos) const override {
+        if (! actual_parser_) return AbstractStackParser::next_chunk_boundary(buffer, pos);
+        return actual_parser_->next_chunk_boundary(buffer, pos);
     }
 
-  private:
-    void detect_format(std::string_view buffer) {
+    std::string_view get_parser_name() const override {
+        return "AutoDetectParser";
+    }
+
+    // 只做探测, 返回实际的解析器; 解析器本身无状态, 可被多个线程同时使用
+    static std::unique_ptr<AbstractStackParser> detect_parser(std::string_view buffer, const ParseOptions& options = {}) {
         size_t start = 0;
         int lines_checked = 0;
-        bool has_perf_format = false;
 
         while (start < buffer.size() && lines_checked < MAX_PREVIEW_LINE) {
             size_t end = buffer.find('\n', start);
@@ -941,36 +2518,70 @@ class AutoDetectParser : public AbstractStackParser {
             std::string_view line = buffer.substr(start, end - start);
             line = trim(line);
 
-            if (! line.empty()) {
-                if (is_like_perf(line)) {
-                    has_perf_format = true;
-                    break;
-                }
+            if (! line.empty() && is_like_perf(line)) {
+                return std::make_unique<PerfScriptParser>(options);
             }
 
             lines_checked++;
             start = end + 1; // 下一行
         }
 
-        if (has_perf_format) {
-            actual_parser_ = std::make_unique<PerfScriptParser>();
+        return std::make_unique<GenericTextParser>();
+    }
+
+    std::string get_using_parser() const {
+        std::ostringstream oss;
+        if (actual_parser_) {
+            oss << "AutoDetect(" << actual_parser_->get_parser_name().data() << ")";
         } else {
-            actual_parser_ = std::make_unique<GenericTextParser>();
+            oss << "AutoDetect(Unknown)";
         }
+        return oss.str();
+    }
+
+  private:
+    void detect_format(std::string_view buffer) {
+        actual_parser_ = detect_parser(buffer, options_);
     }
 
-    bool is_like_perf(std::string_view line) {
+    static bool is_like_perf(std::string_view line) {
         return line.find("cycles:") != std::string_view::npos || line.find("instructions:") != std::string_view::npos ||
                (line.find_first_of("0123456789abcdef") == 0 && line.find("(") != std::string_view::npos);
     }
 };
 
+/**
+ * @brief 在样本边界处按 PROGRESS_SLICE_BYTES 分片解析, 每片之后汇报字节数并检查取消
+ *
+ * 结果与一次解析整个 buffer 相同; progress 为空时直接整体解析
+ */
+inline void parse_with_progress(AbstractStackParser& parser,
+                                std::string_view buffer,
+                                StackSamplesContext& sample_ctx,
+                                StackSamples& samples,
+                                ProgressReporter* progress) {
+    constexpr size_t PROGRESS_SLICE_BYTES = 1 << 20;
+    if (progress == nullptr) {
+        parser.parse_into(buffer, sample_ctx, samples);
+        return;
+    }
+    size_t begin = 0;
+    while (begin < buffer.size()) {
+        size_t nominal = begin + PROGRESS_SLICE_BYTES;
+        size_t end = nominal >= buffer.size() ? buffer.size() : parser.next_chunk_boundary(buffer, nominal);
+        parser.parse_into(buffer.substr(begin, end - begin), sample_ctx, samples);
+        progress->advance(end - begin);
+        begin = end;
+    }
+}
+
 // 🔥 ===== 堆栈折叠器 =====
 struct StackCollapseOptions {
     bool merge_kernel_user = false;           // 合并内核和用户空间
     bool ignore_libraries = false;            // 忽略库名
     std::vector<std::string> filter_patterns; // 过滤模式
     size_t min_count_threshold = 1;           // 最小计数阈值
+    size_t expected_unique_stacks = 0;        // 预计的不同堆栈数, 用于预分配哈希表, 0 表示不预分配
 };
 
 struct FramesView {
@@ -978,8 +2589,12 @@ struct FramesView {
     size_t size;
     mutable size_t precomputed_hash = 0;
 
+    FramesView() : frame_arr(nullptr), size(0) {}
+
     FramesView(const std::pmr::vector<Frame>& frames) : frame_arr(frames.data()), size(frames.size()) {}
 
+    FramesView(const Frame* frame_arr, size_t size) : frame_arr(frame_arr), size(size) {}
+
     struct Hasher {
         size_t operator()(const FramesView& view) const noexcept {
             return view.computed_hash();
@@ -1028,31 +2643,236 @@ struct FramesView {
 
 struct CollapsedStack {
     std::pmr::unordered_map<FramesView, size_t, FramesView::Hasher, FramesView::Equal> collapsed;
+    size_t rehashes = 0; // 填表时桶数组被替换的次数, 含 reserve
 
-    CollapsedStack() : collapsed(&pool) {}
+    explicit CollapsedStack(std::pmr::memory_resource* resource) : collapsed(resource) {}
 
     bool empty() const {
         return collapsed.empty();
     }
 };
 
+// 🔥 ===== 符号改写 =====
+
+struct SymbolRewriteOptions {
+    bool demangle = false;       // 还原 C++ 的 _Z..., Rust 的 _R... 与 legacy _ZN...17h<hash>E
+    bool strip_args = false;     // 还原出的 C++ 名字同样去掉参数列表, 见 ParseOptions
+    bool strip_generics = false; // 去掉名字中间的模板参数（解析器只能去掉末尾的）
+
+    bool enabled() const {
+        return demangle || strip_generics;
+    }
+};
+
+/**
+ * @brief 把折叠结果中的函数名替换为还原/整理后的名字
+ *
+ * 代价只与不同符号的个数有关: collect 对每个名字只登记一次, resolve 对每个登记过的名字改写一次
+ * （可由多个线程分担）, 结果复制到自己的 arena 中, 替换后的 Frame 直接引用它们, 因此 rewriter 须活到渲染结束
+ */
+class SymbolRewriter {
+  private:
+    SymbolRewriteOptions options_;
+    std::pmr::monotonic_buffer_resource storage_;                   // 改写后的名字
+    std::unordered_map<std::string_view, std::string_view> names_; // 原名 -> 改写结果, 不需要改写时为空
+    std::vector<std::string_view> pending_;                         // 已登记、尚未改写的名字
+    size_t rewritten_ = 0;
+    size_t demangled_ = 0;
+    ProgressReporter* progress_ = nullptr;
+
+  public:
+    explicit SymbolRewriter(const SymbolRewriteOptions& options,
+                            std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+        : options_(options), storage_(upstream) {}
+
+    static bool is_mangled(std::string_view name) {
+        return name.size() > 2 && name[0] == '_' && (name[1] == 'Z' || name[1] == 'R');
+    }
+
+    bool needs_rewrite(const Frame& frame) const {
+        return frame.is_func && ! (frame.annotations & ANNOTATE_PROCESS) &&
+               ((options_.demangle && is_mangled(frame.name)) ||
+                                 (options_.strip_generics && frame.name.find('<') != std::string_view::npos));
+    }
+
+    // resolve 时每改写一个符号 tick 一次
+    void set_progress(ProgressReporter* progress) {
+        progress_ = progress;
+    }
+
+    void collect(std::string_view name) {
+        if (names_.emplace(name, std::string_view{}).second) {
+            pending_.push_back(name);
+        }
+    }
+
+    void collect(const FramesView& view) {
+        for (size_t i = 0; i < view.size; ++i) {
+            if (needs_rewrite(view.frame_arr[i])) {
+                collect(view.frame_arr[i].name);
+            }
+        }
+    }
+
+    size_t pending() const {
+        return pending_.size();
+    }
+
+    // parallel_for(n, body) 对 [0, n) 的每个下标调用一次 body, 可以并行; body 之间互不共享状态
+    template <typename ParallelFor>
+    void resolve(ParallelFor&& parallel_for) {
+        std::vector<std::string> results(pending_.size());
+        std::vector<char> demangled(pending_.size(), 0);
+        parallel_for(pending_.size(), [&](size_t i) {
+            results[i] = rewrite_name(pending_[i], demangled[i]);
+            progress_tick(progress_);
+        });
+
+        for (size_t i = 0; i < pending_.size(); ++i) {
+            demangled_ += demangled[i] != 0 ? 1 : 0;
+            if (results[i].empty() || results[i] == pending_[i]) {
+                continue;
+            }
+            auto* data = static_cast<char*>(storage_.allocate(results[i].size(), 1));
+            std::copy(results[i].begin(), results[i].end(), data);
+            names_[pending_[i]] = std::string_view(data, results[i].size());
+            ++rewritten_;
+        }
+        pending_.clear();
+    }
+
+    void resolve() {
+        resolve([](size_t count, const auto& body) {
+            for (size_t i = 0; i < count; ++i) {
+                body(i);
+            }
+        });
+    }
+
+    // 没有登记过或不需要改写的名字原样返回
+    std::string_view lookup(std::string_view name) const {
+        auto it = names_.find(name);
+        return it == names_.end() || it->second.empty() ? name : it->second;
+    }
+
+    // 名字是否被改写; 同名的 Frame 可能引用输入中的不同位置, 不能靠比较指针判断
+    bool rewritten(std::string_view name) const {
+        auto it = names_.find(name);
+        return it != names_.end() && ! it->second.empty();
+    }
+
+    // 堆栈中没有可替换的名字时原样返回, 否则在 arena 中复制一份替换了名字的 Frame 数组
+    FramesView rewrite(const FramesView& view, std::pmr::memory_resource* arena) const {
+        size_t first = view.size;
+        for (size_t i = 0; i < view.size && first == view.size; ++i) {
+            const Frame& frame = view.frame_arr[i];
+            if (needs_rewrite(frame) && rewritten(frame.name)) {
+                first = i;
+            }
+        }
+        if (first == view.size) {
+            return view;
+        }
+
+        std::pmr::polymorphic_allocator<Frame> alloc(arena);
+        Frame* copy = alloc.allocate(view.size);
+        for (size_t i = 0; i < view.size; ++i) {
+            const Frame& frame = view.frame_arr[i];
+            std::string_view name = i >= first && needs_rewrite(frame) ? lookup(frame.name) : frame.name;
+            Frame* owned = new (copy + i) Frame(name, frame.is_func, frame.lib_include_brackets, frame.annotations);
+            if (name.data() == frame.name.data()) {
+                owned->precomputed_hash = frame.precomputed_hash;
+            }
+        }
+        return FramesView{copy, view.size};
+    }
+
+    // 登记过的不同符号数
+    size_t symbol_count() const {
+        return names_.size();
+    }
+
+    // 其中名字被改写的个数
+    size_t rewritten_count() const {
+        return rewritten_;
+    }
+
+    // 其中成功还原的个数
+    size_t demangled_count() const {
+        return demangled_;
+    }
+
+  private:
+    // 先还原, 再整理; 整理对解析器已处理过的名字是幂等的
+    std::string rewrite_name(std::string_view name, char& demangled) const {
+        std::string result;
+        if (options_.demangle && is_mangled(name)) {
+            result = demangle_symbol(name);
+            demangled = result.empty() ? 0 : 1;
+        }
+        std::string_view current = result.empty() ? name : std::string_view(result);
+        if (options_.strip_args && demangled != 0) {
+            current = strip_argument_list(current);
+        }
+        if (options_.strip_generics) {
+            return strip_generic_args(current);
+        }
+        return std::string(current);
+    }
+};
+
 class StackCollapser {
+  private:
+    std::pmr::memory_resource* resource_;
+    ProgressReporter* progress_ = nullptr;
+
   public:
+    explicit StackCollapser(std::pmr::memory_resource* resource) : resource_(resource) {}
+
+    // 每折叠一个样本 tick 一次
+    void set_progress(ProgressReporter* progress) {
+        progress_ = progress;
+    }
+
     // 折叠堆栈: 读入样本，生成 folded 文件数据
     CollapsedStack collapse(const StackSamples& samples,
                             const StackCollapseOptions& options = {}) {
-        (void)options;
-        CollapsedStack collapsed_stacks;
+        CollapsedStack collapsed_stacks(resource_);
+        auto& table = collapsed_stacks.collapsed;
+        size_t buckets = table.bucket_count();
+        table.reserve(std::min(options.expected_unique_stacks, samples.raw_samples.size()));
 
         for (const auto& sample : samples.raw_samples) {
             // 统计出现次数, 使用 view 避免拷贝, 直接引用 samples 的原数据
             FramesView view{sample.frames};
-            collapsed_stacks.collapsed[view] += sample.count;
+            table[view] += sample.count;
+            if (table.bucket_count() != buckets) {
+                buckets = table.bucket_count();
+                ++collapsed_stacks.rehashes;
+            }
+            progress_tick(progress_);
+        }
+        if (table.bucket_count() != buckets) {
+            ++collapsed_stacks.rehashes; // 只有 reserve, 没有样本
         }
 
         return collapsed_stacks;
     }
 
+    // 名字替换为改写后的版本, 新的 Frame 数组分配在 resource 中; 改写后相同的堆栈（如只差 hash 的 Rust 符号）合并为一条
+    CollapsedStack rewrite_symbols(const CollapsedStack& collapsed_stacks, const SymbolRewriter& rewriter) {
+        CollapsedStack result(resource_);
+        auto& table = result.collapsed;
+        size_t buckets = table.bucket_count();
+        table.reserve(collapsed_stacks.collapsed.size());
+        result.rehashes = collapsed_stacks.rehashes + (table.bucket_count() != buckets ? 1 : 0);
+
+        for (const auto& [view, count] : collapsed_stacks.collapsed) {
+            table[rewriter.rewrite(view, resource_)] += count;
+        }
+        return result;
+    }
+
     // 写 folded 文件
     void write_folded_file(const CollapsedStack& collapsed_stacks,
                            std::string_view filename,
@@ -1063,15 +2883,29 @@ class StackCollapser {
             throw OpenFileException(filename);
         }
 
-        for (const auto& [frames, count] : collapsed_stacks.collapsed) {
-            for (size_t i = 0; i < frames.size; ++i) {
-                if (i > 0) {
-                    ofs << ';';
-                }
-                ofs << frames.frame_arr[i];
+        // 按堆栈字典序输出, 与 stackcollapse 一致, 也让输出与哈希表遍历顺序无关
+        std::vector<const std::pair<const FramesView, size_t>*> sorted;
+        sorted.reserve(collapsed_stacks.collapsed.size());
+        for (const auto& entry : collapsed_stacks.collapsed) {
+            sorted.push_back(&entry);
+        }
+        std::sort(sorted.begin(), sorted.end(), [](const auto* a, const auto* b) {
+            return FramesView::Less{}(a->first, b->first);
+        });
+
+        for (const auto* entry : sorted) {
+            write_folded_line(ofs, entry->first, entry->second);
+        }
+    }
+
+    static void write_folded_line(std::ostream& os, const FramesView& frames, size_t count) {
+        for (size_t i = 0; i < frames.size; ++i) {
+            if (i > 0) {
+                os << ';';
             }
-            ofs << ' ' << count << '\n';
+            os << frames.frame_arr[i];
         }
+        os << ' ' << count << '\n';
     }
 };
 
@@ -1083,9 +2917,41 @@ struct FlameGraphBuildOptions {
 };
 
 class FlameGraphBuilder {
+  private:
+    std::pmr::memory_resource* resource_;
+    size_t node_count_ = 0;
+    size_t pruned_nodes_ = 0;
+    size_t children_rehashes_ = 0;
+    ProgressReporter* progress_ = nullptr;
+
   public:
+    explicit FlameGraphBuilder(std::pmr::memory_resource* resource) : resource_(resource) {}
+
+    // 每插入一条堆栈 tick 一次; 节点总数要建完才知道, 所以按堆栈计
+    void set_progress(ProgressReporter* progress) {
+        progress_ = progress;
+    }
+
+    // 最近一次 build_tree 得到的节点数（含根, 不含修剪掉的）
+    size_t node_count() const {
+        return node_count_;
+    }
+
+    // 最近一次 build_tree 修剪掉的节点数
+    size_t pruned_nodes() const {
+        return pruned_nodes_;
+    }
+
+    // 最近一次 build_tree 中所有 children 表的桶数组被替换的次数, 含首次插入时的分配
+    size_t children_rehashes() const {
+        return children_rehashes_;
+    }
+
+    // 返回的树归 resource 所有
     FlameNode* build_tree(const CollapsedStack& folded_stacks, const FlameGraphBuildOptions& options = {}) {
-        auto root = new FlameNode;
+        auto root = FlameNode::create(resource_);
+        node_count_ = 1;
+        children_rehashes_ = 0;
 
         for (const auto& [stack_frames, count] : folded_stacks.collapsed) {
             if (stack_frames.empty()) continue;
@@ -1093,16 +2959,26 @@ class FlameGraphBuilder {
             FlameNode* current = root;
             for (size_t i = 0; i < stack_frames.size; i++) {
                 const Frame* frame = &stack_frames.frame_arr[i];
+                size_t siblings = current->children.size();
+                size_t buckets = current->children.bucket_count();
+                FlameNode* parent = current;
                 current = current->get_or_create_child(frame);
+                node_count_ += parent->children.size() - siblings;
+                if (parent->children.bucket_count() != buckets) {
+                    ++children_rehashes_;
+                }
             }
 
             // current 现在是 leaf, 自底向上更新 count
             current->increment_self_count(count);
+            progress_tick(progress_);
         }
 
         // 修剪小节点
+        pruned_nodes_ = 0;
         if (options.prune_small_nodes && root->total_count > 0) {
-            root->prune_tree(options.prune_threshold);
+            pruned_nodes_ = root->prune_tree(options.prune_threshold);
+            node_count_ -= pruned_nodes_;
         }
 
         return root;
@@ -1112,6 +2988,7 @@ class FlameGraphBuilder {
 class FlameGraphRenderer {
   protected:
     FlameGraphConfig config_;
+    ProgressReporter* progress_ = nullptr;
 
     explicit FlameGraphRenderer(const FlameGraphConfig& config) : config_(config) {
         config_.validate();
@@ -1120,6 +2997,11 @@ class FlameGraphRenderer {
   public:
     virtual void render(const FlameNodeRoot& root, std::string_view output_file) = 0;
     virtual ~FlameGraphRenderer() = default;
+
+    // 进度按已覆盖的样本数计（总量为根节点的 total_count）: 因 min_width 被省略的子树整体计入
+    void set_progress(ProgressReporter* progress) {
+        progress_ = progress;
+    }
 };
 
 class HtmlFlameGraphRenderer : public FlameGraphRenderer {
@@ -1178,7 +3060,7 @@ class HtmlFlameGraphRenderer : public FlameGraphRenderer {
 
 // 🔥 ===== SVG火焰图渲染器  =====
 class SvgFlameGraphRenderer : public FlameGraphRenderer {
-  private:
+  protected:
 #include "embed/flamegraph_js_embed.hpp" // FLAMEGRAPH_JS 变量可用
 
     std::ofstream svg_content_;
@@ -1216,7 +3098,18 @@ class SvgFlameGraphRenderer : public FlameGraphRenderer {
         svg_content_.close();
     }
 
-  private:
+  protected:
+    // 写入所有 frame 元素（火焰图或冰柱图）, 并行渲染器覆盖此方法
+    virtual void write_frames(const FlameNode& root) {
+        double y = frame_origin_y();
+
+        // 渲染根节点
+        render_frame(svg_content_, root, config_.xpad, y, config_.width - 2 * config_.xpad, nullptr, 0);
+
+        // 递归渲染子节点
+        render_children(svg_content_, root, config_.xpad, y, 1, width_per_sample());
+    }
+
     void write_svg(const FlameNode& root) {
         // 写入 SVG
         write_svg_header();
@@ -1228,15 +3121,7 @@ class SvgFlameGraphRenderer : public FlameGraphRenderer {
 
         // 写入火焰图框架
         svg_content_ << "<g id=\"frames\">\n";
-
-        if (config_.inverted) {
-            // Icicle 图（倒置）
-            render_frames_icicle(root);
-        } else {
-            // 标准火焰图
-            render_frames_flamegraph(root);
-        }
-
+        write_frames(root);
         svg_content_ << "</g>\n";
         svg_content_ << "</svg>\n";
     }
@@ -1367,75 +3252,53 @@ class SvgFlameGraphRenderer : public FlameGraphRenderer {
                      << (imageheight_ - ypad2 / 2) << "\"> </text>\n";
     }
 
-    void render_frames_flamegraph(const FlameNode& root) {
+    // 根节点所在行的 y 坐标: 火焰图从底部向上, 冰柱图从顶部向下
+    double frame_origin_y() const {
+        if (config_.inverted) {
+            int ypad1 = config_.font_size * 3;
+            int ypad3 = config_.subtitle.empty() ? 0 : config_.font_size * 2;
+            return ypad1 + ypad3;
+        }
         int ypad = config_.font_size * 2 + 10;
-
-        double width_per_sample = (config_.width - 2.0 * config_.xpad) / static_cast<double>(total_samples_);
-
-        // 渲染根节点
-        double y = imageheight_ - ypad - config_.frame_height;
-
-        render_frame(root, config_.xpad, y, config_.width - 2 * config_.xpad, nullptr, 0);
-
-        // 递归渲染子节点
-        render_children_flamegraph(root, config_.xpad, y, 1, width_per_sample);
+        return imageheight_ - ypad - config_.frame_height;
     }
 
-    void render_frames_icicle(const FlameNode& root) {
-        int ypad1 = config_.font_size * 3;
-        int ypad3 = config_.subtitle.empty() ? 0 : config_.font_size * 2;
-
-        double width_per_sample = (config_.width - 2.0 * config_.xpad) / static_cast<double>(total_samples_);
-        double y = ypad1 + ypad3;
-
-        // 渲染根节点
-        render_frame(root, config_.xpad, y, config_.width - 2 * config_.xpad, nullptr, 0);
-
-        // 递归渲染子节点
-        render_children_icicle(root, config_.xpad, y, 1, width_per_sample);
+    // 子节点相对父节点的 y 偏移
+    double frame_step_y() const {
+        return config_.inverted ? config_.frame_height : -config_.frame_height;
     }
 
-    void
-    render_children_flamegraph(const FlameNode& node, double x, double parent_y, int depth, double width_per_sample) {
-        double child_x = x;
-        double child_y = parent_y - config_.frame_height;
-
-        for (const auto& [frame, child] : node.children) {
-            double child_width = static_cast<double>(child->total_count) * width_per_sample;
-
-            if (child_width >= config_.min_width) {
-                render_frame(*child, child_x, child_y, child_width, frame, depth);
-
-                if (! child->children.empty()) {
-                    render_children_flamegraph(*child, child_x, child_y, depth + 1, width_per_sample);
-                }
-            }
-
-            child_x += child_width;
-        }
+    double width_per_sample() const {
+        return (config_.width - 2.0 * config_.xpad) / static_cast<double>(total_samples_);
     }
 
-    void render_children_icicle(const FlameNode& node, double x, double parent_y, int depth, double width_per_sample) {
+    void render_children(
+        std::ostream& os, const FlameNode& node, double x, double parent_y, int depth, double width_per_sample) {
         double child_x = x;
-        double child_y = parent_y + config_.frame_height;
+        double child_y = parent_y + frame_step_y();
 
-        for (const auto& [name, child] : node.children) {
+        for (const auto& [frame, child] : node.sorted_children()) {
             double child_width = static_cast<double>(child->total_count) * width_per_sample;
 
             if (child_width >= config_.min_width) {
-                render_frame(*child, child_x, child_y, child_width, name, depth);
+                render_frame(os, *child, child_x, child_y, child_width, frame, depth);
 
                 if (! child->children.empty()) {
-                    render_children_icicle(*child, child_x, child_y, depth + 1, width_per_sample);
+                    render_children(os, *child, child_x, child_y, depth + 1, width_per_sample);
                 }
+            } else {
+                progress_tick(progress_, child->total_count);
             }
 
             child_x += child_width;
         }
     }
 
-    void render_frame(const FlameNode& node, double x, double y, double width, const Frame* frame, int depth) {
+    // 输出只依赖参数本身（数值格式每次显式设置）, 因此可以写入任意 ostream 后再拼接
+    void render_frame(
+        std::ostream& os, const FlameNode& node, double x, double y, double width, const Frame* frame, int depth) {
         // frame maybe nullptr
+        progress_tick(progress_, node.self_count);
 
         // 构建 title（tooltip）
         std::string title = build_frame_title(frame, node.total_count);
@@ -1444,22 +3307,22 @@ class SvgFlameGraphRenderer : public FlameGraphRenderer {
         std::string color = get_frame_color(frame, depth);
 
         // 开始 g 元素
-        svg_content_ << "<g>\n";
+        os << "<g>\n";
 
         // 写 title
-        svg_content_ << "<title>";
-        escape_xml_to_stream(title, svg_content_);
-        svg_content_ << "</title>\n";
+        os << "<title>";
+        escape_xml_to_stream(title, os);
+        os << "</title>\n";
 
-        svg_content_ << "<rect x=\"" << std::fixed << std::setprecision(1) << x << "\" y=\"" << static_cast<int>(y)
-                     << "\" width=\"" << std::setprecision(1) << width << "\" height=\"" << (config_.frame_height - 1)
-                     << "\" fill=\"" << color << "\" rx=\"2\" ry=\"2\" />\n";
+        os << "<rect x=\"" << std::fixed << std::setprecision(1) << x << "\" y=\"" << static_cast<int>(y)
+           << "\" width=\"" << std::setprecision(1) << width << "\" height=\"" << (config_.frame_height - 1)
+           << "\" fill=\"" << color << "\" rx=\"2\" ry=\"2\" />\n";
 
         // 留空，直接让浏览器去 title 里面拿信息
-        svg_content_ << "<text x=\"" << std::setprecision(2) << (x + 3) << "\" y=\"" << std::setprecision(1)
-                     << (y + config_.frame_height - 5) << "\"></text>\n";
+        os << "<text x=\"" << std::setprecision(2) << (x + 3) << "\" y=\"" << std::setprecision(1)
+           << (y + config_.frame_height - 5) << "\"></text>\n";
 
-        svg_content_ << "</g>\n";
+        os << "</g>\n";
     }
 
     std::string build_frame_title(const Frame* frame, size_t samples) {
@@ -1505,34 +3368,63 @@ class SvgFlameGraphRenderer : public FlameGraphRenderer {
 };
 
 class FlameGraphRendererFactory {
-    using CreatorFunc = std::function<std::unique_ptr<FlameGraphRenderer>()>;
+    using CreatorFunc = std::function<std::unique_ptr<FlameGraphRenderer>(const FlameGraphConfig&)>;
 
     static const std::unordered_map<std::string_view, CreatorFunc>& get_render_map() {
         static const std::unordered_map<std::string_view, CreatorFunc> render_map = {
-            { "svg",  []() { return std::make_unique<SvgFlameGraphRenderer>(); }},
-            {"html", []() { return std::make_unique<HtmlFlameGraphRenderer>(); }},
+            { "svg",  [](const FlameGraphConfig& config) { return std::make_unique<SvgFlameGraphRenderer>(config); }},
+            {"html", [](const FlameGraphConfig& config) { return std::make_unique<HtmlFlameGraphRenderer>(config); }},
         };
         return render_map;
     }
 
   public:
-    static std::unique_ptr<FlameGraphRenderer> create(std::string_view filetype) {
+    static std::unique_ptr<FlameGraphRenderer> create(std::string_view filetype, const FlameGraphConfig& config = {}) {
         const auto& map = get_render_map();
         auto it = map.find(filetype);
         if (it != map.end()) {
-            return it->second(); // 调用 lambda，生成实例
+            return it->second(config); // 调用 lambda，生成实例
         }
         // 未知默认返回 html
-        return std::make_unique<HtmlFlameGraphRenderer>();
+        return std::make_unique<HtmlFlameGraphRenderer>(config);
     }
 };
 
+// 没有回调也没有 token 时返回空, 各阶段不做任何进度相关的工作
+inline std::unique_ptr<ProgressReporter> make_progress_reporter(const ProgressCallback& callback,
+                                                                const CancellationToken* token) {
+    if (! callback && token == nullptr) {
+        return nullptr;
+    }
+    return std::make_unique<ProgressReporter>(callback, token);
+}
+
+inline void begin_stage(ProgressReporter* progress, const char* stage, size_t total) {
+    if (progress != nullptr) {
+        progress->begin(stage, total);
+    }
+}
+
+inline void finish_stage(ProgressReporter* progress) {
+    if (progress != nullptr) {
+        progress->finish();
+    }
+}
+
 // 🔥 ===== 主入口类 =====
 class FlameGraphGenerator {
   private:
     FlameGraphConfig config_;
     StackCollapseOptions collapse_opts_;
     FlameGraphBuildOptions build_opts_;
+    GenerationArena arena_; // 每次生成的全部中间数据, 结束时整体释放
+    RunStats last_stats_;
+    bool detailed_stats_ = false;
+    bool diagnostics_ = false;
+    bool demangle_ = false;
+    ParseOptions parse_opts_;
+    ProgressCallback progress_callback_;
+    const CancellationToken* cancel_token_ = nullptr;
 
   public:
     explicit FlameGraphGenerator(const FlameGraphConfig& config = {}) : config_(config) {
@@ -1540,50 +3432,186 @@ class FlameGraphGenerator {
     }
 
     void generate(std::string_view raw_file, std::string_view out_file) {
-        auto parser = std::make_unique<AutoDetectParser>();
-        StackCollapser collapser;
-        FlameGraphBuilder builder;
+        std::unique_ptr<MMapBuffer> buffer;
+        try {
+            buffer = std::make_unique<MMapBuffer>(raw_file);
+        } catch (const std::exception& e) {
+            throw FlameGraphException(e.what());
+        }
+        generate_from_buffer(buffer->view(), out_file);
+    }
+
+    // 输入已在内存中（例如调用方已经 mmap 过）时直接生成, 不再读文件
+    void generate_from_buffer(std::string_view raw_buffer, std::string_view out_file) {
+        last_stats_ = RunStats{};
+        RunStats stats;
+        StageTimer total_timer;
+        StageTimer timer;
+        stats.bytes_read = raw_buffer.size();
+        size_t jit_frames = parse_opts_.jit_frames();
+        size_t elf_frames = parse_opts_.elf_frames();
+
+        ArenaReleaseGuard arena_guard{arena_};
+        CountingResource collapse_memory(arena_.resource());
+        CountingResource tree_memory(arena_.resource());
+        auto parser = std::make_unique<AutoDetectParser>(parse_opts_);
+        StackCollapser collapser(&collapse_memory);
+        FlameGraphBuilder builder(&tree_memory);
         auto suffix = file_suffix(out_file);
         if (suffix.empty()) {
             throw FlameGraphException(std::string("File suffix empty") + out_file.data());
         }
-        auto renderer = FlameGraphRendererFactory::create(suffix);
+        auto renderer = FlameGraphRendererFactory::create(suffix, config_);
+        auto progress = make_progress_reporter(progress_callback_, cancel_token_);
+        collapser.set_progress(progress.get());
+        builder.set_progress(progress.get());
+        renderer->set_progress(progress.get());
 
         try {
-            MMapBuffer buffer(raw_file);
-
             // 解析原始数据
-            StackSamplesContext sample_ctx;
-            StackSamples samples = parser->parse(buffer.view(), sample_ctx);
+            StackSamplesContext sample_ctx(arena_.resource());
+            StackSamples samples = sample_ctx.create_samples();
+            if (progress) {
+                // 分片解析以便汇报进度; 格式只在整个 buffer 上探测一次
+                progress->begin("parse", raw_buffer.size());
+                parse_with_progress(*AutoDetectParser::detect_parser(raw_buffer, parse_opts_), raw_buffer, sample_ctx, samples,
+                                    progress.get());
+                progress->finish();
+            } else {
+                samples = parser->parse(raw_buffer, sample_ctx);
+            }
+            stats.parse = timer.lap("parse");
+            stats.lines = samples.line_count;
+            stats.samples = samples.raw_samples.size();
 
             if (samples.empty()) {
                 throw FlameGraphException("No valid samples found in input file");
             }
 
             // 折叠堆栈
+            begin_stage(progress.get(), "collapse", samples.raw_samples.size());
             CollapsedStack collapsed = collapser.collapse(samples, collapse_opts_);
+            finish_stage(progress.get());
 
             if (collapsed.empty()) {
                 throw FlameGraphException("No stacks remained after collapsing");
             }
 
+            stats.unique_stacks = collapsed.collapsed.size(); // 还原前的个数, 与并行版一致
+
+            // 还原与整理函数名: 每个不同的符号一次, 替换后的名字位于 rewriter 中, 须活到渲染结束
+            SymbolRewriter rewriter(symbol_rewrite_options(), arena_.resource());
+            if (symbol_rewrite_options().enabled()) {
+                for (const auto& entry : collapsed.collapsed) {
+                    rewriter.collect(entry.first);
+                }
+                rewriter.set_progress(progress.get());
+                begin_stage(progress.get(), "rewrite symbols", rewriter.pending());
+                rewriter.resolve();
+                finish_stage(progress.get());
+                if (rewriter.rewritten_count() > 0) {
+                    collapsed = collapser.rewrite_symbols(collapsed, rewriter);
+                }
+                stats.demangled_symbols = rewriter.demangled_count();
+            }
+
             if (config_.write_folded_file) {
                 collapser.write_folded_file(collapsed, std::string(out_file) + ".collapse");
+                stats.bytes_written += file_size_or_zero(std::string(out_file) + ".collapse");
+            }
+            stats.collapse = timer.lap("collapse");
+            if (diagnostics_) {
+                stats.diagnostics.enabled = true;
+                stats.diagnostics.collapse_table.add_table(collapsed.collapsed);
+                stats.diagnostics.collapse_table.rehashes = collapsed.rehashes;
             }
 
             // 构建树
             build_opts_.max_depth = config_.max_depth;
             build_opts_.prune_threshold = config_.min_heat_threshold;
+            begin_stage(progress.get(), "build", collapsed.collapsed.size());
             FlameNodeRoot root = builder.build_tree(collapsed, build_opts_);
+            finish_stage(progress.get());
 
             if (root.node->total_count == 0) {
                 throw FlameGraphException("Tree has no samples");
             }
+            stats.tree_nodes = builder.node_count();
+            stats.max_depth = root.node->height - 1;
+            stats.pruned_nodes = builder.pruned_nodes();
+            if (diagnostics_) {
+                stats.diagnostics.tree = root.node->analyze_tree();
+                stats.diagnostics.children_tables = root.node->children_health();
+                stats.diagnostics.children_tables.rehashes = builder.children_rehashes();
+                stats.distinct_frames = stats.diagnostics.tree.distinct_frames;
+            } else if (detailed_stats_) {
+                stats.distinct_frames = root.node->analyze_tree().distinct_frames;
+            }
+            stats.build = timer.lap("build");
 
+            begin_stage(progress.get(), "render", root.node->total_count);
             renderer->render(root, out_file);
+            finish_stage(progress.get());
+            stats.render = timer.lap("render");
+            stats.bytes_written += file_size_or_zero(std::string(out_file));
+
+            stats.memory.samples = sample_ctx.samples_allocations();
+            stats.memory.frames = sample_ctx.frames_allocations();
+            stats.memory.collapse = collapse_memory.stats();
+            stats.memory.tree = tree_memory.stats();
+        } catch (const CancelledException&) {
+            throw;
         } catch (const std::exception& e) {
             throw FlameGraphException(e.what());
         }
+
+        stats.jit_frames = parse_opts_.jit_frames() - jit_frames;
+        stats.elf_frames = parse_opts_.elf_frames() - elf_frames;
+        stats.peak_arena_bytes = arena_.bytes_reserved();
+        stats.total = total_timer.lap();
+        last_stats_ = stats;
+    }
+
+    // 最近一次成功生成的统计
+    const RunStats& get_last_stats() const {
+        return last_stats_;
+    }
+
+    // 额外统计需要遍历整棵树的项（distinct_frames）
+    void set_detailed_stats(bool detailed) {
+        detailed_stats_ = detailed;
+    }
+
+    // 数据结构诊断: 折叠表与 children 表的链长分布、rehash 次数, 以及树的形状, 写入 stats.diagnostics
+    // 需要遍历所有哈希桶和整棵树, 计入 build 阶段; 同时也会填写 distinct_frames
+    void set_diagnostics(bool enabled) {
+        diagnostics_ = enabled;
+    }
+
+    // 折叠后把 C++/Rust 的 mangled 函数名还原为可读名字（folded 文件与图中都是还原后的名字）, 计入 collapse 阶段
+    // 还原按不同符号进行, 代价与样本数无关; 还原后相同的堆栈会合并
+    void set_demangle(bool enabled) {
+        demangle_ = enabled;
+    }
+
+    // 函数名整理（参数列表、模板参数）, 在解析时只缩短 view, 相同函数的不同重载/实例在折叠时即合并
+    // 名字中间的模板参数与还原出的名字在折叠后按不同符号整理, 与 set_demangle 同一阶段
+    void set_parse_options(const ParseOptions& options) {
+        parse_opts_ = options;
+    }
+
+    const ParseOptions& get_parse_options() const {
+        return parse_opts_;
+    }
+
+    // 各阶段的进度回调, 详见 ProgressReporter; 为空时不汇报
+    void set_progress_callback(ProgressCallback callback) {
+        progress_callback_ = std::move(callback);
+    }
+
+    // 取消后 generate 在下一个检查点抛出 CancelledException, 本次生成的 arena 随即释放; token 须活到生成结束
+    void set_cancellation_token(const CancellationToken* token) {
+        cancel_token_ = token;
     }
 
     void set_config(const FlameGraphConfig& config) {
@@ -1594,5 +3622,23 @@ class FlameGraphGenerator {
     const FlameGraphConfig& get_config() const {
         return config_;
     }
+
+    void set_collapse_options(const StackCollapseOptions& options) {
+        collapse_opts_ = options;
+    }
+
+    // 复用模式: 生成结束后保留热页给下一次生成, 适合反复调用 generate 的常驻进程
+    void set_arena_reuse(bool reuse) {
+        arena_.set_reuse(reuse);
+    }
+
+    void set_arena_policy(const ArenaPolicy& policy) {
+        arena_.set_policy(policy);
+    }
+
+  private:
+    SymbolRewriteOptions symbol_rewrite_options() const {
+        return {demangle_, parse_opts_.strip_args, parse_opts_.strip_generics};
+    }
 };
 } // namespace flamegraph
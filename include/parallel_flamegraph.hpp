@@ -1,372 +1,2146 @@
-// #pragma once
-
-// #include <thread>
-// #include <future>
-// #include <atomic>
-// #include <tbb/concurrent_hash_map.h>
-// #include <tbb/parallel_for.h>
-// #include <tbb/blocked_range.h>
-// #include "flamegraph.hpp"
-
-// // 在原有的头文件基础上添加并行化支持
-
-// namespace flamegraph {
-
-// // 并行化的行扫描器
-// class ParallelLineScanner {
-//     std::string_view buffer;
-//     std::vector<size_t> line_offsets;
-
-//   public:
-//     explicit ParallelLineScanner(std::string_view data) : buffer(data) {
-//         // 预先扫描所有行的偏移量
-//         line_offsets.push_back(0);
-//         for (size_t i = 0; i < buffer.size(); ++i) {
-//             if (buffer[i] == '\n') {
-//                 line_offsets.push_back(i + 1);
-//             }
-//         }
-//         if (line_offsets.back() != buffer.size()) {
-//             line_offsets.push_back(buffer.size());
-//         }
-//     }
-
-//     size_t line_count() const {
-//         return line_offsets.empty() ? 0 : line_offsets.size() - 1;
-//     }
-
-//     std::string_view get_line(size_t index) const {
-//         if (index >= line_count()) return {};
-//         size_t start = line_offsets[index];
-//         size_t end = (index + 1 < line_offsets.size()) ? line_offsets[index + 1] - 1 : buffer.size();
-//         return trim(buffer.substr(start, end - start));
-//     }
-
-//     // 获取一个块的行范围
-//     std::pair<size_t, size_t> get_block_range(size_t block_idx, size_t num_blocks) const {
-//         size_t total_lines = line_count();
-//         size_t lines_per_block = total_lines / num_blocks;
-//         size_t start = block_idx * lines_per_block;
-//         size_t end = (block_idx == num_blocks - 1) ? total_lines : (block_idx + 1) * lines_per_block;
-//         return {start, end};
-//     }
-// };
-
-// // 并行化的 PerfScript 解析器
-// class ParallelPerfScriptParser : public AbstractStackParser {
-//   private:
-//     static constexpr size_t MIN_LINES_PER_THREAD = 10000;
-
-//   public:
-//     StackSamples parse(std::string_view buffer, StackSamplesContext& ctx) override {
-//         ParallelLineScanner scanner(buffer);
-//         size_t total_lines = scanner.line_count();
-
-//         // 确定线程数
-//         size_t num_threads = std::min(static_cast<size_t>(std::thread::hardware_concurrency()),
-//                                       (total_lines + MIN_LINES_PER_THREAD - 1) / MIN_LINES_PER_THREAD);
-
-//         if (num_threads <= 1) {
-//             // 数据量太小，使用单线程
-//             return parse_single_thread(scanner, ctx);
-//         }
-
-//         // 并行解析
-//         std::vector<std::future<StackSamples>> futures;
-
-//         for (size_t i = 0; i < num_threads; ++i) {
-//             futures.push_back(std::async(std::launch::async, [this, &scanner, i, num_threads]() {
-//                 return parse_block(scanner, i, num_threads);
-//             }));
-//         }
-
-//         // 收集结果
-//         StackSamples all_samples = ctx.create_samples();
-//         for (auto& future : futures) {
-//             auto samples = future.get();
-//             all_samples.stack_samples.insert(all_samples.stack_samples.end(),
-//                                std::make_move_iterator(samples.stack_samples.begin()),
-//                                std::make_move_iterator(samples.stack_samples.end()));
-//         }
-
-//         if (all_samples.empty()) {
-//             throw ParseException("No valid samples found in file");
-//         }
-
-//         return all_samples;
-//     }
-
-//     std::string_view get_parser_name() const override {
-//         return "ParallelPerfScriptParser";
-//     }
-
-//   private:
-//     StackSamples parse_single_thread(const ParallelLineScanner& scanner, StackSamplesContext& ctx) {
-//         StackSamples samples = ctx.create_samples();
-//         StackSample current_sample = ctx.create_sample();
-//         bool reading_stack = false;
-
-//         for (size_t i = 0; i < scanner.line_count(); ++i) {
-//             std::string_view line = scanner.get_line(i);
-
-//             if (line.empty()) {
-//                 if (reading_stack) {
-//                     samples.move_valid_sample(current_sample);
-//                 }
-//                 reading_stack = false;
-//             } else {
-//                 PerfScriptParser::parse_line(line, current_sample, reading_stack);
-//             }
-//         }
-
-//         if (reading_stack) {
-//             samples.move_valid_sample(current_sample);
-//         }
-
-//         return samples;
-//     }
-
-//     StackSamples parse_block(const ParallelLineScanner& scanner, size_t block_idx, size_t num_blocks) {
-//         auto [start, end] = scanner.get_block_range(block_idx, num_blocks);
-//         StackSamples samples;
-//         StackSample current_sample;
-//         bool reading_stack = false;
-
-//         // 如果不是第一个块，需要找到第一个完整的样本开始位置
-//         if (block_idx > 0) {
-//             // 向前扫描找到第一个空行或样本头
-//             while (start < end) {
-//                 std::string_view line = scanner.get_line(start);
-//                 if (line.empty() || line.find(':') != std::string_view::npos) {
-//                     break;
-//                 }
-//                 start++;
-//             }
-//         }
-
-//         for (size_t i = start; i < end; ++i) {
-//             std::string_view line = scanner.get_line(i);
-
-//             if (line.empty()) {
-//                 if (reading_stack) {
-//                     PerfScriptParser::push_valid_sample(samples, current_sample);
-//                 }
-//                 reading_stack = false;
-//             } else {
-//                 PerfScriptParser::parse_line(line, current_sample, reading_stack);
-//             }
-//         }
-
-//         // 如果是最后一个块且正在读取堆栈，保存它
-//         if (block_idx == num_blocks - 1 && reading_stack) {
-//             PerfScriptParser::push_valid_sample(samples, current_sample);
-//         }
-
-//         return samples;
-//     }
-// };
-
-// // TBB 需要的哈希比较器格式
-// struct FramesViewHasher {
-//     static size_t hash(const FramesView& view) {
-//         return FramesView::Hasher{}(view);
-//     }
-
-//     static bool equal(const FramesView& a, const FramesView& b) {
-//         return FramesView::Equal{}(a, b);
-//     }
-// };
-
-// // 并行化的堆栈折叠器
-// class ParallelStackCollapser {
-//   public:
-//     CollapsedStack collapse(const StackSamples& samples, const StackCollapseOptions& options = {}) {
-//         (void)options;
-
-//         // 使用 TBB 的并发哈希表
-//         using ConcurrentMap = tbb::concurrent_hash_map<FramesView, std::atomic<size_t>, FramesViewHasher>;
-//         ConcurrentMap concurrent_collapsed;
-
-//         // 并行处理样本
-//         tbb::parallel_for(tbb::blocked_range<size_t>(0, samples.stack_samples.size()),
-//                           [&samples, &concurrent_collapsed](const tbb::blocked_range<size_t>& range) {
-//                               for (size_t i = range.begin(); i != range.end(); ++i) {
-//                                   const auto& sample = samples.stack_samples[i];
-//                                   ConcurrentMap::accessor acc;
-//                                   if (concurrent_collapsed.insert(acc, FramesView{sample.frames})) {
-//                                       acc->second.store(sample.count);
-//                                   } else {
-//                                       acc->second.fetch_add(sample.count);
-//                                   }
-//                               }
-//                           });
-
-//         // 转换为普通的 CollapsedStack
-//         CollapsedStack result;
-//         for (const auto& pair : concurrent_collapsed) {
-//             result.collapsed[pair.first] = pair.second.load();
-//         }
-
-//         return result;
-//     }
-
-//     void write_folded_file(const CollapsedStack& collapsed_stacks,
-//                            std::string_view filename,
-//                            const StackCollapseOptions& options = {}) {
-//         (void)options;
-
-//         // 先收集所有数据到内存
-//         std::vector<std::string> lines;
-//         lines.reserve(collapsed_stacks.collapsed.size());
-
-//         for (const auto& [frames, count] : collapsed_stacks.collapsed) {
-//             std::ostringstream oss;
-//             for (size_t i = 0; i < frames.size; ++i) {
-//                 if (i > 0) {
-//                     oss << ';';
-//                 }
-//                 oss << frames.frame_arr[i];
-//             }
-//             oss << ' ' << count << '\n';
-//             lines.push_back(oss.str());
-//         }
-
-//         // 一次性写入文件
-//         std::ofstream ofs(filename.data(), std::ios::binary);
-//         if (! ofs.is_open()) {
-//             throw OpenFileException(filename);
-//         }
-
-//         for (const auto& line : lines) {
-//             ofs.write(line.data(), line.size());
-//         }
-//     }
-// };
-
-// // 更新后的 AutoDetectParser，使用并行解析器
-// class ParallelAutoDetectParser : public AbstractStackParser {
-//   private:
-//     std::unique_ptr<AbstractStackParser> actual_parser_;
-//     static constexpr int MAX_PREVIEW_LINE = 128;
-
-//   public:
-//     StackSamples parse(std::string_view buffer) override {
-//         detect_format(buffer);
-//         if (! actual_parser_) {
-//             throw ParseException(std::string("Unable to detect file format"));
-//         }
-
-//         return actual_parser_->parse(buffer);
-//     }
-
-//     std::string_view get_parser_name() const override {
-//         return "ParallelAutoDetectParser";
-//     }
-
-//   private:
-//     void detect_format(std::string_view buffer) {
-//         size_t start = 0;
-//         int lines_checked = 0;
-//         bool has_perf_format = false;
-
-//         while (start < buffer.size() && lines_checked < MAX_PREVIEW_LINE) {
-//             size_t end = buffer.find('\n', start);
-//             if (end == std::string_view::npos) end = buffer.size();
-
-//             std::string_view line = buffer.substr(start, end - start);
-//             line = trim(line);
-
-//             if (! line.empty()) {
-//                 if (is_like_perf(line)) {
-//                     has_perf_format = true;
-//                     break;
-//                 }
-//             }
-
-//             lines_checked++;
-//             start = end + 1;
-//         }
-
-//         if (has_perf_format) {
-//             actual_parser_ = std::make_unique<ParallelPerfScriptParser>();
-//         } else {
-//             actual_parser_ = std::make_unique<GenericTextParser>();
-//         }
-//     }
-
-//     bool is_like_perf(std::string_view line) {
-//         return line.find("cycles:") != std::string_view::npos || line.find("instructions:") != std::string_view::npos ||
-//                (line.find_first_of("0123456789abcdef") == 0 && line.find("(") != std::string_view::npos);
-//     }
-// };
-
-// // 更新的火焰图生成器，使用并行组件
-// class ParallelFlameGraphGenerator {
-//   private:
-//     FlameGraphConfig config_;
-//     StackCollapseOptions collapse_opts_;
-//     FlameGraphBuildOptions build_opts_;
-
-//   public:
-//     explicit ParallelFlameGraphGenerator(const FlameGraphConfig& config = {}) : config_(config) {
-//         config_.validate();
-//     }
-
-//     void generate(std::string_view in_file, std::string_view out_file) {
-//         auto parser = std::make_unique<ParallelAutoDetectParser>();
-//         ParallelStackCollapser collapser;
-//         FlameGraphBuilder builder;
-//         auto suffix = file_suffix(out_file);
-//         if (suffix.empty()) {
-//             throw FlameGraphException(std::string("File suffix empty") + out_file.data());
-//         }
-//         auto renderer = FlameGraphRendererFactory::create(suffix);
-
-//         try {
-//             MMapBuffer buffer(in_file);
-
-//             // 并行解析原始数据
-//             StackSamples samples = parser->parse(buffer.view());
-
-//             if (samples.empty()) {
-//                 throw FlameGraphException("No valid samples found in input file");
-//             }
-
-//             // 并行折叠堆栈
-//             CollapsedStack collapsed = collapser.collapse(samples, collapse_opts_);
-
-//             if (collapsed.empty()) {
-//                 throw FlameGraphException("No stacks remained after collapsing");
-//             }
-
-//             if (config_.write_folded_file) {
-//                 collapser.write_folded_file(collapsed, std::string(out_file) + ".collapse");
-//             }
-
-//             // 构建树（这部分较难并行化，保持原样）
-//             build_opts_.max_depth = config_.max_depth;
-//             build_opts_.prune_threshold = config_.min_heat_threshold;
-//             FlameNodeRoot root = builder.build_tree(collapsed, build_opts_);
-
-//             if (root.node->total_count == 0) {
-//                 throw FlameGraphException("Tree has no samples");
-//             }
-
-//             renderer->render(root, out_file);
-
-//         } catch (const std::exception& e) {
-//             throw FlameGraphException("Generation failed: " + std::string(e.what()));
-//         }
-//     }
-
-//     void set_config(const FlameGraphConfig& config) {
-//         config.validate();
-//         config_ = config;
-//     }
-
-//     const FlameGraphConfig& get_config() const {
-//         return config_;
-//     }
-// };
-
-// } // namespace flamegraph
+#pragma once
+
+#include "flamegraph.hpp"
+#include "thread_pool.hpp"
+
+#include <cctype>
+#include <map>
+#include <mutex>
+#include <unordered_set>
+
+#include <glob.h>
+
+// 在原有的头文件基础上添加并行化支持
+// 每个阶段（解析、折叠、建树、渲染）都并行化, 输出与 FlameGraphGenerator 逐字节一致
+
+namespace flamegraph {
+
+// 🔥 ===== 每线程 arena =====
+
+// 每个执行线程一个 GenerationArena, 线程只从自己的 arena 分配, 因此无需加锁
+class ArenaSet {
+  private:
+    std::vector<std::unique_ptr<GenerationArena>> arenas_;
+
+  public:
+    ArenaSet(size_t count, bool reuse = false, const ArenaPolicy& policy = {}) {
+        for (size_t i = 0; i < std::max<size_t>(1, count); ++i) {
+            arenas_.push_back(std::make_unique<GenerationArena>(reuse, policy));
+        }
+    }
+
+    size_t size() const {
+        return arenas_.size();
+    }
+
+    GenerationArena& operator[](size_t index) {
+        return *arenas_[index];
+    }
+
+    // 当前执行线程的 arena
+    std::pmr::memory_resource* local(const ParallelExecutor& executor) {
+        return arenas_[executor.worker_index() % arenas_.size()]->resource();
+    }
+
+    void set_reuse(bool reuse) {
+        for (auto& arena : arenas_) {
+            arena->set_reuse(reuse);
+        }
+    }
+
+    void set_policy(const ArenaPolicy& policy) {
+        for (auto& arena : arenas_) {
+            arena->set_policy(policy);
+        }
+    }
+
+    void release() {
+        for (auto& arena : arenas_) {
+            arena->release();
+        }
+    }
+
+    size_t bytes_reserved() const {
+        size_t bytes = 0;
+        for (const auto& arena : arenas_) {
+            bytes += arena->bytes_reserved();
+        }
+        return bytes;
+    }
+};
+
+struct ArenaSetReleaseGuard {
+    ArenaSet& arenas;
+
+    ~ArenaSetReleaseGuard() {
+        arenas.release();
+    }
+};
+
+// 🔥 ===== 并行解析 =====
+
+// 一个分块的解析结果, 样本内存由分块自己的 context 持有
+struct SampleChunk {
+    StackSamplesContext ctx;
+    StackSamples samples{ctx.create_samples()};
+
+    explicit SampleChunk(std::pmr::memory_resource* upstream = std::pmr::get_default_resource()) : ctx(upstream) {}
+    SampleChunk(const SampleChunk&) = delete;
+    SampleChunk& operator=(const SampleChunk&) = delete;
+};
+
+using SampleChunks = std::vector<std::unique_ptr<SampleChunk>>;
+
+inline size_t total_sample_count(ParallelExecutor& executor, const SampleChunks& chunks) {
+    return executor.parallel_reduce(
+        size_t{0},
+        chunks.size(),
+        size_t{0},
+        [&](size_t begin, size_t end, size_t total) {
+            for (size_t i = begin; i < end; ++i) {
+                total += chunks[i]->samples.raw_samples.size();
+            }
+            return total;
+        },
+        [](size_t a, size_t b) { return a + b; });
+}
+
+inline size_t total_line_count(const SampleChunks& chunks) {
+    size_t total = 0;
+    for (const auto& chunk : chunks) {
+        total += chunk->samples.line_count;
+    }
+    return total;
+}
+
+// 把一个分块的样本与 Frame 分配计入统计
+inline void add_chunk_allocations(const SampleChunk& chunk, AllocationStats& samples, AllocationStats& frames) {
+    samples += chunk.ctx.samples_allocations();
+    frames += chunk.ctx.frames_allocations();
+}
+
+class ParallelStackParser {
+  private:
+    static constexpr size_t MIN_CHUNK_BYTES = 64 * 1024; // 分块太小时调度开销大于收益
+    ParallelExecutor& executor_;
+    size_t chunk_count_;
+    ArenaSet* arenas_;
+    ParseOptions options_;
+    ProgressReporter* progress_ = nullptr;
+
+  public:
+    // 给出 arenas 时, 每个分块的样本分配在解析它的线程的 arena 中（NUMA 本地）, 须在 arenas 释放前销毁分块
+    ParallelStackParser(ParallelExecutor& executor, size_t chunk_count, ArenaSet* arenas = nullptr)
+        : executor_(executor), chunk_count_(std::max<size_t>(1, chunk_count)), arenas_(arenas) {}
+
+    // 按已解析的字节数汇报
+    void set_progress(ProgressReporter* progress) {
+        progress_ = progress;
+    }
+
+    void set_parse_options(const ParseOptions& options) {
+        options_ = options;
+    }
+
+    // 在样本边界处切块, 每块用串行解析器独立解析; 分块按文件顺序排列
+    SampleChunks parse(std::string_view buffer) const {
+        auto parser = AutoDetectParser::detect_parser(buffer, options_);
+        auto ranges = split_chunks(buffer, *parser);
+
+        SampleChunks chunks(ranges.size());
+        executor_.parallel_for(size_t{0}, ranges.size(), [&](size_t i) {
+            TraceSpan span("parse", "parse chunk", i);
+            auto [begin, end] = ranges[i];
+            chunks[i] = arenas_ ? std::make_unique<SampleChunk>(arenas_->local(executor_))
+                                : std::make_unique<SampleChunk>();
+            parse_with_progress(*parser, buffer.substr(begin, end - begin), chunks[i]->ctx, chunks[i]->samples,
+                                progress_);
+        }, 1);
+
+        return chunks;
+    }
+
+    std::string_view get_parser_name() const {
+        return "ParallelStackParser";
+    }
+
+  private:
+    std::vector<std::pair<size_t, size_t>> split_chunks(std::string_view buffer,
+                                                        const AbstractStackParser& parser) const {
+        size_t count = std::min(chunk_count_, std::max<size_t>(1, buffer.size() / MIN_CHUNK_BYTES));
+
+        std::vector<std::pair<size_t, size_t>> ranges;
+        ranges.reserve(count);
+        size_t begin = 0;
+        for (size_t i = 1; i <= count && begin < buffer.size(); ++i) {
+            size_t end = buffer.size();
+            if (i < count) {
+                size_t nominal = std::max(begin, buffer.size() / count * i);
+                end = parser.next_chunk_boundary(buffer, nominal);
+            }
+            if (end > begin) {
+                ranges.emplace_back(begin, end);
+            }
+            begin = end;
+        }
+        return ranges;
+    }
+};
+
+// 🔥 ===== 并行折叠 =====
+using CollapsedEntry = std::pair<FramesView, size_t>;
+using CollapsedEntries = std::vector<CollapsedEntry>;
+
+// 分组键: 数值类键用 id, 名字类键用 name
+struct PartitionKey {
+    uint64_t id = 0;
+    std::string_view name;
+
+    bool operator==(const PartitionKey& other) const {
+        return id == other.id && name == other.name;
+    }
+
+    bool operator<(const PartitionKey& other) const {
+        return id != other.id ? id < other.id : name < other.name;
+    }
+
+    struct Hasher {
+        size_t operator()(const PartitionKey& key) const noexcept {
+            return std::hash<uint64_t>{}(key.id) * 31 + std::hash<std::string_view>{}(key.name);
+        }
+    };
+};
+
+// 一组样本的折叠结果
+struct Partition {
+    PartitionKey key;
+    size_t sample_count = 0;
+    CollapsedEntries entries;
+};
+
+using Partitions = std::vector<Partition>;
+
+class ParallelStackCollapser {
+  private:
+    ParallelExecutor& executor_;
+    size_t shard_count_;
+    ProgressReporter* progress_ = nullptr;
+    HashTableHealth* diagnostics_ = nullptr;
+
+    // 对 hash 再做一次乘法散列, 避免分片与分片内哈希表的桶下标相关
+    static size_t shard_of(size_t hash, size_t shards) {
+        return static_cast<size_t>((static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ULL) >> 32) % shards;
+    }
+
+  public:
+    ParallelStackCollapser(ParallelExecutor& executor, size_t shard_count)
+        : executor_(executor), shard_count_(std::max<size_t>(1, shard_count)) {}
+
+    // 分块折叠时每个样本 tick 一次, 合并阶段按分片检查取消
+    void set_progress(ProgressReporter* progress) {
+        progress_ = progress;
+    }
+
+    // 给出时 collapse 把各分块局部表的健康度累加到 diagnostics
+    void set_diagnostics(HashTableHealth* diagnostics) {
+        diagnostics_ = diagnostics;
+    }
+
+    using LocalMap = std::unordered_map<FramesView, size_t, FramesView::Hasher, FramesView::Equal>;
+
+    // 结果按 FramesView::Less 排序, 与串行 write_folded_file 的顺序一致, 也是并行建树的前提
+    CollapsedEntries collapse(const SampleChunks& chunks, const StackCollapseOptions& options = {}) const {
+        // 每个分块内部折叠
+        std::vector<LocalMap> locals(chunks.size());
+        std::vector<size_t> rehashes(chunks.size(), 0);
+        executor_.parallel_for(size_t{0}, chunks.size(), [&](size_t c) {
+            TraceSpan span("collapse", "collapse chunk", c);
+            auto& local = locals[c];
+            size_t buckets = local.bucket_count();
+            local.reserve(std::min(options.expected_unique_stacks, chunks[c]->samples.raw_samples.size()));
+            for (const auto& sample : chunks[c]->samples.raw_samples) {
+                local[FramesView{sample.frames}] += sample.count;
+                if (local.bucket_count() != buckets) {
+                    buckets = local.bucket_count();
+                    ++rehashes[c];
+                }
+                progress_tick(progress_);
+            }
+        }, 1);
+
+        if (diagnostics_ != nullptr) {
+            for (size_t c = 0; c < locals.size(); ++c) {
+                diagnostics_->add_table(locals[c]);
+                diagnostics_->rehashes += rehashes[c];
+            }
+        }
+        return merge(locals);
+    }
+
+    // 合并若干局部折叠结果: 按 hash 分片后各分片独立合并, 最后拼接并排序
+    CollapsedEntries merge(const std::vector<LocalMap>& locals) const {
+        std::vector<const LocalMap*> pointers;
+        pointers.reserve(locals.size());
+        for (const auto& local : locals) {
+            pointers.push_back(&local);
+        }
+        return merge(pointers);
+    }
+
+    CollapsedEntries merge(const std::vector<const LocalMap*>& locals) const {
+        // 1. 局部结果按 hash 分散到各个分片
+        std::vector<std::vector<CollapsedEntries>> scattered(locals.size());
+        executor_.parallel_for(size_t{0}, locals.size(), [&](size_t c) {
+            TraceSpan span("collapse", "scatter", c);
+            check_cancelled(progress_);
+            auto& shards = scattered[c];
+            shards.resize(shard_count_);
+            for (const auto& [view, count] : *locals[c]) {
+                shards[shard_of(view.computed_hash(), shard_count_)].emplace_back(view, count);
+            }
+        }, 1);
+
+        // 2. 每个分片独立合并, 同一个堆栈只会落在同一个分片
+        std::vector<CollapsedEntries> merged(shard_count_);
+        executor_.parallel_for(size_t{0}, shard_count_, [&](size_t s) {
+            TraceSpan span("collapse", "merge shard", s);
+            check_cancelled(progress_);
+            size_t upper = 0;
+            for (const auto& shards : scattered) {
+                upper += shards[s].size();
+            }
+
+            LocalMap shard_map;
+            shard_map.reserve(upper);
+            for (const auto& shards : scattered) {
+                for (const auto& [view, count] : shards[s]) {
+                    shard_map[view] += count;
+                }
+            }
+            merged[s].assign(shard_map.begin(), shard_map.end());
+        }, 1);
+
+        // 3. 拼接并排序
+        std::vector<size_t> offsets(shard_count_ + 1, 0);
+        for (size_t s = 0; s < shard_count_; ++s) {
+            offsets[s + 1] = offsets[s] + merged[s].size();
+        }
+
+        CollapsedEntries entries(offsets.back());
+        executor_.parallel_for(size_t{0}, shard_count_, [&](size_t s) {
+            std::copy(merged[s].begin(), merged[s].end(), entries.begin() + static_cast<std::ptrdiff_t>(offsets[s]));
+        });
+
+        TraceSpan span("collapse", "sort");
+        executor_.parallel_sort(entries.begin(), entries.end(), [](const CollapsedEntry& a, const CollapsedEntry& b) {
+            return FramesView::Less{}(a.first, b.first);
+        });
+        // 比较函数是最热的循环, 不在其中检查; 排序结束后再检查一次取消
+        check_cancelled(progress_);
+
+        return entries;
+    }
+
+    // 按 key_of(sample) 把样本分成互不相交的若干组, 每组单独折叠; 结果按键排序
+    template <typename KeyOf>
+    Partitions collapse_partitioned(const SampleChunks& chunks, KeyOf&& key_of) const {
+        struct Group {
+            size_t sample_count = 0;
+            LocalMap stacks;
+        };
+        using GroupMap = std::unordered_map<PartitionKey, Group, PartitionKey::Hasher>;
+
+        // 每个分块内部按键分组并折叠
+        std::vector<GroupMap> per_chunk(chunks.size());
+        executor_.parallel_for(size_t{0}, chunks.size(), [&](size_t c) {
+            TraceSpan span("collapse", "partition chunk", c);
+            for (const auto& sample : chunks[c]->samples.raw_samples) {
+                Group& group = per_chunk[c][key_of(sample)];
+                ++group.sample_count;
+                group.stacks[FramesView{sample.frames}] += sample.count;
+                progress_tick(progress_);
+            }
+        }, 1);
+
+        // 汇总所有键, 同一个键的局部结果再合并
+        std::map<PartitionKey, std::vector<const Group*>> by_key;
+        for (const auto& groups : per_chunk) {
+            for (const auto& [key, group] : groups) {
+                by_key[key].push_back(&group);
+            }
+        }
+
+        Partitions partitions;
+        partitions.reserve(by_key.size());
+        for (const auto& entry : by_key) {
+            partitions.emplace_back();
+            partitions.back().key = entry.first;
+        }
+
+        executor_.parallel_for(size_t{0}, partitions.size(), [&](size_t p) {
+            TraceSpan span("collapse", "merge partition", p);
+            const auto& groups = by_key.at(partitions[p].key);
+            std::vector<const LocalMap*> locals;
+            locals.reserve(groups.size());
+            for (const Group* group : groups) {
+                partitions[p].sample_count += group->sample_count;
+                locals.push_back(&group->stacks);
+            }
+            partitions[p].entries = merge(locals);
+        }, 1);
+
+        return partitions;
+    }
+
+    // 分块并行格式化, 按顺序写出
+    void write_folded_file(const CollapsedEntries& entries, std::string_view filename) const {
+        constexpr size_t LINES_PER_BLOCK = 4096;
+        size_t blocks = (entries.size() + LINES_PER_BLOCK - 1) / LINES_PER_BLOCK;
+        std::vector<std::string> texts(blocks);
+
+        executor_.parallel_for(size_t{0}, blocks, [&](size_t b) {
+            TraceSpan span("collapse", "format folded block", b);
+            std::ostringstream oss;
+            size_t end = std::min(entries.size(), (b + 1) * LINES_PER_BLOCK);
+            for (size_t i = b * LINES_PER_BLOCK; i < end; ++i) {
+                StackCollapser::write_folded_line(oss, entries[i].first, entries[i].second);
+            }
+            texts[b] = oss.str();
+        }, 1);
+
+        std::ofstream ofs(filename.data(), std::ios::binary);
+        if (! ofs.is_open()) {
+            throw OpenFileException(filename);
+        }
+        for (const auto& text : texts) {
+            ofs.write(text.data(), static_cast<std::streamsize>(text.size()));
+        }
+    }
+};
+
+// 🔥 ===== 并行符号改写 =====
+
+/**
+ * @brief 还原/整理折叠结果中的函数名, 见 SymbolRewriter
+ *
+ * 收集与替换按堆栈分块并行, 改写按符号并行; 替换后的 Frame 数组分配在各线程自己的 arena 中,
+ * 结果重新按 FramesView::Less 排序, 改写后相同的相邻堆栈合并为一条
+ */
+inline CollapsedEntries rewrite_symbols(ParallelExecutor& executor,
+                                        ArenaSet& arenas,
+                                        SymbolRewriter& rewriter,
+                                        const CollapsedEntries& entries,
+                                        ProgressReporter* progress = nullptr) {
+    constexpr size_t STACKS_PER_BLOCK = 4096;
+    size_t blocks = (entries.size() + STACKS_PER_BLOCK - 1) / STACKS_PER_BLOCK;
+    auto block_end = [&](size_t b) { return std::min(entries.size(), (b + 1) * STACKS_PER_BLOCK); };
+
+    // 1. 各块收集自己见到的不同符号, 再按块的顺序登记, 登记顺序与线程调度无关
+    std::vector<std::unordered_set<std::string_view>> names(blocks);
+    executor.parallel_for(size_t{0}, blocks, [&](size_t b) {
+        TraceSpan span("collapse", "collect symbols", b);
+        check_cancelled(progress);
+        for (size_t i = b * STACKS_PER_BLOCK; i < block_end(b); ++i) {
+            const FramesView& view = entries[i].first;
+            for (size_t f = 0; f < view.size; ++f) {
+                if (rewriter.needs_rewrite(view.frame_arr[f])) {
+                    names[b].insert(view.frame_arr[f].name);
+                }
+            }
+        }
+    }, 1);
+    for (const auto& block : names) {
+        for (std::string_view name : block) {
+            rewriter.collect(name);
+        }
+    }
+
+    // 2. 每个不同的符号改写一次
+    rewriter.set_progress(progress);
+    begin_stage(progress, "rewrite symbols", rewriter.pending());
+    rewriter.resolve([&](size_t count, const auto& body) { executor.parallel_for(size_t{0}, count, body); });
+    finish_stage(progress);
+    if (rewriter.rewritten_count() == 0) {
+        return entries;
+    }
+
+    // 3. 替换名字, 重新排序并合并
+    CollapsedEntries rewritten(entries.size());
+    executor.parallel_for(size_t{0}, blocks, [&](size_t b) {
+        TraceSpan span("collapse", "rewrite stacks", b);
+        check_cancelled(progress);
+        std::pmr::memory_resource* arena = arenas.local(executor);
+        for (size_t i = b * STACKS_PER_BLOCK; i < block_end(b); ++i) {
+            rewritten[i] = {rewriter.rewrite(entries[i].first, arena), entries[i].second};
+        }
+    }, 1);
+
+    executor.parallel_sort(rewritten.begin(), rewritten.end(), [](const CollapsedEntry& a, const CollapsedEntry& b) {
+        return FramesView::Less{}(a.first, b.first);
+    });
+    check_cancelled(progress);
+    size_t kept = 0;
+    for (size_t i = 0; i < rewritten.size(); ++i) {
+        if (kept > 0 && FramesView::Equal{}(rewritten[kept - 1].first, rewritten[i].first)) {
+            rewritten[kept - 1].second += rewritten[i].second;
+        } else {
+            rewritten[kept++] = rewritten[i];
+        }
+    }
+    rewritten.resize(kept);
+    return rewritten;
+}
+
+// 🔥 ===== 流水线: 解析与折叠重叠执行 =====
+struct PipelineOptions {
+    bool enabled = false;           // 是否启用流水线模式
+    size_t chunk_bytes = 1 << 20;   // 每个解析块的大小
+    size_t queue_capacity = 0;      // 已解析但尚未折叠的块数上限, 0 表示 2 × 线程数
+};
+
+/**
+ * @brief 边解析边折叠
+ *
+ * 解析好的块进入有界队列, 由其它线程取出折叠; 每个线程在队列较空时解析新块, 否则折叠已有块,
+ * 因此任意线程数（包括 1）下都不会死锁, 而队列满时自动转去消费, 内存被限制在 capacity 个块以内
+ * 新出现的堆栈会把 Frame 复制到线程自己的 arena 中（只复制 string_view, 不复制字符串）,
+ * 这样块折叠完即可释放, 不必等到整个文件解析结束
+ */
+class PipelinedStackCollapser {
+  public:
+    struct Result {
+        CollapsedEntries entries; // 其中的 Frame 位于 arenas 中
+        size_t sample_count = 0;
+        size_t line_count = 0;
+        AllocationStats samples_memory;
+        AllocationStats frames_memory;
+    };
+
+  private:
+    ParallelExecutor& executor_;
+    ArenaSet& arenas_;
+    const ParallelStackCollapser& collapser_;
+    PipelineOptions options_;
+    size_t parallelism_;
+    ParseOptions parse_opts_;
+    ProgressReporter* progress_ = nullptr;
+
+  public:
+    // parallelism 为参与流水线的线程数上限, 0 表示执行器的全部线程
+    PipelinedStackCollapser(ParallelExecutor& executor,
+                            ArenaSet& arenas,
+                            const ParallelStackCollapser& collapser,
+                            const PipelineOptions& options,
+                            size_t parallelism = 0)
+        : executor_(executor), arenas_(arenas), collapser_(collapser), options_(options), parallelism_(parallelism) {}
+
+    // 按已解析的字节数汇报; 每个角色每轮循环检查一次取消, 所有角色一起退出
+    void set_progress(ProgressReporter* progress) {
+        progress_ = progress;
+    }
+
+    void set_parse_options(const ParseOptions& options) {
+        parse_opts_ = options;
+    }
+
+    Result run(std::string_view buffer, const StackCollapseOptions& collapse_opts = {}) const {
+        auto parser = AutoDetectParser::detect_parser(buffer, parse_opts_);
+        auto ranges = split_chunks(buffer, *parser);
+
+        // 每个角色独占一个 arena; 角色之间不嵌套并行, 所以与线程编号无关
+        size_t roles = std::min(executor_.concurrency(), arenas_.size());
+        if (parallelism_ > 0) {
+            roles = std::min(roles, parallelism_);
+        }
+        size_t capacity = options_.queue_capacity == 0 ? roles * 2 : options_.queue_capacity;
+        BoundedQueue<SampleChunk*> queue(capacity);
+
+        Result result;
+        std::vector<ParallelStackCollapser::LocalMap> locals(roles);
+        std::vector<size_t> sample_counts(roles, 0);
+        std::vector<size_t> line_counts(roles, 0);
+        std::vector<AllocationStats> samples_memory(roles);
+        std::vector<AllocationStats> frames_memory(roles);
+        // 各角色只看到一部分样本, 按角色数均分预估值, 预分配总量不随角色数增长
+        for (auto& local : locals) {
+            local.reserve((collapse_opts.expected_unique_stacks + roles - 1) / roles);
+        }
+
+        std::atomic<size_t> next_chunk{0};
+        std::atomic<size_t> folded_chunks{0};
+        const size_t total_chunks = ranges.size();
+
+        auto fold = [&](size_t r, std::unique_ptr<SampleChunk> chunk) {
+            TraceSpan span("collapse", "fold chunk");
+            auto& local = locals[r];
+            std::pmr::polymorphic_allocator<Frame> alloc(arenas_[r].resource());
+            for (const auto& sample : chunk->samples.raw_samples) {
+                FramesView view{sample.frames};
+                auto it = local.find(view);
+                if (it != local.end()) {
+                    it->second += sample.count;
+                    continue;
+                }
+                Frame* copy = alloc.allocate(view.size);
+                std::uninitialized_copy(view.frame_arr, view.frame_arr + view.size, copy);
+                FramesView owned{copy, view.size};
+                owned.precomputed_hash = view.precomputed_hash;
+                local.emplace(owned, sample.count);
+            }
+            sample_counts[r] += chunk->samples.raw_samples.size();
+            line_counts[r] += chunk->samples.line_count;
+            add_chunk_allocations(*chunk, samples_memory[r], frames_memory[r]);
+            folded_chunks.fetch_add(1, std::memory_order_acq_rel);
+        };
+
+        auto parse = [&](size_t index) {
+            TraceSpan span("parse", "parse chunk", index);
+            auto chunk = std::make_unique<SampleChunk>();
+            auto [begin, end] = ranges[index];
+            parse_with_progress(*parser, buffer.substr(begin, end - begin), chunk->ctx, chunk->samples, progress_);
+            return chunk;
+        };
+
+        // 一个角色出错或被取消后其它角色也退出, 否则它们会一直等待永远不会折叠完的块
+        std::atomic<bool> failed{false};
+        try {
+            executor_.parallel_for(size_t{0}, roles, [&](size_t r) {
+                try {
+                    while (! failed.load(std::memory_order_relaxed) &&
+                           folded_chunks.load(std::memory_order_acquire) < total_chunks) {
+                        check_cancelled(progress_);
+
+                        // 队列不到一半时优先解析, 让解析跑在折叠前面
+                        bool parse_ahead = queue.size_approx() < queue.capacity() / 2;
+                        SampleChunk* ready = nullptr;
+                        if (! parse_ahead && queue.try_pop(ready)) {
+                            fold(r, std::unique_ptr<SampleChunk>(ready));
+                            continue;
+                        }
+
+                        if (next_chunk.load(std::memory_order_relaxed) < total_chunks) {
+                            size_t index = next_chunk.fetch_add(1, std::memory_order_relaxed);
+                            if (index < total_chunks) {
+                                auto chunk = parse(index);
+                                if (queue.try_push(chunk.get())) {
+                                    chunk.release();
+                                } else {
+                                    fold(r, std::move(chunk)); // 队列已满: 背压, 自己折叠
+                                }
+                                continue;
+                            }
+                        }
+
+                        if (queue.try_pop(ready)) {
+                            fold(r, std::unique_ptr<SampleChunk>(ready));
+                        } else {
+                            std::this_thread::yield(); // 其它线程手中还有未完成的块
+                        }
+                    }
+                } catch (...) {
+                    failed.store(true, std::memory_order_relaxed);
+                    throw;
+                }
+            }, 1);
+        } catch (...) {
+            // 队列中已解析未折叠的块由这里释放
+            SampleChunk* orphan = nullptr;
+            while (queue.try_pop(orphan)) {
+                delete orphan;
+            }
+            throw;
+        }
+
+        for (size_t r = 0; r < roles; ++r) {
+            result.sample_count += sample_counts[r];
+            result.line_count += line_counts[r];
+            result.samples_memory += samples_memory[r];
+            result.frames_memory += frames_memory[r];
+        }
+        result.entries = collapser_.merge(locals);
+        return result;
+    }
+
+  private:
+    std::vector<std::pair<size_t, size_t>> split_chunks(std::string_view buffer,
+                                                        const AbstractStackParser& parser) const {
+        std::vector<std::pair<size_t, size_t>> ranges;
+        size_t step = std::max<size_t>(1, options_.chunk_bytes);
+        size_t begin = 0;
+        while (begin < buffer.size()) {
+            size_t nominal = begin + step;
+            size_t end = nominal >= buffer.size() ? buffer.size() : parser.next_chunk_boundary(buffer, nominal);
+            ranges.emplace_back(begin, end);
+            begin = end;
+        }
+        return ranges;
+    }
+};
+
+// 🔥 ===== 多文件输入 =====
+
+// 展开输入列表中的通配符（* ? [）, 结果按文件名排序; 不含通配符的项原样保留
+inline std::vector<std::string> expand_input_patterns(const std::vector<std::string>& patterns) {
+    std::vector<std::string> files;
+    for (const auto& pattern : patterns) {
+        if (pattern.find_first_of("*?[") == std::string::npos) {
+            files.push_back(pattern);
+            continue;
+        }
+
+        glob_t matches{};
+        int rc = glob(pattern.c_str(), 0, nullptr, &matches);
+        if (rc != 0) {
+            globfree(&matches);
+            throw FileNotFoundException(pattern);
+        }
+        for (size_t i = 0; i < matches.gl_pathc; ++i) {
+            files.emplace_back(matches.gl_pathv[i]);
+        }
+        globfree(&matches);
+    }
+    return files;
+}
+
+/**
+ * @brief 多个文件共享的 Frame 名字驻留表
+ *
+ * 名字复制到表自己的内存中, 所有文件里相同的名字只存一份; 折叠结果只引用驻留后的名字,
+ * 因此每个文件折叠完即可 munmap, 不必等所有文件处理完。按 hash 分片加锁, 减少线程间争用
+ */
+class FrameInternTable {
+  private:
+    static constexpr size_t SHARD_COUNT = 64;
+
+    struct Shard {
+        std::mutex mutex;
+        std::pmr::monotonic_buffer_resource storage;
+        std::unordered_set<std::string_view> names;
+    };
+
+    std::unique_ptr<Shard[]> shards_;
+
+  public:
+    FrameInternTable() : shards_(std::make_unique<Shard[]>(SHARD_COUNT)) {}
+
+    std::string_view intern(std::string_view name) {
+        size_t hash = std::hash<std::string_view>{}(name);
+        Shard& shard = shards_[hash % SHARD_COUNT];
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.names.find(name);
+        if (it != shard.names.end()) {
+            return *it;
+        }
+        auto* data = static_cast<char*>(shard.storage.allocate(std::max<size_t>(1, name.size()), 1));
+        std::copy(name.begin(), name.end(), data);
+        std::string_view owned(data, name.size());
+        shard.names.insert(owned);
+        return owned;
+    }
+
+    // 把一条堆栈复制到 arena 中, 名字替换为驻留后的版本
+    FramesView own(const FramesView& view, std::pmr::memory_resource* arena) {
+        std::pmr::polymorphic_allocator<Frame> alloc(arena);
+        Frame* copy = alloc.allocate(view.size);
+        for (size_t i = 0; i < view.size; ++i) {
+            const Frame& frame = view.frame_arr[i];
+            Frame* owned = new (copy + i) Frame(intern(frame.name), frame.is_func, frame.lib_include_brackets, frame.annotations);
+            owned->precomputed_hash = frame.precomputed_hash;
+        }
+        FramesView result{copy, view.size};
+        result.precomputed_hash = view.precomputed_hash;
+        return result;
+    }
+};
+
+// 每个输入文件的统计
+struct InputFileStats {
+    std::string path;
+    size_t bytes = 0;
+    size_t lines = 0;
+    size_t samples = 0;
+};
+
+/**
+ * @brief 多个输入文件并行解析、折叠, 合并为一份折叠结果
+ *
+ * 每个线程依次领取整个文件: mmap -> 解析 -> 折叠进线程自己的表 -> munmap,
+ * 文件之间互不等待, 也不需要事先把文件拼接在一起
+ */
+class MultiFileStackCollapser {
+  public:
+    struct Result {
+        CollapsedEntries entries; // 其中的 Frame 位于 arenas 中, 名字位于 interned 中
+        std::vector<InputFileStats> files;
+        size_t sample_count = 0;
+        size_t line_count = 0;
+        AllocationStats samples_memory;
+        AllocationStats frames_memory;
+    };
+
+  private:
+    ParallelExecutor& executor_;
+    ArenaSet& arenas_;
+    FrameInternTable& interned_;
+    const ParallelStackCollapser& collapser_;
+    size_t parallelism_;
+    ParseOptions parse_opts_;
+    ProgressReporter* progress_ = nullptr;
+
+  public:
+    MultiFileStackCollapser(ParallelExecutor& executor,
+                            ArenaSet& arenas,
+                            FrameInternTable& interned,
+                            const ParallelStackCollapser& collapser,
+                            size_t parallelism = 0)
+        : executor_(executor), arenas_(arenas), interned_(interned), collapser_(collapser), parallelism_(parallelism) {}
+
+    // 按已解析的字节数汇报（总量为所有文件大小之和）
+    void set_progress(ProgressReporter* progress) {
+        progress_ = progress;
+    }
+
+    void set_parse_options(const ParseOptions& options) {
+        parse_opts_ = options;
+    }
+
+    Result run(const std::vector<std::string>& paths, const StackCollapseOptions& collapse_opts = {}) const {
+        size_t roles = std::min({executor_.concurrency(), arenas_.size(), std::max<size_t>(1, paths.size())});
+        if (parallelism_ > 0) {
+            roles = std::min(roles, parallelism_);
+        }
+
+        Result result;
+        result.files.resize(paths.size());
+        std::vector<ParallelStackCollapser::LocalMap> locals(roles);
+        for (auto& local : locals) {
+            local.reserve((collapse_opts.expected_unique_stacks + roles - 1) / roles);
+        }
+        std::vector<AllocationStats> samples_memory(roles);
+        std::vector<AllocationStats> frames_memory(roles);
+
+        std::atomic<size_t> next_file{0};
+        executor_.parallel_for(size_t{0}, roles, [&](size_t r) {
+            for (size_t f = next_file.fetch_add(1); f < paths.size(); f = next_file.fetch_add(1)) {
+                TraceSpan span("parse", "parse file", f);
+                InputFileStats& stats = result.files[f];
+                stats.path = paths[f];
+                // 大小取自读到的内容: FIFO、/dev/fd/N 和 "-" 没有文件大小, procfs 一类的文件报告为 0
+                MMapBuffer buffer(paths[f]);
+                stats.bytes = buffer.size;
+                if (stats.bytes == 0) {
+                    continue;
+                }
+
+                auto parser = AutoDetectParser::detect_parser(buffer.view(), parse_opts_);
+                SampleChunk chunk;
+                parse_with_progress(*parser, buffer.view(), chunk.ctx, chunk.samples, progress_);
+
+                auto& local = locals[r];
+                for (const auto& sample : chunk.samples.raw_samples) {
+                    FramesView view{sample.frames};
+                    auto it = local.find(view);
+                    if (it != local.end()) {
+                        it->second += sample.count;
+                    } else {
+                        local.emplace(interned_.own(view, arenas_[r].resource()), sample.count);
+                    }
+                }
+                stats.samples = chunk.samples.raw_samples.size();
+                stats.lines = chunk.samples.line_count;
+                add_chunk_allocations(chunk, samples_memory[r], frames_memory[r]);
+            }
+        }, 1);
+
+        for (const auto& stats : result.files) {
+            result.sample_count += stats.samples;
+            result.line_count += stats.lines;
+        }
+        for (size_t r = 0; r < roles; ++r) {
+            result.samples_memory += samples_memory[r];
+            result.frames_memory += frames_memory[r];
+        }
+        result.entries = collapser_.merge(locals);
+        return result;
+    }
+};
+
+// 🔥 ===== 并行建树 =====
+class ParallelFlameGraphBuilder {
+  private:
+    static constexpr size_t PARALLEL_GRAIN = 1024; // 区间内堆栈数小于此值时串行构建
+    ParallelExecutor& executor_;
+    ArenaSet& arenas_;
+    std::vector<std::unique_ptr<CountingResource>> memory_; // 每个 arena 前面一个计数资源, 须活到树不再使用
+    size_t node_count_ = 0;
+    size_t pruned_nodes_ = 0;
+    mutable std::atomic<size_t> children_rehashes_{0}; // 各线程在 build_range 中累加
+    ProgressReporter* progress_ = nullptr;
+
+  public:
+    ParallelFlameGraphBuilder(ParallelExecutor& executor, ArenaSet& arenas) : executor_(executor), arenas_(arenas) {
+        for (size_t i = 0; i < arenas_.size(); ++i) {
+            memory_.push_back(std::make_unique<CountingResource>(arenas_[i].resource()));
+        }
+    }
+
+    // 与串行版本相同, 按堆栈计: 每条堆栈在它结束的节点处 tick 一次
+    void set_progress(ProgressReporter* progress) {
+        progress_ = progress;
+    }
+
+    // 树节点及其 children 表的分配, 合计所有线程
+    AllocationStats allocations() const {
+        AllocationStats total;
+        for (const auto& memory : memory_) {
+            total += memory->stats();
+        }
+        return total;
+    }
+
+    // 最近一次 build_tree 得到的节点数（含根, 不含修剪掉的）
+    size_t node_count() const {
+        return node_count_;
+    }
+
+    // 最近一次 build_tree 修剪掉的节点数
+    size_t pruned_nodes() const {
+        return pruned_nodes_;
+    }
+
+    // 最近一次 build_tree 中所有 children 表的桶数组被替换的次数; 子节点数事先已知, 每个非叶子节点只有 reserve 一次
+    size_t children_rehashes() const {
+        return children_rehashes_.load(std::memory_order_relaxed);
+    }
+
+    // entries 必须已按 FramesView::Less 排序: 每个节点对应一段共享前缀的连续区间
+    FlameNode* build_tree(const CollapsedEntries& entries, const FlameGraphBuildOptions& options = {}) {
+        // 树归 arenas 所有: 每个节点及其 children 都分配在创建它的线程的 arena 中
+        auto root = FlameNode::create(local_memory());
+
+        const CollapsedEntry* begin = entries.data();
+        const CollapsedEntry* end = begin + entries.size();
+        // 与串行版本一致, 空堆栈不计入
+        while (begin != end && begin->first.empty()) {
+            ++begin;
+        }
+        children_rehashes_.store(0, std::memory_order_relaxed);
+        node_count_ = build_range(root, begin, end, 0);
+
+        // 修剪小节点
+        pruned_nodes_ = 0;
+        if (options.prune_small_nodes && root->total_count > 0) {
+            pruned_nodes_ = root->prune_tree(options.prune_threshold);
+            node_count_ -= pruned_nodes_;
+        }
+
+        return root;
+    }
+
+  private:
+    std::pmr::memory_resource* local_memory() const {
+        return memory_[executor_.worker_index() % memory_.size()].get();
+    }
+
+    // 返回以 node 为根的子树节点数
+    size_t build_range(FlameNode* node, const CollapsedEntry* begin, const CollapsedEntry* end, size_t depth) const {
+        // 恰好在此结束的堆栈排在区间最前面
+        const CollapsedEntry* it = begin;
+        for (; it != end && it->first.size == depth; ++it) {
+            node->self_count += it->second;
+            progress_tick(progress_);
+        }
+        node->total_count = node->self_count;
+
+        // 按第 depth 层的 frame 分组, 每组是一个子节点
+        std::vector<std::pair<const CollapsedEntry*, const CollapsedEntry*>> groups;
+        while (it != end) {
+            const Frame& frame = it->first.frame_arr[depth];
+            const CollapsedEntry* group_end = it + 1;
+            while (group_end != end && group_end->first.frame_arr[depth] == frame) {
+                ++group_end;
+            }
+            groups.emplace_back(it, group_end);
+            it = group_end;
+        }
+
+        // 子节点在构建它的线程上创建, 于是节点的 children 表只会被该线程修改
+        std::vector<FlameNode*> kids(groups.size());
+        std::vector<size_t> kid_sizes(groups.size());
+        auto build_child = [&](size_t g) {
+            const Frame* frame = &groups[g].first->first.frame_arr[depth];
+            FlameNode* kid = FlameNode::create(local_memory(), frame);
+            kid->parent = node;
+            kid_sizes[g] = build_range(kid, groups[g].first, groups[g].second, depth + 1);
+            kids[g] = kid;
+        };
+        if (static_cast<size_t>(end - begin) >= PARALLEL_GRAIN && groups.size() > 1) {
+            executor_.parallel_for(size_t{0}, groups.size(), [&](size_t g) {
+                TraceSpan span("build", "build subtree", g);
+                build_child(g);
+            }, 1);
+        } else {
+            for (size_t g = 0; g < groups.size(); ++g) {
+                build_child(g);
+            }
+        }
+
+        size_t size = 1;
+        size_t buckets = node->children.bucket_count();
+        if (! kids.empty()) {
+            node->children.reserve(kids.size()); // reserve(0) 也会分配桶数组, 叶子不需要
+        }
+        for (size_t g = 0; g < kids.size(); ++g) {
+            FlameNode* kid = kids[g];
+            node->children.emplace(kid->frame, kid);
+            node->total_count += kid->total_count;
+            node->height = std::max(node->height, kid->height + 1);
+            size += kid_sizes[g];
+        }
+        if (node->children.bucket_count() != buckets) {
+            children_rehashes_.fetch_add(1, std::memory_order_relaxed);
+        }
+        return size;
+    }
+};
+
+// 🔥 ===== 并行 SVG 渲染 =====
+class ParallelSvgFlameGraphRenderer : public SvgFlameGraphRenderer {
+  private:
+    static constexpr size_t SEGMENTS_PER_THREAD = 16;
+    ParallelExecutor& executor_;
+
+    // 一段输出: node 为空时是已经渲染好的文本, 否则是待并行渲染的子树
+    struct Segment {
+        std::string text;
+        const FlameNode* node = nullptr;
+        const Frame* frame = nullptr;
+        double x = 0;
+        double y = 0;
+        double width = 0;
+        int depth = 0;
+    };
+
+  public:
+    ParallelSvgFlameGraphRenderer(const FlameGraphConfig& config, ParallelExecutor& executor)
+        : SvgFlameGraphRenderer(config), executor_(executor) {}
+
+  protected:
+    // 顺序遍历大节点, 把小子树切成独立任务并行渲染, 最后按 DFS 顺序拼接
+    void write_frames(const FlameNode& root) override {
+        double y = frame_origin_y();
+        double wps = width_per_sample();
+        size_t threshold = std::max<size_t>(1, root.total_count / (executor_.concurrency() * SEGMENTS_PER_THREAD));
+
+        std::vector<Segment> segments;
+        std::ostringstream literal;
+        render_frame(literal, root, config_.xpad, y, config_.width - 2 * config_.xpad, nullptr, 0);
+        plan_children(segments, literal, root, config_.xpad, y, 1, wps, threshold);
+        flush_literal(segments, literal);
+
+        executor_.parallel_for(size_t{0}, segments.size(), [&](size_t i) {
+            Segment& seg = segments[i];
+            if (seg.node == nullptr) return;
+
+            TraceSpan span("render", "render segment", i);
+            std::ostringstream oss;
+            render_frame(oss, *seg.node, seg.x, seg.y, seg.width, seg.frame, seg.depth);
+            if (! seg.node->children.empty()) {
+                render_children(oss, *seg.node, seg.x, seg.y, seg.depth + 1, wps);
+            }
+            seg.text = oss.str();
+        }, 1);
+
+        for (const auto& seg : segments) {
+            svg_content_.write(seg.text.data(), static_cast<std::streamsize>(seg.text.size()));
+        }
+    }
+
+  private:
+    // 与 render_children 的遍历顺序和坐标累加方式完全相同
+    void plan_children(std::vector<Segment>& segments,
+                       std::ostringstream& literal,
+                       const FlameNode& node,
+                       double x,
+                       double parent_y,
+                       int depth,
+                       double wps,
+                       size_t threshold) {
+        double child_x = x;
+        double child_y = parent_y + frame_step_y();
+
+        for (const auto& [frame, child] : node.sorted_children()) {
+            double child_width = static_cast<double>(child->total_count) * wps;
+
+            if (child_width >= config_.min_width) {
+                if (child->total_count > threshold && ! child->children.empty()) {
+                    render_frame(literal, *child, child_x, child_y, child_width, frame, depth);
+                    plan_children(segments, literal, *child, child_x, child_y, depth + 1, wps, threshold);
+                } else {
+                    flush_literal(segments, literal);
+                    Segment seg;
+                    seg.node = child;
+                    seg.frame = frame;
+                    seg.x = child_x;
+                    seg.y = child_y;
+                    seg.width = child_width;
+                    seg.depth = depth;
+                    segments.push_back(std::move(seg));
+                }
+            } else {
+                progress_tick(progress_, child->total_count);
+            }
+
+            child_x += child_width;
+        }
+    }
+
+    static void flush_literal(std::vector<Segment>& segments, std::ostringstream& literal) {
+        std::string text = literal.str();
+        if (text.empty()) return;
+        Segment seg;
+        seg.text = std::move(text);
+        segments.push_back(std::move(seg));
+        literal.str("");
+    }
+};
+
+// 🔥 ===== 按进程/线程/CPU 拆分 =====
+enum class SplitBy {
+    None,
+    Pid,
+    Tid,
+    Comm,
+    Cpu,
+};
+
+inline SplitBy parse_split_by(std::string_view name) {
+    if (name == "none") return SplitBy::None;
+    if (name == "pid") return SplitBy::Pid;
+    if (name == "tid") return SplitBy::Tid;
+    if (name == "comm") return SplitBy::Comm;
+    if (name == "cpu") return SplitBy::Cpu;
+    throw FlameGraphException(std::string("Unknown split-by key: ") + std::string(name));
+}
+
+inline PartitionKey split_key_of(SplitBy by, const StackSample& sample) {
+    switch (by) {
+    case SplitBy::Pid:
+        return {sample.pid, {}};
+    case SplitBy::Tid:
+        return {(uint64_t{sample.pid} << 32) | sample.tid, {}};
+    case SplitBy::Comm:
+        return {0, sample.process_name};
+    case SplitBy::Cpu:
+        return {static_cast<uint64_t>(static_cast<int64_t>(sample.cpu) + 1), {}}; // 没有 cpu 字段的排在最前
+    case SplitBy::None:
+        break;
+    }
+    return {};
+}
+
+// 用作文件名的一部分, 只保留安全字符
+inline std::string split_key_label(SplitBy by, const PartitionKey& key) {
+    switch (by) {
+    case SplitBy::Pid:
+        return std::to_string(key.id);
+    case SplitBy::Tid:
+        return std::to_string(key.id >> 32) + "-" + std::to_string(key.id & 0xFFFFFFFFu);
+    case SplitBy::Cpu:
+        return key.id == 0 ? "cpu-unknown" : "cpu" + std::to_string(key.id - 1);
+    case SplitBy::Comm: {
+        if (key.name.empty()) {
+            return "unknown";
+        }
+        std::string label(key.name);
+        for (char& c : label) {
+            bool safe = std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_' || c == '.';
+            if (! safe) {
+                c = '_';
+            }
+        }
+        return label;
+    }
+    case SplitBy::None:
+        break;
+    }
+    return "all";
+}
+
+// <out>.<label>.<suffix>, 例如 flame.svg -> flame.27409.svg
+inline std::string partition_output_path(std::string_view out_file, std::string_view label) {
+    auto suffix = file_suffix(out_file);
+    std::string_view stem = out_file.substr(0, out_file.size() - suffix.size() - 1);
+    return std::string(stem) + "." + std::string(label) + "." + std::string(suffix);
+}
+
+// 每个拆分输出的统计
+struct PartitionStats {
+    std::string key;
+    std::string path;
+    size_t samples = 0;
+};
+
+// 🔥 ===== 时间切片 =====
+struct TimeSliceOptions {
+    uint64_t window_us = 0;   // 每个时间窗口的长度（微秒）, 0 表示不切片
+    bool heatmap = true;      // 同时输出 <out>.heatmap.svg
+    size_t heatmap_rows = 50; // 热力图每秒分成的行数, 50 即每格 20ms
+};
+
+// FlameScope 风格的样本密度矩阵: 每列一秒, 每行是秒内的一段偏移
+struct TimeHeatmap {
+    uint64_t start_us = 0;
+    size_t columns = 0;
+    size_t rows = 0;
+    std::vector<size_t> counts; // counts[column * rows + row]
+
+    size_t at(size_t column, size_t row) const {
+        return counts[column * rows + row];
+    }
+
+    size_t max_count() const {
+        return counts.empty() ? 0 : *std::max_element(counts.begin(), counts.end());
+    }
+};
+
+// 有时间戳的样本的最早、最晚时间; 没有时间戳（为 0）的样本不参与
+inline std::pair<uint64_t, uint64_t> timestamp_range(ParallelExecutor& executor, const SampleChunks& chunks) {
+    using Range = std::pair<uint64_t, uint64_t>;
+    return executor.parallel_reduce(
+        size_t{0},
+        chunks.size(),
+        Range{UINT64_MAX, 0},
+        [&](size_t begin, size_t end, Range range) {
+            for (size_t c = begin; c < end; ++c) {
+                for (const auto& sample : chunks[c]->samples.raw_samples) {
+                    if (sample.timestamp != 0) {
+                        range.first = std::min(range.first, sample.timestamp);
+                        range.second = std::max(range.second, sample.timestamp);
+                    }
+                }
+            }
+            return range;
+        },
+        [](Range a, Range b) { return Range{std::min(a.first, b.first), std::max(a.second, b.second)}; });
+}
+
+inline TimeHeatmap build_heatmap(ParallelExecutor& executor,
+                                 const SampleChunks& chunks,
+                                 uint64_t start_us,
+                                 uint64_t end_us,
+                                 size_t rows) {
+    constexpr uint64_t US_PER_SECOND = 1000000;
+    TimeHeatmap heatmap;
+    heatmap.start_us = start_us;
+    heatmap.rows = std::max<size_t>(1, rows);
+    heatmap.columns = static_cast<size_t>((end_us - start_us) / US_PER_SECOND) + 1;
+    const uint64_t row_us = std::max<uint64_t>(1, US_PER_SECOND / heatmap.rows);
+
+    // 每个归约块一个矩阵, 按块合并
+    heatmap.counts = executor.parallel_reduce(
+        size_t{0},
+        chunks.size(),
+        std::vector<size_t>{},
+        [&](size_t begin, size_t end, std::vector<size_t> counts) {
+            counts.resize(heatmap.columns * heatmap.rows, 0);
+            for (size_t c = begin; c < end; ++c) {
+                for (const auto& sample : chunks[c]->samples.raw_samples) {
+                    uint64_t offset = sample.timestamp > start_us ? sample.timestamp - start_us : 0;
+                    auto column = static_cast<size_t>(offset / US_PER_SECOND);
+                    auto row = std::min(heatmap.rows - 1, static_cast<size_t>(offset % US_PER_SECOND / row_us));
+                    counts[column * heatmap.rows + row] += sample.count;
+                }
+            }
+            return counts;
+        },
+        [](std::vector<size_t> a, const std::vector<size_t>& b) {
+            if (a.empty()) return b;
+            for (size_t i = 0; i < b.size(); ++i) {
+                a[i] += b[i];
+            }
+            return a;
+        });
+    heatmap.counts.resize(heatmap.columns * heatmap.rows, 0);
+    return heatmap;
+}
+
+// 写出热力图: 横轴为秒, 纵轴自上而下为秒内偏移, 颜色越深样本越多
+inline void write_heatmap_svg(const TimeHeatmap& heatmap, const FlameGraphConfig& config, std::string_view filename) {
+    constexpr int CELL = 8;
+    const int top = config.font_size * 3;
+    const int left = config.xpad;
+    const int width = left * 2 + static_cast<int>(heatmap.columns) * CELL;
+    const int height = top + static_cast<int>(heatmap.rows) * CELL + config.font_size * 2;
+    const double max_count = static_cast<double>(std::max<size_t>(1, heatmap.max_count()));
+    const double row_ms = 1000.0 / static_cast<double>(heatmap.rows);
+
+    std::ofstream ofs(filename.data());
+    if (! ofs.is_open()) {
+        throw OpenFileException(filename);
+    }
+
+    ofs << "<?xml version=\"1.0\" standalone=\"no\"?>\n";
+    ofs << "<svg version=\"1.1\" width=\"" << width << "\" height=\"" << height << "\" viewBox=\"0 0 " << width
+        << " " << height << "\" xmlns=\"http://www.w3.org/2000/svg\">\n";
+    ofs << "<style type=\"text/css\">\n";
+    ofs << "  text { font-family:" << config.font_type << "; font-size:" << config.font_size << "px; fill:black; }\n";
+    ofs << "  rect:hover { stroke:black; stroke-width:0.5; }\n";
+    ofs << "</style>\n";
+    ofs << "<rect x=\"0\" y=\"0\" width=\"" << width << "\" height=\"" << height << "\" fill=\"white\" />\n";
+    ofs << "<text x=\"" << width / 2 << "\" y=\"" << config.font_size * 2 << "\" text-anchor=\"middle\">";
+    escape_xml_to_stream(config.title, ofs);
+    ofs << " - sample density (x: seconds, y: " << std::fixed << std::setprecision(0) << row_ms << " ms rows)</text>\n";
+
+    ofs << std::setprecision(1);
+    for (size_t column = 0; column < heatmap.columns; ++column) {
+        for (size_t row = 0; row < heatmap.rows; ++row) {
+            size_t count = heatmap.at(column, row);
+            if (count == 0) {
+                continue;
+            }
+            // 白 -> 红, 与 FlameScope 一致
+            auto shade = static_cast<int>(255.0 * (1.0 - static_cast<double>(count) / max_count));
+            ofs << "<rect x=\"" << left + static_cast<int>(column) * CELL << "\" y=\"" << top + static_cast<int>(row) * CELL
+                << "\" width=\"" << CELL << "\" height=\"" << CELL << "\" fill=\"rgb(255," << shade << "," << shade
+                << ")\"><title>" << static_cast<double>(column) + static_cast<double>(row) * row_ms / 1000.0 << "s: "
+                << count << " samples</title></rect>\n";
+        }
+    }
+    ofs << "</svg>\n";
+
+    if (! ofs.good()) {
+        throw RenderException(std::string("Error writing to SVG file: ") + filename.data());
+    }
+}
+
+// 窗口编号补零到相同位数, 文件名按字典序即为时间顺序
+inline std::string window_label(uint64_t index, uint64_t window_count) {
+    std::string digits = std::to_string(index);
+    size_t width = std::max<size_t>(4, std::to_string(window_count > 0 ? window_count - 1 : 0).size());
+    return "w" + std::string(width - std::min(width, digits.size()), '0') + digits;
+}
+
+// 🔥 ===== 执行计划 =====
+
+// 对输入的廉价探测结果
+struct InputProfile {
+    size_t file_bytes = 0;
+    size_t probe_bytes = 0;             // 实际解析的前缀长度, 0 表示没有探测解析
+    size_t probe_lines = 0;
+    size_t probe_samples = 0;
+    size_t probe_unique_stacks = 0;
+    size_t estimated_samples = 0;
+    size_t estimated_unique_stacks = 0;
+};
+
+enum class ExecutionStrategy {
+    Serial,    // 单线程, 不启动线程池
+    Staged,    // 并行解析 -> 并行折叠, 分阶段执行
+    Pipelined, // 解析与折叠重叠执行, 内存有上限
+    MultiFile, // 多个输入文件, 每个线程整文件解析折叠
+};
+
+inline std::string_view to_string(ExecutionStrategy strategy) {
+    switch (strategy) {
+    case ExecutionStrategy::Serial:
+        return "serial";
+    case ExecutionStrategy::Staged:
+        return "staged";
+    case ExecutionStrategy::Pipelined:
+        return "pipelined";
+    case ExecutionStrategy::MultiFile:
+        return "multi-file";
+    }
+    return "unknown";
+}
+
+// 规划结果, 生成结束后可通过 get_last_plan() 查看, 便于审计
+struct ExecutionPlan {
+    InputProfile profile;
+    ExecutionStrategy strategy = ExecutionStrategy::Serial;
+    size_t threads = 1;                 // 参与计算的线程数
+    size_t chunk_count = 1;             // 分阶段模式的分块数
+    size_t chunk_bytes = 0;             // 流水线模式的块大小
+    size_t expected_unique_stacks = 0;  // 哈希表预分配大小
+    std::string reason;                 // 选择该策略的原因
+};
+
+/**
+ * @brief 根据输入规模选择执行策略
+ *
+ * 只解析文件开头的一小段: 由此估算总样本数和不同堆栈数, 再决定线程数、分块大小、哈希表预分配
+ * 以及分阶段还是流水线; 小输入直接串行, 不付线程启动的代价
+ */
+class ExecutionPlanner {
+  public:
+    static constexpr size_t PROBE_BYTES = 256 * 1024;               // 探测前缀长度, 不超过它的输入直接串行
+    static constexpr size_t SERIAL_MAX_SAMPLES = 10000;             // 样本数不超过它时串行更快（见 README 中的测试）
+    static constexpr size_t BYTES_PER_THREAD = 1 << 20;             // 每个线程至少分到的字节数
+    static constexpr size_t CHUNKS_PER_THREAD = 4;                  // 分块多于线程数, 便于负载均衡
+    static constexpr size_t PIPELINE_MIN_BYTES = size_t{256} << 20; // 超过它时分阶段模式的样本内存太大, 改用流水线
+    static constexpr size_t PIPELINE_MIN_CHUNK = 256 * 1024;
+    static constexpr size_t PIPELINE_MAX_CHUNK = 8 << 20;
+
+    // max_threads 为可用的线程数上限; options 为生成器的解析选项, 根帧、注解、整理都会改变不同堆栈的数目
+    ExecutionPlan plan(std::string_view buffer, size_t max_threads, const ParseOptions& options = {}) const {
+        ExecutionPlan plan;
+        plan.profile = probe(buffer, options);
+        const InputProfile& profile = plan.profile;
+        plan.expected_unique_stacks = profile.estimated_unique_stacks;
+
+        std::ostringstream reason;
+        if (profile.probe_bytes == 0) {
+            reason << "input " << profile.file_bytes << " bytes <= probe size";
+            plan.reason = reason.str();
+            return plan;
+        }
+        if (max_threads <= 1) {
+            reason << "single thread available";
+            plan.reason = reason.str();
+            return plan;
+        }
+        if (profile.estimated_samples <= SERIAL_MAX_SAMPLES) {
+            reason << "estimated " << profile.estimated_samples << " samples <= " << SERIAL_MAX_SAMPLES;
+            plan.reason = reason.str();
+            return plan;
+        }
+
+        plan.threads = std::clamp<size_t>(profile.file_bytes / BYTES_PER_THREAD, 2, max_threads);
+        plan.chunk_count = plan.threads * CHUNKS_PER_THREAD;
+        reason << "estimated " << profile.estimated_samples << " samples, "
+               << profile.estimated_unique_stacks << " unique stacks; "
+               << plan.threads << " threads";
+
+        if (profile.file_bytes >= PIPELINE_MIN_BYTES) {
+            plan.strategy = ExecutionStrategy::Pipelined;
+            plan.chunk_bytes = std::clamp<size_t>(profile.file_bytes / (plan.threads * 16), PIPELINE_MIN_CHUNK,
+                                                  PIPELINE_MAX_CHUNK);
+            reason << "; input >= " << (PIPELINE_MIN_BYTES >> 20) << " MiB, pipelined to bound memory";
+        } else {
+            plan.strategy = ExecutionStrategy::Staged;
+            reason << "; staged";
+        }
+        plan.reason = reason.str();
+        return plan;
+    }
+
+  private:
+    static size_t count_lines(std::string_view text) {
+        return static_cast<size_t>(std::count(text.begin(), text.end(), '\n'));
+    }
+
+    static InputProfile probe(std::string_view buffer, const ParseOptions& options) {
+        InputProfile profile;
+        profile.file_bytes = buffer.size();
+        if (buffer.size() <= PROBE_BYTES) {
+            // 小输入不做探测解析, 否则等于解析两遍
+            return profile;
+        }
+
+        // 不带 JIT/ELF 还原: 探测不应载入符号、写缓存或计入还原的帧数
+        ParseOptions probe_options = options;
+        probe_options.perf_maps = nullptr;
+        probe_options.elf_symbols = nullptr;
+        auto parser = AutoDetectParser::detect_parser(buffer, probe_options);
+        size_t end = parser->next_chunk_boundary(buffer, PROBE_BYTES);
+        std::string_view prefix = buffer.substr(0, end);
+
+        StackSamplesContext ctx;
+        StackSamples samples = ctx.create_samples();
+        parser->parse_into(prefix, ctx, samples);
+
+        std::unordered_set<FramesView, FramesView::Hasher, FramesView::Equal> unique;
+        for (const auto& sample : samples.raw_samples) {
+            unique.insert(FramesView{sample.frames});
+        }
+
+        profile.probe_bytes = prefix.size();
+        profile.probe_lines = count_lines(prefix);
+        profile.probe_samples = samples.raw_samples.size();
+        profile.probe_unique_stacks = unique.size();
+
+        // 样本数按字节线性外推; 堆栈种类的增长远慢于样本数, 按平方根外推
+        double scale = static_cast<double>(buffer.size()) / static_cast<double>(std::max<size_t>(1, prefix.size()));
+        profile.estimated_samples = static_cast<size_t>(static_cast<double>(profile.probe_samples) * scale);
+        profile.estimated_unique_stacks = std::min(
+            profile.estimated_samples,
+            static_cast<size_t>(static_cast<double>(profile.probe_unique_stacks) * std::sqrt(scale)));
+        return profile;
+    }
+};
+
+// 🔥 ===== 主入口类 =====
+class ParallelFlameGraphGenerator {
+  private:
+    FlameGraphConfig config_;
+    StackCollapseOptions collapse_opts_;
+    FlameGraphBuildOptions build_opts_;
+    size_t threads_;                              // 0 表示使用全部硬件线程
+    std::unique_ptr<ParallelExecutor> executor_; // 首次并行执行时创建, 线程在多次 generate 之间复用
+    std::unique_ptr<ArenaSet> arenas_;           // 每个执行线程一个 arena, 每次生成结束后整体释放
+    bool arena_reuse_ = false;
+    ArenaPolicy arena_policy_;
+    PipelineOptions pipeline_opts_;
+    bool auto_plan_ = true;
+    ExecutionPlan last_plan_;
+    std::vector<InputFileStats> last_inputs_;
+    SplitBy split_by_ = SplitBy::None;
+    TimeSliceOptions time_slices_;
+    std::vector<PartitionStats> last_partitions_;
+    TimeHeatmap last_heatmap_;
+    RunStats last_stats_;
+    bool detailed_stats_ = false;
+    bool diagnostics_ = false;
+    bool demangle_ = false;
+    ParseOptions parse_opts_;
+    ProgressCallback progress_callback_;
+    const CancellationToken* cancel_token_ = nullptr;
+    FlameGraphGenerator serial_; // 规划为串行时使用
+
+  public:
+    explicit ParallelFlameGraphGenerator(const FlameGraphConfig& config = {}, size_t threads = 0)
+        : config_(config), threads_(threads), serial_(config) {
+        config_.validate();
+    }
+
+    void generate(std::string_view raw_file, std::string_view out_file) {
+        auto suffix = file_suffix(out_file);
+        if (suffix.empty()) {
+            throw FlameGraphException(std::string("File suffix empty") + out_file.data());
+        }
+
+        try {
+            run(raw_file, out_file, suffix);
+        } catch (const CancelledException&) {
+            throw;
+        } catch (const std::exception& e) {
+            throw FlameGraphException(e.what());
+        }
+    }
+
+    // 多个输入（可含通配符）合并为一张图, 各文件的样本数见 get_last_inputs()
+    void generate(const std::vector<std::string>& raw_files, std::string_view out_file) {
+        auto suffix = file_suffix(out_file);
+        if (suffix.empty()) {
+            throw FlameGraphException(std::string("File suffix empty") + out_file.data());
+        }
+
+        try {
+            auto files = expand_input_patterns(raw_files);
+            if (files.empty()) {
+                throw FlameGraphException("No input files");
+            }
+            if (files.size() > 1 && (split_by_ != SplitBy::None || time_slices_.window_us != 0)) {
+                throw FlameGraphException("Split-by and time slices are not supported with multiple input files");
+            }
+            if (files.size() == 1) {
+                run(files.front(), out_file, suffix);
+                return;
+            }
+            run_files(files, out_file, suffix);
+        } catch (const CancelledException&) {
+            throw;
+        } catch (const std::exception& e) {
+            throw FlameGraphException(e.what());
+        }
+    }
+
+    void set_threads(size_t threads) {
+        if (threads != threads_) {
+            threads_ = threads;
+            executor_.reset();
+            arenas_.reset();
+        }
+    }
+
+    // 复用模式: 生成结束后各线程 arena 保留热页给下一次生成
+    void set_arena_reuse(bool reuse) {
+        arena_reuse_ = reuse;
+        if (arenas_) {
+            arenas_->set_reuse(reuse);
+        }
+        serial_.set_arena_reuse(reuse);
+    }
+
+    // arena 页分配策略: 大页与 NUMA 本地, 系统不支持时自动回退到普通页
+    void set_arena_policy(const ArenaPolicy& policy) {
+        arena_policy_ = policy;
+        if (arenas_) {
+            arenas_->set_policy(policy);
+        }
+        serial_.set_arena_policy(policy);
+    }
+
+    // 自动规划（默认开启）: 按输入规模选择串行/分阶段/流水线, 线程数以 threads 为上限
+    // 关闭后总是用全部 threads 个线程, 是否流水线由 set_pipeline_options 决定
+    void set_auto_plan(bool enabled) {
+        auto_plan_ = enabled;
+    }
+
+    bool get_auto_plan() const {
+        return auto_plan_;
+    }
+
+    // 最近一次 generate 的执行计划及其依据
+    const ExecutionPlan& get_last_plan() const {
+        return last_plan_;
+    }
+
+    // 最近一次 generate 每个输入文件的字节数和样本数
+    const std::vector<InputFileStats>& get_last_inputs() const {
+        return last_inputs_;
+    }
+
+    // 最近一次成功生成的统计
+    const RunStats& get_last_stats() const {
+        return last_stats_;
+    }
+
+    // 额外统计需要遍历整棵树的项（distinct_frames）
+    void set_detailed_stats(bool detailed) {
+        detailed_stats_ = detailed;
+        serial_.set_detailed_stats(detailed);
+    }
+
+    // 数据结构诊断, 见 FlameGraphGenerator::set_diagnostics; 折叠表只在串行与分阶段模式下统计
+    void set_diagnostics(bool enabled) {
+        diagnostics_ = enabled;
+        serial_.set_diagnostics(enabled);
+    }
+
+    // 还原 C++/Rust 的 mangled 函数名, 见 FlameGraphGenerator::set_demangle; 拆分与切片模式下每组各自还原
+    void set_demangle(bool enabled) {
+        demangle_ = enabled;
+        serial_.set_demangle(enabled);
+    }
+
+    // 函数名整理, 见 FlameGraphGenerator::set_parse_options
+    void set_parse_options(const ParseOptions& options) {
+        parse_opts_ = options;
+        serial_.set_parse_options(options);
+    }
+
+    const ParseOptions& get_parse_options() const {
+        return parse_opts_;
+    }
+
+    // 各阶段的进度回调, 详见 ProgressReporter; 流水线与多文件模式汇报 "parse + collapse",
+    // 拆分与时间切片模式的建树和渲染按完成的输出个数汇报 "build + render"
+    void set_progress_callback(ProgressCallback callback) {
+        progress_callback_ = callback;
+        serial_.set_progress_callback(std::move(callback));
+    }
+
+    // 取消后 generate 在下一个检查点抛出 CancelledException, 各线程的 arena 随即释放; token 须活到生成结束
+    void set_cancellation_token(const CancellationToken* token) {
+        cancel_token_ = token;
+        serial_.set_cancellation_token(token);
+    }
+
+    // 一次解析后按 pid/tid/comm/cpu 拆分, 每组输出到 <out>.<key>.<suffix>, 不再输出 out 本身
+    void set_split_by(SplitBy split_by) {
+        split_by_ = split_by;
+    }
+
+    SplitBy get_split_by() const {
+        return split_by_;
+    }
+
+    // 时间切片: 一次解析后每 window_us 微秒输出一张 <out>.wNNNN.<suffix>, 并可输出 <out>.heatmap.svg
+    // 与 set_split_by 互斥
+    void set_time_slices(const TimeSliceOptions& options) {
+        time_slices_ = options;
+    }
+
+    const TimeSliceOptions& get_time_slices() const {
+        return time_slices_;
+    }
+
+    // 最近一次拆分或切片生成的各个输出
+    const std::vector<PartitionStats>& get_last_partitions() const {
+        return last_partitions_;
+    }
+
+    // 最近一次时间切片的样本密度矩阵
+    const TimeHeatmap& get_last_heatmap() const {
+        return last_heatmap_;
+    }
+
+    size_t get_threads() const {
+        return threads_;
+    }
+
+    // 流水线模式: 解析与折叠重叠执行, 且已解析的块数有上限
+    void set_pipeline_options(const PipelineOptions& options) {
+        pipeline_opts_ = options;
+    }
+
+    const PipelineOptions& get_pipeline_options() const {
+        return pipeline_opts_;
+    }
+
+    void set_config(const FlameGraphConfig& config) {
+        config.validate();
+        config_ = config;
+        serial_.set_config(config);
+    }
+
+    const FlameGraphConfig& get_config() const {
+        return config_;
+    }
+
+  private:
+    size_t max_threads() const {
+        return threads_ != 0 ? threads_ : std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+
+    static RunStats::Plan plan_stats(const ExecutionPlan& plan) {
+        RunStats::Plan stats;
+        stats.enabled = true;
+        stats.strategy = to_string(plan.strategy);
+        stats.threads = plan.threads;
+        stats.chunk_count = plan.chunk_count;
+        stats.chunk_bytes = plan.chunk_bytes;
+        stats.estimated_samples = plan.profile.estimated_samples;
+        stats.estimated_unique_stacks = plan.profile.estimated_unique_stacks;
+        stats.presize = plan.expected_unique_stacks;
+        stats.reason = plan.reason;
+        return stats;
+    }
+
+    ExecutionPlan make_plan(std::string_view buffer) const {
+        ExecutionPlan plan;
+        if (auto_plan_) {
+            plan = ExecutionPlanner().plan(buffer, max_threads(), parse_opts_);
+        } else {
+            plan.profile.file_bytes = buffer.size();
+            plan.strategy = ExecutionStrategy::Staged;
+            plan.threads = max_threads();
+            plan.chunk_count = plan.threads * ExecutionPlanner::CHUNKS_PER_THREAD;
+            plan.reason = "auto plan disabled";
+        }
+
+        // 显式开启的流水线优先于规划结果
+        if (pipeline_opts_.enabled && plan.strategy != ExecutionStrategy::Pipelined) {
+            if (plan.strategy == ExecutionStrategy::Serial) {
+                plan.threads = max_threads();
+                plan.chunk_count = plan.threads * ExecutionPlanner::CHUNKS_PER_THREAD;
+            }
+            plan.strategy = ExecutionStrategy::Pipelined;
+            plan.chunk_bytes = pipeline_opts_.chunk_bytes;
+            plan.reason += "; pipeline forced by options";
+        }
+        return plan;
+    }
+
+    ParallelExecutor& executor() {
+        if (! executor_) {
+            executor_ = std::make_unique<ParallelExecutor>(threads_);
+            arenas_ = std::make_unique<ArenaSet>(executor_->concurrency(), arena_reuse_, arena_policy_);
+        }
+        return *executor_;
+    }
+
+    void run_files(const std::vector<std::string>& files, std::string_view out_file, std::string_view suffix) {
+        StageTimer total_timer;
+        StageTimer timer;
+        RunStats stats;
+        last_stats_ = RunStats{};
+        size_t jit_frames = parse_opts_.jit_frames();
+        size_t elf_frames = parse_opts_.elf_frames();
+        last_plan_ = ExecutionPlan{};
+        last_plan_.strategy = ExecutionStrategy::MultiFile;
+        last_plan_.threads = std::min(max_threads(), files.size());
+        last_plan_.chunk_count = last_plan_.threads * ExecutionPlanner::CHUNKS_PER_THREAD;
+        last_plan_.reason = std::to_string(files.size()) + " input files";
+        last_inputs_.clear();
+        last_partitions_.clear();
+
+        ParallelExecutor& executor = this->executor();
+        ArenaSetReleaseGuard arena_guard{*arenas_};
+        auto progress = make_progress_reporter(progress_callback_, cancel_token_);
+        ParallelStackCollapser collapser(executor, last_plan_.chunk_count);
+        collapser.set_progress(progress.get());
+        FrameInternTable interned; // 折叠结果中的名字都在这里, 须活到渲染结束
+
+        if (progress) {
+            size_t total_bytes = 0;
+            for (const auto& file : files) {
+                total_bytes += file_size_or_zero(file);
+            }
+            progress->begin("parse + collapse", total_bytes);
+        }
+        MultiFileStackCollapser multi_file(executor, *arenas_, interned, collapser, last_plan_.threads);
+        multi_file.set_progress(progress.get());
+        multi_file.set_parse_options(parse_opts_);
+        auto result = multi_file.run(files, collapse_opts_);
+        finish_stage(progress.get());
+        last_inputs_ = std::move(result.files);
+        for (const auto& input : last_inputs_) {
+            last_plan_.profile.file_bytes += input.bytes;
+        }
+        if (result.sample_count == 0) {
+            throw FlameGraphException("No valid samples found in input files");
+        }
+        stats.parse = timer.lap("parse + collapse");
+        stats.bytes_read = last_plan_.profile.file_bytes;
+        stats.plan = plan_stats(last_plan_);
+        stats.lines = result.line_count;
+        stats.samples = result.sample_count;
+        stats.memory.samples = result.samples_memory;
+        stats.memory.frames = result.frames_memory;
+        stats.unique_stacks = result.entries.size();
+
+        finish(collapser, result.entries, out_file, suffix, config_, stats, progress.get());
+        stats.jit_frames = parse_opts_.jit_frames() - jit_frames;
+        stats.elf_frames = parse_opts_.elf_frames() - elf_frames;
+        stats.peak_arena_bytes = arenas_->bytes_reserved();
+        stats.total = total_timer.lap();
+        last_stats_ = stats;
+    }
+
+    SampleChunks parse_chunks(std::string_view buffer, ProgressReporter* progress) {
+        ParallelExecutor& executor = this->executor();
+        ParallelStackParser parser(executor, std::max<size_t>(1, last_plan_.chunk_count), arenas_.get());
+        parser.set_progress(progress);
+        parser.set_parse_options(parse_opts_);
+        begin_stage(progress, "parse", buffer.size());
+        SampleChunks chunks = parser.parse(buffer);
+        finish_stage(progress);
+        if (total_sample_count(executor, chunks) == 0) {
+            throw FlameGraphException("No valid samples found in input file");
+        }
+        return chunks;
+    }
+
+    // 一次解析, 按键分组折叠, 各组并行建树和渲染
+    void run_split(std::string_view buffer,
+                   std::string_view out_file,
+                   std::string_view suffix,
+                   RunStats& run_stats,
+                   StageTimer& timer,
+                   ProgressReporter* progress) {
+        ParallelExecutor& executor = this->executor();
+        ArenaSetReleaseGuard arena_guard{*arenas_};
+        SampleChunks chunks = parse_chunks(buffer, progress);
+        record_parse(executor, chunks, run_stats, timer);
+        ParallelStackCollapser collapser(executor, std::max<size_t>(1, last_plan_.chunk_count));
+        collapser.set_progress(progress);
+
+        SplitBy split_by = split_by_;
+        begin_stage(progress, "collapse", run_stats.samples);
+        Partitions partitions = collapser.collapse_partitioned(
+            chunks, [split_by](const StackSample& sample) { return split_key_of(split_by, sample); });
+        finish_stage(progress);
+        record_partitions(partitions, run_stats, timer);
+
+        last_partitions_.resize(partitions.size());
+        std::vector<std::string> titles(partitions.size()); // config.title 只是 view, 标题需要单独保存
+        for (size_t p = 0; p < partitions.size(); ++p) {
+            auto& stats = last_partitions_[p];
+            stats.key = split_key_label(split_by, partitions[p].key);
+            stats.path = partition_output_path(out_file, stats.key);
+            stats.samples = partitions[p].sample_count;
+            titles[p] = std::string(config_.title) + " (" + stats.key + ")";
+        }
+
+        render_partitions(collapser, partitions, titles, suffix, run_stats, progress);
+        run_stats.render = timer.lap("build + render");
+        run_stats.peak_arena_bytes = arenas_->bytes_reserved();
+    }
+
+    // 一次解析, 按时间窗口分组折叠, 各窗口并行建树和渲染, 同时统计密度矩阵
+    void run_time_slices(std::string_view buffer,
+                         std::string_view out_file,
+                         std::string_view suffix,
+                         RunStats& run_stats,
+                         StageTimer& timer,
+                         ProgressReporter* progress) {
+        ParallelExecutor& executor = this->executor();
+        ArenaSetReleaseGuard arena_guard{*arenas_};
+        SampleChunks chunks = parse_chunks(buffer, progress);
+        record_parse(executor, chunks, run_stats, timer);
+        ParallelStackCollapser collapser(executor, std::max<size_t>(1, last_plan_.chunk_count));
+        collapser.set_progress(progress);
+
+        auto [start_us, end_us] = timestamp_range(executor, chunks);
+        if (start_us > end_us) {
+            throw FlameGraphException("Time slices need sample timestamps, but the input has none");
+        }
+
+        const uint64_t window_us = time_slices_.window_us;
+        const uint64_t origin_us = start_us;
+        auto window_of = [origin_us, window_us](const StackSample& sample) {
+            // 无时间戳的样本归入第一个窗口
+            uint64_t offset = sample.timestamp > origin_us ? sample.timestamp - origin_us : 0;
+            return PartitionKey{offset / window_us, {}};
+        };
+        begin_stage(progress, "collapse", run_stats.samples);
+        Partitions partitions = collapser.collapse_partitioned(chunks, window_of);
+        finish_stage(progress);
+        record_partitions(partitions, run_stats, timer);
+
+        const uint64_t window_count = (end_us - start_us) / window_us + 1;
+        last_partitions_.resize(partitions.size());
+        std::vector<std::string> titles(partitions.size());
+        for (size_t p = 0; p < partitions.size(); ++p) {
+            uint64_t index = partitions[p].key.id;
+            auto& stats = last_partitions_[p];
+            stats.key = window_label(index, window_count);
+            stats.path = partition_output_path(out_file, stats.key);
+            stats.samples = partitions[p].sample_count;
+
+            std::ostringstream title;
+            title << config_.title << " (" << std::fixed << std::setprecision(1)
+                  << static_cast<double>(index * window_us) / 1e6 << "s - "
+                  << static_cast<double>((index + 1) * window_us) / 1e6 << "s)";
+            titles[p] = title.str();
+        }
+
+        if (time_slices_.heatmap) {
+            // 热力图总是 SVG: flame.html -> flame.heatmap.svg
+            std::string svg_out = std::string(out_file.substr(0, out_file.size() - suffix.size())) + "svg";
+            last_heatmap_ = build_heatmap(executor, chunks, start_us, end_us, time_slices_.heatmap_rows);
+            std::string heatmap_path = partition_output_path(svg_out, "heatmap");
+            write_heatmap_svg(last_heatmap_, config_, heatmap_path);
+            run_stats.bytes_written += file_size_or_zero(heatmap_path);
+        }
+
+        render_partitions(collapser, partitions, titles, suffix, run_stats, progress);
+        run_stats.render = timer.lap("build + render");
+        run_stats.peak_arena_bytes = arenas_->bytes_reserved();
+    }
+
+    static void record_parse(ParallelExecutor& executor, const SampleChunks& chunks, RunStats& stats, StageTimer& timer) {
+        stats.parse = timer.lap("parse");
+        stats.lines = total_line_count(chunks);
+        stats.samples = total_sample_count(executor, chunks);
+        for (const auto& chunk : chunks) {
+            add_chunk_allocations(*chunk, stats.memory.samples, stats.memory.frames);
+        }
+    }
+
+    static void record_partitions(const Partitions& partitions, RunStats& stats, StageTimer& timer) {
+        stats.collapse = timer.lap("collapse");
+        for (const auto& partition : partitions) {
+            stats.unique_stacks += partition.entries.size();
+        }
+    }
+
+    void render_partitions(const ParallelStackCollapser& collapser,
+                           const Partitions& partitions,
+                           const std::vector<std::string>& titles,
+                           std::string_view suffix,
+                           RunStats& stats,
+                           ProgressReporter* progress) {
+        // 各组同时建树和渲染, 不能各自开始阶段; 组内只检查取消, 进度按完成的组数汇报
+        std::unique_ptr<ProgressReporter> cancel_only = make_progress_reporter(nullptr, cancel_token_);
+        begin_stage(progress, "build + render", partitions.size());
+        std::vector<RunStats> graphs(partitions.size());
+        executor_->parallel_for(size_t{0}, partitions.size(), [&](size_t p) {
+            TraceSpan span("render", "partition", p);
+            FlameGraphConfig config = config_;
+            config.title = titles[p];
+            finish(collapser, partitions[p].entries, last_partitions_[p].path, suffix, config, graphs[p],
+                   cancel_only.get(), false);
+            if (progress) {
+                progress->advance(1);
+            }
+        }, 1);
+        finish_stage(progress);
+        for (const auto& graph : graphs) {
+            stats.add_graph(graph);
+        }
+    }
+
+    void run(std::string_view raw_file, std::string_view out_file, std::string_view suffix) {
+        StageTimer total_timer;
+        StageTimer timer;
+        RunStats stats;
+        last_stats_ = RunStats{};
+        size_t jit_frames = parse_opts_.jit_frames();
+        size_t elf_frames = parse_opts_.elf_frames();
+
+        MMapBuffer buffer(raw_file);
+        stats.bytes_read = buffer.size;
+        last_plan_ = make_plan(buffer.view());
+        const ExecutionPlan& plan = last_plan_;
+        stats.plan = plan_stats(plan);
+        last_inputs_.clear();
+        last_partitions_.clear();
+        last_heatmap_ = TimeHeatmap{};
+
+        StackCollapseOptions collapse_opts = collapse_opts_;
+        collapse_opts.expected_unique_stacks = plan.expected_unique_stacks;
+
+        if (split_by_ != SplitBy::None && time_slices_.window_us != 0) {
+            throw FlameGraphException("Split-by and time slices cannot be combined");
+        }
+        auto progress = make_progress_reporter(progress_callback_, cancel_token_);
+        if (split_by_ != SplitBy::None || time_slices_.window_us != 0) {
+            if (split_by_ != SplitBy::None) {
+                run_split(buffer.view(), out_file, suffix, stats, timer, progress.get());
+            } else {
+                run_time_slices(buffer.view(), out_file, suffix, stats, timer, progress.get());
+            }
+            stats.jit_frames = parse_opts_.jit_frames() - jit_frames;
+            stats.elf_frames = parse_opts_.elf_frames() - elf_frames;
+            stats.total = total_timer.lap();
+            last_stats_ = stats;
+            return;
+        }
+
+        if (plan.strategy == ExecutionStrategy::Serial) {
+            serial_.set_collapse_options(collapse_opts);
+            serial_.generate_from_buffer(buffer.view(), out_file);
+            last_stats_ = serial_.get_last_stats();
+            last_stats_.plan = stats.plan;
+            last_stats_.total = total_timer.lap(); // 含读文件与规划
+            return;
+        }
+
+        ParallelExecutor& executor = this->executor();
+        ArenaSetReleaseGuard arena_guard{*arenas_};
+        ParallelStackParser parser(executor, plan.chunk_count, arenas_.get());
+        ParallelStackCollapser collapser(executor, plan.chunk_count);
+        parser.set_progress(progress.get());
+        parser.set_parse_options(parse_opts_);
+        collapser.set_progress(progress.get());
+        if (diagnostics_) {
+            stats.diagnostics.enabled = true;
+            collapser.set_diagnostics(&stats.diagnostics.collapse_table);
+        }
+
+        SampleChunks chunks;
+        PipelinedStackCollapser::Result pipelined;
+        CollapsedEntries collapsed;
+        if (plan.strategy == ExecutionStrategy::Pipelined) {
+            // 解析与折叠重叠执行
+            PipelineOptions pipeline_opts = pipeline_opts_;
+            pipeline_opts.chunk_bytes = plan.chunk_bytes;
+            PipelinedStackCollapser pipeline(executor, *arenas_, collapser, pipeline_opts, plan.threads);
+            pipeline.set_progress(progress.get());
+            pipeline.set_parse_options(parse_opts_);
+            begin_stage(progress.get(), "parse + collapse", buffer.size);
+            pipelined = pipeline.run(buffer.view(), collapse_opts);
+            finish_stage(progress.get());
+            if (pipelined.sample_count == 0) {
+                throw FlameGraphException("No valid samples found in input file");
+            }
+            collapsed = std::move(pipelined.entries);
+            stats.parse = timer.lap("parse + collapse");
+            stats.lines = pipelined.line_count;
+            stats.samples = pipelined.sample_count;
+            stats.memory.samples = pipelined.samples_memory;
+            stats.memory.frames = pipelined.frames_memory;
+        } else {
+            // 并行解析原始数据
+            begin_stage(progress.get(), "parse", buffer.size);
+            chunks = parser.parse(buffer.view());
+            finish_stage(progress.get());
+            record_parse(executor, chunks, stats, timer);
+
+            if (stats.samples == 0) {
+                throw FlameGraphException("No valid samples found in input file");
+            }
+
+            // 并行折叠堆栈
+            begin_stage(progress.get(), "collapse", stats.samples);
+            collapsed = collapser.collapse(chunks, collapse_opts);
+            finish_stage(progress.get());
+            stats.collapse = timer.lap("collapse");
+        }
+        stats.unique_stacks = collapsed.size();
+
+        finish(collapser, collapsed, out_file, suffix, config_, stats, progress.get());
+        stats.jit_frames = parse_opts_.jit_frames() - jit_frames;
+        stats.elf_frames = parse_opts_.elf_frames() - elf_frames;
+        stats.peak_arena_bytes = arenas_->bytes_reserved();
+        stats.total = total_timer.lap();
+        last_stats_ = stats;
+    }
+
+    // 折叠之后的公共部分: 写 folded 文件、并行建树、渲染; 拆分模式下会被多个线程同时调用, 各自填写 stats
+    // stages 为 false 时 progress 只用于检查取消, 不开始新阶段（多个调用共享同一个 progress）
+    void finish(const ParallelStackCollapser& collapser,
+                const CollapsedEntries& collapsed,
+                std::string_view out_file,
+                std::string_view suffix,
+                const FlameGraphConfig& config,
+                RunStats& stats,
+                ProgressReporter* progress,
+                bool stages = true) const {
+        StageTimer timer;
+        ParallelExecutor& executor = *executor_;
+        ParallelFlameGraphBuilder builder(executor, *arenas_);
+        std::unique_ptr<FlameGraphRenderer> renderer;
+        if (suffix == "svg") {
+            renderer = std::make_unique<ParallelSvgFlameGraphRenderer>(config, executor);
+        } else {
+            renderer = FlameGraphRendererFactory::create(suffix, config);
+        }
+        builder.set_progress(progress);
+        renderer->set_progress(progress);
+        ProgressReporter* stage_progress = stages ? progress : nullptr;
+
+        if (collapsed.empty()) {
+            throw FlameGraphException("No stacks remained after collapsing");
+        }
+
+        // 替换后的名字位于 rewriter 中, 须活到渲染结束
+        SymbolRewriter rewriter(symbol_rewrite_options());
+        CollapsedEntries rewritten;
+        const CollapsedEntries* stacks = &collapsed;
+        if (symbol_rewrite_options().enabled()) {
+            rewritten = rewrite_symbols(executor, *arenas_, rewriter, collapsed, stage_progress);
+            stacks = &rewritten;
+            stats.demangled_symbols = rewriter.demangled_count();
+        }
+
+        if (config.write_folded_file) {
+            collapser.write_folded_file(*stacks, std::string(out_file) + ".collapse");
+            stats.bytes_written += file_size_or_zero(std::string(out_file) + ".collapse");
+        }
+        stats.collapse += timer.lap("write folded");
+
+        // 并行构建树
+        FlameGraphBuildOptions build_opts = build_opts_;
+        build_opts.max_depth = config.max_depth;
+        build_opts.prune_threshold = config.min_heat_threshold;
+        begin_stage(stage_progress, "build", stacks->size());
+        FlameNodeRoot root = builder.build_tree(*stacks, build_opts);
+        finish_stage(stage_progress);
+
+        if (root.node->total_count == 0) {
+            throw FlameGraphException("Tree has no samples");
+        }
+        stats.tree_nodes = builder.node_count();
+        stats.max_depth = root.node->height - 1;
+        stats.pruned_nodes = builder.pruned_nodes();
+        if (diagnostics_) {
+            stats.diagnostics.enabled = true;
+            stats.diagnostics.tree = root.node->analyze_tree();
+            stats.diagnostics.children_tables = root.node->children_health();
+            stats.diagnostics.children_tables.rehashes = builder.children_rehashes();
+            stats.distinct_frames = stats.diagnostics.tree.distinct_frames;
+        } else if (detailed_stats_) {
+            stats.distinct_frames = root.node->analyze_tree().distinct_frames;
+        }
+        stats.build += timer.lap("build");
+
+        begin_stage(stage_progress, "render", root.node->total_count);
+        renderer->render(root, out_file);
+        finish_stage(stage_progress);
+        stats.render += timer.lap("render");
+        stats.bytes_written += file_size_or_zero(std::string(out_file));
+        stats.memory.tree = builder.allocations();
+    }
+
+    SymbolRewriteOptions symbol_rewrite_options() const {
+        return {demangle_, parse_opts_.strip_args, parse_opts_.strip_generics};
+    }
+};
+
+} // namespace flamegraph
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// JIT 符号: JIT 运行时（perf-map-agent、node --perf-basic-prof 等）把生成的代码写到 /tmp/perf-<pid>.map,
+// 每行 "START SIZE name", START 与 SIZE 为十六进制; perf 录制或 perf script 时没有读到这些文件,
+// JIT 帧就只剩 "[unknown] (/tmp/perf-<pid>.map)", 这里离线补上
+
+namespace flamegraph {
+
+/**
+ * @brief 一个进程的 perf map: 按起始地址排序的区间数组, 名字直接引用文件内容
+ *
+ * 起始地址单独存一列, 二分查找只访问这一列; 构造后只读, 可被多个线程同时查找
+ */
+class PerfMap {
+  private:
+    struct Range {
+        uint64_t end;
+        std::string_view name;
+    };
+
+    std::string text_;
+    std::vector<uint64_t> starts_;
+    std::vector<Range> ranges_;
+
+  public:
+    PerfMap() = default;
+
+    // 名字引用 text_, 因此不可复制或移动
+    explicit PerfMap(std::string text) : text_(std::move(text)) {
+        index();
+    }
+
+    PerfMap(const PerfMap&) = delete;
+    PerfMap& operator=(const PerfMap&) = delete;
+
+    // 不存在或无法读取的文件视为空表, 与 perf 的行为一致
+    static std::string read(const std::string& path) {
+        std::ifstream ifs(path, std::ios::binary);
+        if (! ifs.is_open()) {
+            return {};
+        }
+        std::ostringstream oss;
+        oss << ifs.rdbuf();
+        return oss.str();
+    }
+
+    // 包含 addr 的区间的名字, 没有时返回空
+    std::string_view find(uint64_t addr) const {
+        auto it = std::upper_bound(starts_.begin(), starts_.end(), addr);
+        if (it == starts_.begin()) {
+            return {};
+        }
+        const Range& range = ranges_[static_cast<size_t>(it - starts_.begin()) - 1];
+        return addr < range.end ? range.name : std::string_view{};
+    }
+
+    size_t size() const {
+        return starts_.size();
+    }
+
+  private:
+    static bool parse_hex(std::string_view text, uint64_t& value) {
+        if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+            text.remove_prefix(2);
+        }
+        auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value, 16);
+        return ec == std::errc() && ptr == text.data() + text.size();
+    }
+
+    void index() {
+        struct Entry {
+            uint64_t start;
+            uint64_t end;
+            std::string_view name;
+        };
+        std::vector<Entry> entries;
+        std::string_view text = text_;
+        for (size_t begin = 0; begin < text.size();) {
+            size_t end = std::min(text.find('\n', begin), text.size());
+            std::string_view line = text.substr(begin, end - begin);
+            begin = end + 1;
+            if (! line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+
+            size_t size_begin = line.find(' ');
+            size_t name_begin = size_begin == std::string_view::npos ? size_begin : line.find(' ', size_begin + 1);
+            if (name_begin == std::string_view::npos || name_begin + 1 >= line.size()) {
+                continue;
+            }
+            uint64_t start = 0;
+            uint64_t size = 0;
+            if (! parse_hex(line.substr(0, size_begin), start) ||
+                ! parse_hex(line.substr(size_begin + 1, name_begin - size_begin - 1), size) || size == 0) {
+                continue;
+            }
+            entries.push_back({start, start + size, line.substr(name_begin + 1)});
+        }
+
+        // 同一地址上的代码可能被重新编译多次, 以文件中最后一条为准
+        std::stable_sort(entries.begin(), entries.end(),
+                         [](const Entry& a, const Entry& b) { return a.start < b.start; });
+        starts_.reserve(entries.size());
+        ranges_.reserve(entries.size());
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (i + 1 < entries.size() && entries[i + 1].start == entries[i].start) {
+                continue;
+            }
+            starts_.push_back(entries[i].start);
+            ranges_.push_back({entries[i].end, entries[i].name});
+        }
+    }
+};
+
+/**
+ * @brief 按 (pid, 地址) 还原 JIT 帧, 可被多个解析线程同时调用
+ *
+ * 每个 pid 的 map 文件在第一次用到时读入并建立索引, 读入在全局锁之外进行, 只有等同一个 pid 的线程会等待;
+ * 查找结果（包括找不到）按 (pid, 地址) 记住,
+ * 同一个地址在后续样本中只需一次哈希查找. 记忆表分片加锁, 减少解析线程之间的争用
+ * 返回的名字引用 resolver 持有的文件内容, 因此 resolver 须活到渲染结束
+ */
+class PerfMapResolver {
+  private:
+    struct Key {
+        uint32_t pid;
+        uint64_t addr;
+
+        bool operator==(const Key& other) const {
+            return pid == other.pid && addr == other.addr;
+        }
+    };
+
+    struct KeyHasher {
+        size_t operator()(const Key& key) const {
+            uint64_t h = (key.addr ^ (uint64_t{key.pid} << 32)) * 0x9E3779B97F4A7C15ULL;
+            return static_cast<size_t>(h ^ (h >> 32));
+        }
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<Key, std::string_view, KeyHasher> memo;
+    };
+
+    // 一个 pid 的 map, 由第一个用到它的线程读入
+    struct MapSlot {
+        std::once_flag loaded;
+        std::unique_ptr<PerfMap> map;
+    };
+
+    static constexpr size_t SHARD_COUNT = 16;
+
+    std::string directory_;
+    std::mutex maps_mutex_; // 只保护 maps_ 本身, 读文件时不持有
+    std::unordered_map<uint32_t, std::unique_ptr<MapSlot>> maps_;
+    std::array<Shard, SHARD_COUNT> shards_;
+    std::atomic<size_t> resolved_frames_{0};
+
+  public:
+    explicit PerfMapResolver(std::string directory = "/tmp") : directory_(std::move(directory)) {}
+
+    // 找不到时返回空
+    std::string_view resolve(uint32_t pid, uint64_t addr) {
+        Key key{pid, addr};
+        size_t hash = KeyHasher{}(key);
+        Shard& shard = shards_[(hash >> 8) % SHARD_COUNT];
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.memo.find(key);
+            if (it != shard.memo.end()) {
+                count(it->second);
+                return it->second;
+            }
+        }
+
+        std::string_view name = map(pid).find(addr);
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.memo.emplace(key, name);
+        }
+        count(name);
+        return name;
+    }
+
+    const PerfMap& map(uint32_t pid) {
+        MapSlot* slot = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(maps_mutex_);
+            auto& entry = maps_[pid];
+            if (! entry) {
+                entry = std::make_unique<MapSlot>();
+            }
+            slot = entry.get();
+        }
+        std::call_once(slot->loaded, [&] { slot->map = std::make_unique<PerfMap>(PerfMap::read(path(pid))); });
+        return *slot->map;
+    }
+
+    std::string path(uint32_t pid) const {
+        return directory_ + "/perf-" + std::to_string(pid) + ".map";
+    }
+
+    // 累计还原成功的帧数（按样本中的帧计, 不是按符号）
+    size_t resolved_frames() const {
+        return resolved_frames_.load(std::memory_order_relaxed);
+    }
+
+  private:
+    void count(std::string_view name) {
+        if (! name.empty()) {
+            resolved_frames_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+};
+
+} // namespace flamegraph
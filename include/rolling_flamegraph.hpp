@@ -0,0 +1,379 @@
+#pragma once
+
+#include "flamegraph.hpp"
+
+#include <deque>
+#include <mutex>
+
+// 常驻进程中的滚动窗口聚合: 持续接收堆栈, 随时输出 "最近 N 个时间段" 的火焰图
+
+namespace flamegraph {
+
+// 🔥 ===== 符号表 =====
+
+/**
+ * @brief 带引用计数的 Frame 驻留表
+ *
+ * 每个不同的 Frame（名字 + 标记）对应一个 id, 堆栈只保存 id 序列;
+ * 引用计数归零的符号立即回收, 其 id 留给之后的新符号复用
+ */
+class SymbolTable {
+  public:
+    using SymbolId = uint32_t;
+
+  private:
+    struct Symbol {
+        std::string name;
+        bool is_func = true;
+        bool lib_include_brackets = false;
+        uint8_t annotations = 0;
+        size_t refs = 0;
+    };
+
+    struct Key {
+        std::string_view name;
+        bool is_func;
+        bool lib_include_brackets;
+        uint8_t annotations;
+
+        bool operator==(const Key& other) const {
+            return is_func == other.is_func && lib_include_brackets == other.lib_include_brackets &&
+                   annotations == other.annotations && name == other.name;
+        }
+    };
+
+    struct KeyHasher {
+        size_t operator()(const Key& key) const noexcept {
+            return (std::hash<std::string_view>{}(key.name) * 256 + key.annotations) * 4 + (key.is_func ? 2 : 0) +
+                   (key.lib_include_brackets ? 1 : 0);
+        }
+    };
+
+    std::deque<Symbol> symbols_; // deque 扩容时元素不移动, 索引中的 name 视图保持有效
+    std::vector<SymbolId> free_ids_;
+    std::unordered_map<Key, SymbolId, KeyHasher> index_;
+
+  public:
+    static constexpr SymbolId NOT_FOUND = UINT32_MAX;
+
+    // 只查找, 不改变引用计数
+    SymbolId find(const Frame& frame) const {
+        auto it = index_.find(Key{frame.name, frame.is_func, frame.lib_include_brackets, frame.annotations});
+        return it == index_.end() ? NOT_FOUND : it->second;
+    }
+
+    // 查找或新建符号, 并增加一次引用
+    SymbolId acquire(const Frame& frame) {
+        auto it = index_.find(Key{frame.name, frame.is_func, frame.lib_include_brackets, frame.annotations});
+        if (it != index_.end()) {
+            ++symbols_[it->second].refs;
+            return it->second;
+        }
+
+        SymbolId id;
+        if (! free_ids_.empty()) {
+            id = free_ids_.back();
+            free_ids_.pop_back();
+        } else {
+            id = static_cast<SymbolId>(symbols_.size());
+            symbols_.emplace_back();
+        }
+
+        Symbol& symbol = symbols_[id];
+        symbol.name.assign(frame.name);
+        symbol.is_func = frame.is_func;
+        symbol.lib_include_brackets = frame.lib_include_brackets;
+        symbol.annotations = frame.annotations;
+        symbol.refs = 1;
+        index_.emplace(Key{symbol.name, symbol.is_func, symbol.lib_include_brackets, symbol.annotations}, id);
+        return id;
+    }
+
+    // 减少一次引用, 归零时回收
+    void release(SymbolId id) {
+        Symbol& symbol = symbols_[id];
+        if (--symbol.refs > 0) {
+            return;
+        }
+        index_.erase(Key{symbol.name, symbol.is_func, symbol.lib_include_brackets, symbol.annotations});
+        std::string().swap(symbol.name);
+        free_ids_.push_back(id);
+    }
+
+    // name 指向表内的字符串, 只在该符号存活期间有效
+    Frame frame(SymbolId id) const {
+        const Symbol& symbol = symbols_[id];
+        return Frame{symbol.name, symbol.is_func, symbol.lib_include_brackets, symbol.annotations};
+    }
+
+    bool alive(SymbolId id) const {
+        return symbols_[id].refs > 0;
+    }
+
+    size_t capacity() const {
+        return symbols_.size();
+    }
+
+    size_t size() const {
+        return index_.size();
+    }
+};
+
+// 🔥 ===== 滚动窗口聚合 =====
+
+/**
+ * @brief 滚动窗口聚合器
+ *
+ * 窗口由 interval_count 个时间段组成, 每个时间段单独保存自己的折叠结果（堆栈 id -> 次数）,
+ * 同时维护整个窗口的合并结果: 新数据直接累加到当前时间段和合并结果, 时间段过期时把它的计数从
+ * 合并结果中减掉, 计数归零的堆栈及其不再被引用的符号随即回收。输出快照只需遍历合并结果,
+ * 不必重新聚合整个窗口。所有公开方法都是线程安全的
+ */
+class RollingFlameGraphAggregator {
+  public:
+    using SymbolId = SymbolTable::SymbolId;
+    using StackId = uint32_t;
+
+  private:
+    using StackKey = std::vector<SymbolId>; // 从根到叶
+
+    struct StackKeyHasher {
+        size_t operator()(const StackKey& key) const noexcept {
+            size_t hash = 0;
+            for (SymbolId id : key) {
+                hash ^= id + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+            }
+            return hash;
+        }
+    };
+
+    struct Stack {
+        StackKey key;
+        size_t count = 0; // 整个窗口内的计数, 0 表示该槽位空闲
+    };
+
+    using Interval = std::unordered_map<StackId, size_t>;
+
+    mutable std::mutex mutex_;
+    size_t interval_count_;
+    uint64_t interval_us_;
+    uint64_t interval_start_us_ = 0;
+
+    SymbolTable symbols_;
+    std::vector<Stack> stacks_;
+    std::vector<StackId> free_stacks_;
+    std::unordered_map<StackKey, StackId, StackKeyHasher> stack_index_;
+    std::deque<Interval> intervals_; // 最新的在 back
+    size_t total_count_ = 0;
+    StackKey scratch_key_; // 查找用的临时键, 持锁使用; 已有堆栈（最常见的情况）不分配内存
+
+  public:
+    // interval_us 为 0 时只在调用 rotate() 时切换时间段
+    explicit RollingFlameGraphAggregator(size_t interval_count, uint64_t interval_us = 0)
+        : interval_count_(std::max<size_t>(1, interval_count)), interval_us_(interval_us) {
+        intervals_.emplace_back();
+    }
+
+    // 添加一条堆栈, frames 从根到叶
+    void add_stack(const Frame* frames, size_t size, size_t count = 1) {
+        if (size == 0 || count == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        add_stack_locked(frames, size, count);
+    }
+
+    void add_samples(const StackSamples& samples) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& sample : samples.raw_samples) {
+            if (sample.is_valid()) {
+                add_stack_locked(sample.frames.data(), sample.frames.size(), sample.count);
+            }
+        }
+    }
+
+    // 解析一段原始数据（perf script 或 folded 格式）并加入当前时间段;
+    // options 只作用于解析阶段, 名字中间的模板参数不在这里去掉
+    void add_text(std::string_view buffer, const ParseOptions& options = {}) {
+        auto parser = AutoDetectParser::detect_parser(buffer, options);
+        StackSamplesContext ctx;
+        StackSamples samples = ctx.create_samples();
+        parser->parse_into(buffer, ctx, samples);
+        add_samples(samples);
+    }
+
+    // 开始一个新的时间段, 窗口已满时最旧的时间段过期
+    void rotate() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        rotate_locked();
+    }
+
+    // 按时间推进: 跨过几个时间段边界就切换几次
+    void advance_to(uint64_t now_us) {
+        if (interval_us_ == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (interval_start_us_ == 0) {
+            interval_start_us_ = now_us;
+            return;
+        }
+        // 停顿超过整个窗口时, 切换 interval_count 次已足以清空
+        size_t steps = 0;
+        while (now_us >= interval_start_us_ + interval_us_ && steps < interval_count_) {
+            interval_start_us_ += interval_us_;
+            rotate_locked();
+            ++steps;
+        }
+        if (now_us >= interval_start_us_ + interval_us_) {
+            interval_start_us_ = now_us - (now_us - interval_start_us_) % interval_us_;
+        }
+    }
+
+    // 输出当前窗口的火焰图, 后缀决定格式（svg/html）
+    void snapshot(std::string_view out_file, const FlameGraphConfig& config = {}) const {
+        auto suffix = file_suffix(out_file);
+        if (suffix.empty()) {
+            throw FlameGraphException(std::string("File suffix empty") + out_file.data());
+        }
+
+        GenerationArena arena;
+        CollapsedStack collapsed = snapshot_stacks(arena.resource());
+        if (collapsed.empty()) {
+            throw FlameGraphException("No samples in the current window");
+        }
+
+        FlameGraphBuildOptions build_opts;
+        build_opts.max_depth = config.max_depth;
+        build_opts.prune_threshold = config.min_heat_threshold;
+        FlameNodeRoot root = FlameGraphBuilder(arena.resource()).build_tree(collapsed, build_opts);
+        FlameGraphRendererFactory::create(suffix, config)->render(root, out_file);
+    }
+
+    // 把当前窗口的合并结果复制到 resource 中; 只在复制期间持锁, 之后的建树与渲染不阻塞写入
+    CollapsedStack snapshot_stacks(std::pmr::memory_resource* resource) const {
+        CollapsedStack collapsed(resource);
+        std::pmr::polymorphic_allocator<char> char_alloc(resource);
+        std::pmr::polymorphic_allocator<Frame> frame_alloc(resource);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        // 每个存活符号复制一次
+        std::vector<Frame> frames(symbols_.capacity());
+        for (SymbolId id = 0; id < symbols_.capacity(); ++id) {
+            if (! symbols_.alive(id)) {
+                continue;
+            }
+            Frame frame = symbols_.frame(id);
+            char* name = char_alloc.allocate(std::max<size_t>(1, frame.name.size()));
+            std::copy(frame.name.begin(), frame.name.end(), name);
+            frames[id] = Frame{std::string_view(name, frame.name.size()), frame.is_func, frame.lib_include_brackets,
+                               frame.annotations};
+        }
+
+        collapsed.collapsed.reserve(stack_index_.size());
+        for (const auto& stack : stacks_) {
+            if (stack.count == 0) {
+                continue;
+            }
+            Frame* arr = frame_alloc.allocate(stack.key.size());
+            for (size_t i = 0; i < stack.key.size(); ++i) {
+                new (arr + i) Frame(frames[stack.key[i]]);
+            }
+            collapsed.collapsed.emplace(FramesView{arr, stack.key.size()}, stack.count);
+        }
+        return collapsed;
+    }
+
+    size_t total_count() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return total_count_;
+    }
+
+    size_t stack_count() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stack_index_.size();
+    }
+
+    size_t symbol_count() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return symbols_.size();
+    }
+
+    size_t interval_count() const {
+        return interval_count_;
+    }
+
+  private:
+    void add_stack_locked(const Frame* frames, size_t size, size_t count) {
+        StackId id = find_or_create_stack(frames, size);
+        stacks_[id].count += count;
+        intervals_.back()[id] += count;
+        total_count_ += count;
+    }
+
+    // 每个存活的堆栈对其中每个 Frame 持有一次符号引用
+    StackId find_or_create_stack(const Frame* frames, size_t size) {
+        // 先只查不建: 已有堆栈（最常见的情况）不改动引用计数
+        StackKey& key = scratch_key_;
+        key.clear();
+        bool all_known = true;
+        for (size_t i = 0; i < size && all_known; ++i) {
+            SymbolId id = symbols_.find(frames[i]);
+            all_known = id != SymbolTable::NOT_FOUND;
+            key.push_back(id);
+        }
+        if (all_known) {
+            auto it = stack_index_.find(key);
+            if (it != stack_index_.end()) {
+                return it->second;
+            }
+        }
+
+        key.clear();
+        for (size_t i = 0; i < size; ++i) {
+            key.push_back(symbols_.acquire(frames[i]));
+        }
+
+        StackId id;
+        if (! free_stacks_.empty()) {
+            id = free_stacks_.back();
+            free_stacks_.pop_back();
+        } else {
+            id = static_cast<StackId>(stacks_.size());
+            stacks_.emplace_back();
+        }
+        stacks_[id].key = key;
+        stacks_[id].count = 0;
+        stack_index_.emplace(std::move(key), id); // 新堆栈才把临时键移入索引
+        return id;
+    }
+
+    void rotate_locked() {
+        intervals_.emplace_back();
+        while (intervals_.size() > interval_count_) {
+            expire(intervals_.front());
+            intervals_.pop_front();
+        }
+    }
+
+    // 从合并结果中减去一个过期时间段, 回收计数归零的堆栈和符号
+    void expire(const Interval& interval) {
+        for (const auto& [id, count] : interval) {
+            Stack& stack = stacks_[id];
+            stack.count -= count;
+            total_count_ -= count;
+            if (stack.count > 0) {
+                continue;
+            }
+            for (SymbolId symbol : stack.key) {
+                symbols_.release(symbol);
+            }
+            stack_index_.erase(stack.key);
+            StackKey().swap(stack.key);
+            free_stacks_.push_back(id);
+        }
+    }
+};
+
+} // namespace flamegraph
@@ -0,0 +1,595 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#if defined(FLAMEGRAPH_USE_TBB)
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+#include <tbb/parallel_sort.h>
+#include <tbb/task_arena.h>
+#endif
+
+// 并行后端: 默认使用内置的 work-stealing 线程池, 定义 FLAMEGRAPH_USE_TBB 后改用 TBB
+// 两种后端对外提供相同的 ParallelExecutor 接口
+
+namespace flamegraph {
+
+/**
+ * @brief 按执行线程累计忙碌时间, 用于衡量负载不均
+ *
+ * run() 计时的区间只计最外层: 嵌套区间的时间已包含在外层中; 区间内等待其它线程的时间
+ * 由线程池通过 add_idle() 扣除。关闭时线程池每个任务只多一次 relaxed 读
+ */
+class WorkerTimer {
+  private:
+    std::vector<std::atomic<int64_t>> busy_ns_;
+    std::atomic<bool> enabled_{false};
+
+    inline static thread_local size_t tl_depth_ = 0;
+
+  public:
+    explicit WorkerTimer(size_t slots) : busy_ns_(std::max<size_t>(1, slots)) {}
+
+    bool enabled() const {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    void set_enabled(bool enabled) {
+        enabled_.store(enabled, std::memory_order_relaxed);
+    }
+
+    void reset() {
+        for (auto& busy : busy_ns_) {
+            busy.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // 下标为执行线程编号
+    std::vector<double> busy_seconds() const {
+        std::vector<double> seconds;
+        for (const auto& busy : busy_ns_) {
+            seconds.push_back(static_cast<double>(std::max<int64_t>(0, busy.load(std::memory_order_relaxed))) * 1e-9);
+        }
+        return seconds;
+    }
+
+    // 把 f 的执行时间记到 slot 上; 未开启时直接执行
+    template <typename F>
+    void run(size_t slot, F&& f) {
+        if (tl_depth_ > 0 || ! enabled()) {
+            f();
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        ++tl_depth_;
+        try {
+            f();
+        } catch (...) {
+            --tl_depth_;
+            throw;
+        }
+        --tl_depth_;
+        add(slot, std::chrono::steady_clock::now() - start);
+    }
+
+    // 计时区间内无事可做的等待, 从忙碌时间中扣除
+    void add_idle(size_t slot, std::chrono::steady_clock::duration idle) {
+        if (tl_depth_ > 0) {
+            add(slot, -idle);
+        }
+    }
+
+  private:
+    void add(size_t slot, std::chrono::steady_clock::duration d) {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+        busy_ns_[slot % busy_ns_.size()].fetch_add(static_cast<int64_t>(ns), std::memory_order_relaxed);
+    }
+};
+
+/**
+ * @brief 轻量的 work-stealing 线程池
+ *
+ * 每个 worker 一个双端队列: 自己从尾部取（LIFO, 缓存友好）, 其它线程从头部偷（FIFO, 偷到的是大块任务）
+ * 外部线程提交的任务进入共享注入队列; 调用 parallel_for 的线程在等待期间也参与执行任务,
+ * 因此嵌套的 parallel_for 不会死锁, 且 concurrency = workers + 1
+ */
+class WorkStealingPool {
+  private:
+    // 区间任务, 不做类型擦除的堆分配: 回调与上下文都在发起者的栈上
+    struct Task {
+        void (*run)(void* ctx, size_t begin, size_t end) = nullptr;
+        void* ctx = nullptr;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::thread> workers_;
+    std::vector<std::unique_ptr<WorkQueue>> queues_; // [0, workers) 属于各 worker, 最后一个是注入队列
+    std::atomic<size_t> queued_{0};
+    std::atomic<size_t> sleepers_{0};
+    std::atomic<bool> stop_{false};
+    std::mutex sleep_mutex_;
+    std::condition_variable sleep_cv_;
+    WorkerTimer timer_;
+
+    inline static thread_local WorkStealingPool* tl_pool_ = nullptr;
+    inline static thread_local size_t tl_index_ = 0;
+
+  public:
+    // concurrency 为参与计算的线程总数（含调用者）, 0 表示硬件线程数
+    explicit WorkStealingPool(size_t concurrency = 0) : timer_(resolve_concurrency(concurrency)) {
+        size_t worker_count = resolve_concurrency(concurrency) - 1;
+
+        for (size_t i = 0; i <= worker_count; ++i) {
+            queues_.push_back(std::make_unique<WorkQueue>());
+        }
+        workers_.reserve(worker_count);
+        for (size_t i = 0; i < worker_count; ++i) {
+            workers_.emplace_back([this, i] { worker_loop(i); });
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            stop_.store(true);
+        }
+        sleep_cv_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    size_t concurrency() const {
+        return workers_.size() + 1;
+    }
+
+    // 每个线程执行任务的时间, 默认关闭; 外部线程的时间只计它自己用 timer().run() 包起来的部分
+    WorkerTimer& timer() {
+        return timer_;
+    }
+
+    // 当前线程在池中的编号, [0, concurrency); 外部线程统一为最后一个编号
+    size_t worker_index() const {
+        return tl_pool_ == this ? tl_index_ : workers_.size();
+    }
+
+    // 对 [begin, end) 的每个下标调用 f(i); grain 为单个任务最少处理的下标数, 0 表示自动
+    template <typename F>
+    void parallel_for(size_t begin, size_t end, F&& f, size_t grain = 0) {
+        if (begin >= end) return;
+        size_t n = end - begin;
+        if (grain == 0) {
+            grain = std::max<size_t>(1, n / (concurrency() * 8));
+        }
+        if (workers_.empty() || n <= grain) {
+            for (size_t i = begin; i < end; ++i) {
+                f(i);
+            }
+            return;
+        }
+
+        using Fn = std::remove_reference_t<F>;
+        ForJob<Fn> job(&f, grain, this, n);
+        run_range<Fn>(&job, begin, end);
+
+        // 调用者执行完自己的那一份后帮忙执行其它任务, 直到全部完成
+        while (job.remaining.load(std::memory_order_acquire) != 0) {
+            Task task;
+            if (try_take(task)) {
+                task.run(task.ctx, task.begin, task.end);
+            } else if (timer_.enabled()) {
+                auto start = std::chrono::steady_clock::now();
+                std::this_thread::yield();
+                timer_.add_idle(worker_index(), std::chrono::steady_clock::now() - start);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        if (job.error) {
+            std::rethrow_exception(job.error);
+        }
+    }
+
+    // 把 [begin, end) 分块, 每块 body(b, e, identity) 得到局部结果, 再按块顺序 combine（结果确定）
+    template <typename T, typename Body, typename Combine>
+    T parallel_reduce(size_t begin, size_t end, T identity, Body&& body, Combine&& combine, size_t grain = 0) {
+        if (begin >= end) return identity;
+        size_t n = end - begin;
+        if (grain == 0) {
+            grain = std::max<size_t>(1, n / (concurrency() * 4));
+        }
+        size_t blocks = (n + grain - 1) / grain;
+        std::vector<T> partial(blocks, identity);
+        parallel_for(size_t{0}, blocks, [&](size_t blk) {
+            size_t b = begin + blk * grain;
+            size_t e = std::min(end, b + grain);
+            partial[blk] = body(b, e, identity);
+        }, 1);
+
+        T result = identity;
+        for (auto& value : partial) {
+            result = combine(std::move(result), std::move(value));
+        }
+        return result;
+    }
+
+    // 分块并行排序, 再逐轮两两归并
+    template <typename It, typename Cmp>
+    void parallel_sort(It first, It last, Cmp cmp) {
+        constexpr size_t SERIAL_CUTOFF = 4096;
+        size_t n = static_cast<size_t>(std::distance(first, last));
+        if (workers_.empty() || n <= SERIAL_CUTOFF) {
+            std::sort(first, last, cmp);
+            return;
+        }
+
+        size_t blocks = 1;
+        while (blocks < concurrency() * 2 && n / (blocks * 2) >= SERIAL_CUTOFF) {
+            blocks *= 2;
+        }
+        auto at = [&](size_t blk) {
+            return first + static_cast<std::ptrdiff_t>(std::min(n, n / blocks * blk));
+        };
+        auto bound = [&](size_t blk) {
+            return blk >= blocks ? last : at(blk);
+        };
+
+        parallel_for(size_t{0}, blocks, [&](size_t blk) { std::sort(bound(blk), bound(blk + 1), cmp); }, 1);
+
+        for (size_t width = 1; width < blocks; width *= 2) {
+            size_t pairs = blocks / (width * 2);
+            parallel_for(size_t{0}, pairs, [&](size_t p) {
+                size_t lo = p * width * 2;
+                std::inplace_merge(bound(lo), bound(lo + width), bound(lo + width * 2), cmp);
+            }, 1);
+        }
+    }
+
+  private:
+    static size_t resolve_concurrency(size_t concurrency) {
+        return concurrency == 0 ? std::max<unsigned>(1, std::thread::hardware_concurrency()) : concurrency;
+    }
+
+    template <typename Fn>
+    struct ForJob {
+        Fn* fn;
+        size_t grain;
+        WorkStealingPool* pool;
+        std::atomic<size_t> remaining; // 尚未执行完的下标数
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;
+
+        ForJob(Fn* fn, size_t grain, WorkStealingPool* pool, size_t n)
+            : fn(fn), grain(grain), pool(pool), remaining(n) {}
+    };
+
+    template <typename Fn>
+    static void run_range(void* ctx, size_t begin, size_t end) {
+        auto& job = *static_cast<ForJob<Fn>*>(ctx);
+        // 不断二分, 右半部分留给别的线程偷
+        while (end - begin > job.grain) {
+            size_t mid = begin + (end - begin) / 2;
+            job.pool->push(Task{&run_range<Fn>, ctx, mid, end});
+            end = mid;
+        }
+        // 出错后剩余任务只做计数, 尽快结束
+        if (! job.failed.load(std::memory_order_relaxed)) {
+            try {
+                for (size_t i = begin; i < end; ++i) {
+                    (*job.fn)(i);
+                }
+            } catch (...) {
+                if (! job.failed.exchange(true)) {
+                    job.error = std::current_exception();
+                }
+            }
+        }
+        // 最后一步: 计数归零后发起者可能立即返回, 之后不能再访问 job
+        job.remaining.fetch_sub(end - begin, std::memory_order_acq_rel);
+    }
+
+    void push(const Task& task) {
+        size_t index = (tl_pool_ == this) ? tl_index_ : queues_.size() - 1;
+        {
+            std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+            queues_[index]->tasks.push_back(task);
+        }
+        queued_.fetch_add(1);
+        if (sleepers_.load() > 0) {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            sleep_cv_.notify_one();
+        }
+    }
+
+    // 先取自己的队尾, 再从其它队列头部偷
+    bool try_take(Task& task) {
+        size_t count = queues_.size();
+        size_t self = (tl_pool_ == this) ? tl_index_ : count - 1;
+
+        if (pop_back(*queues_[self], task)) return true;
+        for (size_t k = 1; k < count; ++k) {
+            if (pop_front(*queues_[(self + k) % count], task)) return true;
+        }
+        return false;
+    }
+
+    bool pop_back(WorkQueue& q, Task& task) {
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.tasks.empty()) return false;
+        task = q.tasks.back();
+        q.tasks.pop_back();
+        queued_.fetch_sub(1);
+        return true;
+    }
+
+    bool pop_front(WorkQueue& q, Task& task) {
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.tasks.empty()) return false;
+        task = q.tasks.front();
+        q.tasks.pop_front();
+        queued_.fetch_sub(1);
+        return true;
+    }
+
+    void worker_loop(size_t index) {
+        tl_pool_ = this;
+        tl_index_ = index;
+
+        while (true) {
+            Task task;
+            if (try_take(task)) {
+                timer_.run(index, [&] { task.run(task.ctx, task.begin, task.end); });
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            sleepers_.fetch_add(1);
+            sleep_cv_.wait(lock, [this] { return stop_.load() || queued_.load() > 0; });
+            sleepers_.fetch_sub(1);
+            if (stop_.load()) return;
+        }
+    }
+};
+
+/**
+ * @brief 有界无锁队列（Vyukov bounded MPMC）, 同样适用于 SPSC/MPSC 场景
+ *
+ * 每个槽位带一个序号: 生产者等待序号 == pos, 消费者等待序号 == pos + 1
+ * 满时 try_push 失败, 由调用方决定等待还是改做别的事, 以此实现背压
+ */
+template <typename T>
+class BoundedQueue {
+  private:
+    struct Cell {
+        std::atomic<size_t> sequence{0};
+        T data{};
+    };
+
+    static constexpr size_t CACHE_LINE = 64;
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+    alignas(CACHE_LINE) std::atomic<size_t> enqueue_pos_{0};
+    alignas(CACHE_LINE) std::atomic<size_t> dequeue_pos_{0};
+
+  public:
+    // 容量向上取整到 2 的幂
+    explicit BoundedQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size *= 2;
+        }
+        cells_ = std::make_unique<Cell[]>(size);
+        mask_ = size - 1;
+        for (size_t i = 0; i < size; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    size_t capacity() const {
+        return mask_ + 1;
+    }
+
+    // 近似长度, 只用于调度决策
+    size_t size_approx() const {
+        size_t enq = enqueue_pos_.load(std::memory_order_relaxed);
+        size_t deq = dequeue_pos_.load(std::memory_order_relaxed);
+        return enq > deq ? enq - deq : 0;
+    }
+
+    bool try_push(T value) {
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells_[pos & mask_];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            if (seq == pos) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.data = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (seq < pos) {
+                return false; // 已满
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop(T& value) {
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells_[pos & mask_];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            if (seq == pos + 1) {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.data);
+                    cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (seq < pos + 1) {
+                return false; // 为空
+            } else {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+};
+
+#if defined(FLAMEGRAPH_USE_TBB)
+
+/**
+ * @brief TBB 后端: task_arena 限定线程数, 算法直接转发给 TBB
+ */
+class ParallelExecutor {
+  private:
+    tbb::task_arena arena_;
+    WorkerTimer timer_;
+
+  public:
+    explicit ParallelExecutor(size_t concurrency = 0)
+        : arena_(concurrency == 0 ? tbb::task_arena::automatic : static_cast<int>(concurrency)),
+          timer_(static_cast<size_t>(arena_.max_concurrency())) {}
+
+    size_t concurrency() const {
+        return static_cast<size_t>(arena_.max_concurrency());
+    }
+
+    std::string_view backend_name() const {
+        return "tbb";
+    }
+
+    // 当前线程在 arena 中的槽位编号, [0, concurrency); 不在 arena 内时为 0
+    size_t worker_index() const {
+        int index = tbb::this_task_arena::current_thread_index();
+        return index < 0 ? 0 : static_cast<size_t>(index);
+    }
+
+    // 每个线程的忙碌时间统计, 默认关闭; 只计 parallel_for 与 parallel_reduce 的循环体,
+    // 调用线程自己的时间由调用方用 run() 包起来计入（其中等待 TBB 的时间也算作忙碌）
+    WorkerTimer& worker_timer() {
+        return timer_;
+    }
+
+    template <typename F>
+    void parallel_for(size_t begin, size_t end, F&& f, size_t grain = 0) {
+        if (timer_.enabled()) {
+            for_each_index(begin, end, [&](size_t i) { timer_.run(worker_index(), [&] { f(i); }); }, grain);
+        } else {
+            for_each_index(begin, end, f, grain);
+        }
+    }
+
+    template <typename T, typename Body, typename Combine>
+    T parallel_reduce(size_t begin, size_t end, T identity, Body&& body, Combine&& combine, size_t grain = 1) {
+        return arena_.execute([&] {
+            return tbb::parallel_deterministic_reduce(
+                tbb::blocked_range<size_t>(begin, end, std::max<size_t>(1, grain)),
+                identity,
+                [&](const tbb::blocked_range<size_t>& r, T init) {
+                    T result;
+                    timer_.run(worker_index(), [&] { result = body(r.begin(), r.end(), std::move(init)); });
+                    return result;
+                },
+                [&](T a, T b) { return combine(std::move(a), std::move(b)); });
+        });
+    }
+
+    template <typename It, typename Cmp>
+    void parallel_sort(It first, It last, Cmp cmp) {
+        arena_.execute([&] { tbb::parallel_sort(first, last, cmp); });
+    }
+
+  private:
+    template <typename F>
+    void for_each_index(size_t begin, size_t end, F&& f, size_t grain) {
+        arena_.execute([&] {
+            if (grain == 0) {
+                tbb::parallel_for(begin, end, f);
+            } else {
+                tbb::parallel_for(tbb::blocked_range<size_t>(begin, end, grain),
+                                  [&](const tbb::blocked_range<size_t>& r) {
+                                      for (size_t i = r.begin(); i != r.end(); ++i) {
+                                          f(i);
+                                      }
+                                  });
+            }
+        });
+    }
+};
+
+#else
+
+/**
+ * @brief 默认后端: 内置 work-stealing 线程池, 线程在多次 generate 之间复用
+ */
+class ParallelExecutor {
+  private:
+    WorkStealingPool pool_;
+
+  public:
+    explicit ParallelExecutor(size_t concurrency = 0) : pool_(concurrency) {}
+
+    size_t concurrency() const {
+        return pool_.concurrency();
+    }
+
+    std::string_view backend_name() const {
+        return "work-stealing";
+    }
+
+    size_t worker_index() const {
+        return pool_.worker_index();
+    }
+
+    // 每个线程的忙碌时间统计, 默认关闭; 调用线程自己的时间由调用方用 run() 包起来计入
+    WorkerTimer& worker_timer() {
+        return pool_.timer();
+    }
+
+    template <typename F>
+    void parallel_for(size_t begin, size_t end, F&& f, size_t grain = 0) {
+        pool_.parallel_for(begin, end, std::forward<F>(f), grain);
+    }
+
+    template <typename T, typename Body, typename Combine>
+    T parallel_reduce(size_t begin, size_t end, T identity, Body&& body, Combine&& combine, size_t grain = 0) {
+        return pool_.parallel_reduce(begin, end, std::move(identity), body, combine, grain);
+    }
+
+    template <typename It, typename Cmp>
+    void parallel_sort(It first, It last, Cmp cmp) {
+        pool_.parallel_sort(first, last, cmp);
+    }
+};
+
+#endif
+
+} // namespace flamegraph